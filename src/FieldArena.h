@@ -0,0 +1,280 @@
+/*
+ * A single allocation holding many fields over a HexGrid.
+ */
+
+#ifndef _FIELDARENA_H_
+#define _FIELDARENA_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <array>
+#include <stdexcept>
+#include <new>
+
+using std::runtime_error;
+using std::array;
+
+namespace morph {
+
+    /*!
+     * How FieldArena lays out its fields in memory.
+     */
+    enum class FieldLayout {
+        SoA,        // Each field contiguous (field-major), padded to a cache line
+        Interleaved // The fields' values for each hex together (hex-major)
+    };
+
+    /*!
+     * A view of one field in a FieldArena, with the element access and iterators of a
+     * vector, so that it can be used with range-for and the standard algorithms. In the
+     * Interleaved layout successive elements are stride apart in memory, so data() may
+     * only be handed to code that expects contiguous values if contiguous() is true.
+     */
+    template <class Flt>
+    class FieldView
+    {
+    public:
+        /*!
+         * A random access iterator over the elements of a view, stride apart. T is Flt or
+         * const Flt.
+         */
+        template <typename T>
+        class strided_iterator
+        {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef typename std::remove_const<T>::type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef T* pointer;
+            typedef T& reference;
+
+            strided_iterator (void) {}
+            strided_iterator (T* p_, difference_type i_, unsigned int stride_)
+                : p(p_), i(i_), stride(stride_) {}
+
+            T& operator* (void) const { return this->p[this->i * this->stride]; }
+            T* operator-> (void) const { return this->p + this->i * this->stride; }
+            T& operator[] (difference_type d) const { return this->p[(this->i + d) * this->stride]; }
+
+            strided_iterator& operator++ (void) { ++this->i; return *this; }
+            strided_iterator& operator-- (void) { --this->i; return *this; }
+            strided_iterator operator++ (int) { strided_iterator t = *this; ++this->i; return t; }
+            strided_iterator operator-- (int) { strided_iterator t = *this; --this->i; return t; }
+            strided_iterator& operator+= (difference_type d) { this->i += d; return *this; }
+            strided_iterator& operator-= (difference_type d) { this->i -= d; return *this; }
+            strided_iterator operator+ (difference_type d) const { return strided_iterator (this->p, this->i + d, this->stride); }
+            strided_iterator operator- (difference_type d) const { return strided_iterator (this->p, this->i - d, this->stride); }
+            friend strided_iterator operator+ (difference_type d, const strided_iterator& it) { return it + d; }
+            difference_type operator- (const strided_iterator& o) const { return this->i - o.i; }
+
+            bool operator== (const strided_iterator& o) const { return this->p == o.p && this->i == o.i; }
+            bool operator!= (const strided_iterator& o) const { return !(*this == o); }
+            bool operator< (const strided_iterator& o) const { return this->i < o.i; }
+            bool operator> (const strided_iterator& o) const { return this->i > o.i; }
+            bool operator<= (const strided_iterator& o) const { return this->i <= o.i; }
+            bool operator>= (const strided_iterator& o) const { return this->i >= o.i; }
+
+        private:
+            T* p = nullptr;
+            difference_type i = 0;
+            unsigned int stride = 1;
+        };
+
+        typedef Flt value_type;
+        typedef strided_iterator<Flt> iterator;
+        typedef strided_iterator<const Flt> const_iterator;
+
+        FieldView (Flt* p_, unsigned int n_, unsigned int stride_)
+            : p(p_), n(n_), stride(stride_) {}
+
+        iterator begin (void) { return iterator (this->p, 0, this->stride); }
+        iterator end (void) { return iterator (this->p, this->n, this->stride); }
+        const_iterator begin (void) const { return const_iterator (this->p, 0, this->stride); }
+        const_iterator end (void) const { return const_iterator (this->p, this->n, this->stride); }
+
+        Flt& operator[] (unsigned int i) { return this->p[i*this->stride]; }
+        const Flt& operator[] (unsigned int i) const { return this->p[i*this->stride]; }
+        unsigned int size (void) const { return this->n; }
+        Flt* data (void) { return this->p; }
+        const Flt* data (void) const { return this->p; }
+        unsigned int getStride (void) const { return this->stride; }
+        bool contiguous (void) const { return this->stride == 1; }
+
+        //! Set every element to val
+        void assign (Flt val) {
+            for (unsigned int i = 0; i < this->n; ++i) { this->p[i*this->stride] = val; }
+        }
+
+    private:
+        Flt* p;
+        unsigned int n;
+        unsigned int stride;
+    };
+
+    /*!
+     * Holds nfields fields, each of n values, in a single allocation aligned to a 64 byte
+     * cache line, in either the SoA or the Interleaved layout. fa[i] gives a FieldView of
+     * field i, so that fa[i][h] reads and writes element h of field i whichever the layout.
+     * Copying a FieldArena is one memcpy, which makes a snapshot of the whole state cheap,
+     * and the whole state can be written to HDF5 in one call (see
+     * RD_Base::saveFieldArena).
+     *
+     * In the SoA layout, field i starts at data() + i * fieldStride(), and each field is
+     * padded to a multiple of 64 bytes so that each starts on a cache line. In the
+     * Interleaved layout, element h of field i is at data() + h * nfields + i.
+     */
+    template <class Flt>
+    class FieldArena
+    {
+    public:
+        FieldArena (void) {}
+
+        FieldArena (unsigned int nfields_, unsigned int n_, FieldLayout layout_ = FieldLayout::SoA) {
+            this->resize (nfields_, n_, layout_);
+        }
+
+        FieldArena (const FieldArena<Flt>& other) {
+            *this = other;
+        }
+
+        FieldArena<Flt>& operator= (const FieldArena<Flt>& other) {
+            if (this != &other) {
+                if (this->total != other.total) {
+                    this->release();
+                    this->allocate (other.total);
+                }
+                this->nf = other.nf;
+                this->n = other.n;
+                this->fstride = other.fstride;
+                this->lay = other.lay;
+                if (this->total > 0) {
+                    std::memcpy (this->p, other.p, this->total * sizeof(Flt));
+                }
+            }
+            return *this;
+        }
+
+        ~FieldArena (void) {
+            this->release();
+        }
+
+        /*!
+         * (Re)allocate for nfields_ fields of n_ values each, all zero.
+         */
+        void resize (unsigned int nfields_, unsigned int n_, FieldLayout layout_ = FieldLayout::SoA) {
+            this->nf = nfields_;
+            this->n = n_;
+            this->lay = layout_;
+            if (layout_ == FieldLayout::SoA) {
+                const unsigned int perline = 64 / sizeof(Flt);
+                this->fstride = ((n_ + perline - 1) / perline) * perline;
+            } else {
+                this->fstride = 1;
+            }
+            size_t newtotal = (layout_ == FieldLayout::SoA)
+                ? (size_t)this->fstride * nfields_ : (size_t)n_ * nfields_;
+            if (newtotal != this->total) {
+                this->release();
+                this->allocate (newtotal);
+            }
+            this->zero();
+        }
+
+        //! Set every value (and any padding) to 0
+        void zero (void) {
+            if (this->total > 0) {
+                std::memset (this->p, 0, this->total * sizeof(Flt));
+            }
+        }
+
+        //! A view of field i
+        //@{
+        FieldView<Flt> operator[] (unsigned int i) {
+            return FieldView<Flt> (this->fieldStart (i), this->n, this->elementStride());
+        }
+        const FieldView<Flt> operator[] (unsigned int i) const {
+            return FieldView<Flt> (const_cast<Flt*>(this->fieldStart (i)), this->n, this->elementStride());
+        }
+        //@}
+
+        /*!
+         * Fields 2i and 2i+1, as the x and y components of (mathematical) vector field i,
+         * such as a gradient. See RD_Base::resize_vector_array_arena.
+         */
+        //@{
+        array<FieldView<Flt>, 2> vectorField (unsigned int i) {
+            return {{ (*this)[2*i], (*this)[2*i+1] }};
+        }
+        const array<FieldView<Flt>, 2> vectorField (unsigned int i) const {
+            return {{ (*this)[2*i], (*this)[2*i+1] }};
+        }
+        //@}
+
+        //! The number of fields
+        unsigned int size (void) const { return this->nf; }
+
+        //! The number of values in each field
+        unsigned int fieldSize (void) const { return this->n; }
+
+        FieldLayout layout (void) const { return this->lay; }
+
+        //! The distance between the first elements of successive fields
+        unsigned int fieldStride (void) const {
+            return this->lay == FieldLayout::SoA ? this->fstride : 1;
+        }
+
+        //! The distance between successive elements of one field
+        unsigned int elementStride (void) const {
+            return this->lay == FieldLayout::SoA ? 1 : this->nf;
+        }
+
+        //! The whole arena, including any padding
+        //@{
+        Flt* data (void) { return this->p; }
+        const Flt* data (void) const { return this->p; }
+        size_t allocated (void) const { return this->total; }
+        size_t bytes (void) const { return this->total * sizeof(Flt); }
+        //@}
+
+    private:
+        Flt* fieldStart (unsigned int i) const {
+            if (i >= this->nf) {
+                throw runtime_error ("FieldArena: field index out of range");
+            }
+            return this->lay == FieldLayout::SoA ? this->p + (size_t)i * this->fstride : this->p + i;
+        }
+
+        void allocate (size_t count) {
+            this->total = count;
+            if (count == 0) {
+                this->p = nullptr;
+                return;
+            }
+            void* mem = nullptr;
+            if (posix_memalign (&mem, 64, count * sizeof(Flt)) != 0) {
+                this->total = 0;
+                throw std::bad_alloc();
+            }
+            this->p = static_cast<Flt*>(mem);
+        }
+
+        void release (void) {
+            std::free (this->p);
+            this->p = nullptr;
+            this->total = 0;
+        }
+
+        Flt* p = nullptr;
+        size_t total = 0;
+        unsigned int nf = 0;
+        unsigned int n = 0;
+        unsigned int fstride = 0;
+        FieldLayout lay = FieldLayout::SoA;
+    };
+
+} // namespace morph
+
+#endif // _FIELDARENA_H_
@@ -9,6 +9,10 @@
 #include <sstream>
 #include <stdexcept>
 #include <utility>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
 
 using std::vector;
 using std::string;
@@ -17,17 +21,41 @@ using std::stringstream;
 using std::pair;
 using std::make_pair;
 
+/*!
+ * Without a threadsafe HDF5 library, each call into HdfData holds a process-wide
+ * (recursive) lock, so that only one thread at a time is in the library.
+ */
+#ifdef H5_HAVE_THREADSAFE
+# define HDFDATA_LOCK
+#else
+# define HDFDATA_LOCK std::lock_guard<std::recursive_mutex> hdfdata_lock (HdfData::libraryMutex())
+#endif
+
 #include <iostream>
 using std::cout;
 using std::endl;
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <opencv2/opencv.hpp>
 
-morph::HdfData::HdfData (const string fname, const bool read_data)
+std::recursive_mutex&
+morph::HdfData::libraryMutex (void)
+{
+    static std::recursive_mutex m;
+    return m;
+}
+
+morph::HdfData::HdfData (const string fname, const bool read_data, const bool read_only)
 {
+    HDFDATA_LOCK;
+    this->filename = fname;
     this->read_mode = read_data;
     if (this->read_mode == true) {
-        this->file_id = H5Fopen (fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+        this->file_id = H5Fopen (fname.c_str(), read_only ? H5F_ACC_RDONLY : H5F_ACC_RDWR, H5P_DEFAULT);
     } else {
         this->file_id = H5Fcreate (fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
     }
@@ -41,6 +69,10 @@ morph::HdfData::HdfData (const string fname, const bool read_data)
 
 morph::HdfData::~HdfData()
 {
+    HDFDATA_LOCK;
+    for (hid_t id : this->cachedIds) {
+        H5Dclose (id);
+    }
     herr_t status = H5Fclose (this->file_id);
     if (status) {
         //stringstream ee;
@@ -66,6 +98,7 @@ morph::HdfData::handle_error (const herr_t& status, const string& emsg)
 void
 morph::HdfData::read_contained_vals (const char* path, vector<double>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     // Get number of elements in the dataset at path, and resize vals
     // so it's ready to receive the data.
@@ -81,6 +114,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<double>& vals)
     // This line is different in the overloaded implementations:
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dread: ");
+    this->dequantise (dataset_id, H5T_NATIVE_DOUBLE, vals.data(), vals.size());
     status = H5Dclose (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
 }
@@ -88,6 +122,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<double>& vals)
 void
 morph::HdfData::read_contained_vals (const char* path, vector<float>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -100,6 +135,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<float>& vals)
     vals.resize (dims[0], 0.0);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dread: ");
+    this->dequantise (dataset_id, H5T_NATIVE_FLOAT, vals.data(), vals.size());
     status = H5Dclose (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
 }
@@ -107,6 +143,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<float>& vals)
 void
 morph::HdfData::read_contained_vals (const char* path, vector<array<float, 3>>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[2] = {0,0};
@@ -131,6 +168,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<array<float, 3>>&
 void
 morph::HdfData::read_contained_vals (const char* path, vector<array<float, 12>>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[2] = {0,0};
@@ -155,6 +193,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<array<float, 12>>&
 void
 morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2i>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[2] = {0,0};
@@ -179,6 +218,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2i>& vals
 void
 morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2d>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[2] = {0,0};
@@ -203,6 +243,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2d>& vals
 void
 morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2f>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[2] = {0,0};
@@ -227,6 +268,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<cv::Point2f>& vals
 void
 morph::HdfData::read_contained_vals (const char* path, cv::Mat& vals)
 {
+    HDFDATA_LOCK;
     // First get the type metadata
     string pathtype (path);
     pathtype += "_type";
@@ -327,6 +369,7 @@ morph::HdfData::read_contained_vals (const char* path, cv::Mat& vals)
 void
 morph::HdfData::read_contained_vals (const char* path, vector<int>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -346,6 +389,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<int>& vals)
 void
 morph::HdfData::read_contained_vals (const char* path, vector<unsigned int>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -365,6 +409,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<unsigned int>& val
 void
 morph::HdfData::read_contained_vals (const char* path, vector<long long int>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -384,6 +429,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<long long int>& va
 void
 morph::HdfData::read_contained_vals (const char* path, vector<unsigned long long int>& vals)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -403,6 +449,7 @@ morph::HdfData::read_contained_vals (const char* path, vector<unsigned long long
 void
 morph::HdfData::read_contained_vals (const char* path, pair<float, float>& vals)
 {
+    HDFDATA_LOCK;
     vector<float> vvals;
     this->read_contained_vals (path, vvals);
     if (vvals.size() != 2) {
@@ -417,6 +464,7 @@ morph::HdfData::read_contained_vals (const char* path, pair<float, float>& vals)
 void
 morph::HdfData::read_contained_vals (const char* path, pair<double, double>& vals)
 {
+    HDFDATA_LOCK;
     vector<double> vvals;
     this->read_contained_vals (path, vvals);
     if (vvals.size() != 2) {
@@ -431,6 +479,7 @@ morph::HdfData::read_contained_vals (const char* path, pair<double, double>& val
 void
 morph::HdfData::read_contained_vals (const char* path, list<pair<float, float>>& vals)
 {
+    HDFDATA_LOCK;
     string p1(path);
     p1 += "_first";
     string p2(path);
@@ -456,6 +505,7 @@ morph::HdfData::read_contained_vals (const char* path, list<pair<float, float>>&
 void
 morph::HdfData::read_contained_vals (const char* path, list<pair<double, double>>& vals)
 {
+    HDFDATA_LOCK;
     string p1(path);
     p1 += "_first";
     string p2(path);
@@ -481,6 +531,7 @@ morph::HdfData::read_contained_vals (const char* path, list<pair<double, double>
 void
 morph::HdfData::read_val (const char* path, double& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -491,6 +542,7 @@ morph::HdfData::read_val (const char* path, double& val)
 void
 morph::HdfData::read_val (const char* path, float& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -501,6 +553,7 @@ morph::HdfData::read_val (const char* path, float& val)
 void
 morph::HdfData::read_val (const char* path, int& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -511,6 +564,7 @@ morph::HdfData::read_val (const char* path, int& val)
 void
 morph::HdfData::read_val (const char* path, unsigned int& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -521,6 +575,7 @@ morph::HdfData::read_val (const char* path, unsigned int& val)
 void
 morph::HdfData::read_val (const char* path, long long int& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -531,6 +586,7 @@ morph::HdfData::read_val (const char* path, long long int& val)
 void
 morph::HdfData::read_val (const char* path, unsigned long long int& val)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_ULLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dread: ");
@@ -541,6 +597,7 @@ morph::HdfData::read_val (const char* path, unsigned long long int& val)
 void
 morph::HdfData::read_val (const char* path, bool& val)
 {
+    HDFDATA_LOCK;
     unsigned int uival = 0;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     herr_t status = H5Dread (dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &uival);
@@ -555,6 +612,13 @@ morph::HdfData::read_val (const char* path, bool& val)
 void
 morph::HdfData::process_groups (const char* path)
 {
+    HDFDATA_LOCK;
+    // The parent group of path, and so all of its ancestors, may be known to exist already
+    string p (path);
+    string::size_type last = p.rfind ('/');
+    if (last == 0 || last == string::npos || this->knownGroups.count (p.substr (0, last)) > 0) {
+        return;
+    }
     vector<string> pbits = morph::Tools::stringToVector (path, "/");
     unsigned int numgroups = pbits.size() - 1;
     if (numgroups > 1) { // There's always the first, empty (root) group
@@ -569,12 +633,106 @@ morph::HdfData::process_groups (const char* path)
 void
 morph::HdfData::verify_group (const string& path)
 {
+    HDFDATA_LOCK;
     if (H5Lexists (this->file_id, path.c_str(), H5P_DEFAULT) <= 0) {
         //cout << "Create group " << path << endl;
         hid_t group = H5Gcreate (this->file_id, path.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         herr_t status = H5Gclose (group);
         this->handle_error (status, "Error. status after H5Gclose: ");
     }
+    this->knownGroups.insert (path);
+}
+
+hid_t
+morph::HdfData::create_dataset (const char* path, hid_t filetype, hid_t dataspace_id, hid_t dcpl_id)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = -1;
+    if (this->transactionDepth > 0) {
+        std::map<string, hid_t>::const_iterator cached = this->datasetCache.find (path);
+        if (cached != this->datasetCache.end()) {
+            dataset_id = cached->second;
+        } else if (this->exists (path) == true) {
+            dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+            if (dataset_id < 0) {
+                stringstream ee;
+                ee << "Error. Failed to open " << path;
+                throw runtime_error (ee.str());
+            }
+            this->datasetCache[path] = dataset_id;
+            this->cachedIds.insert (dataset_id);
+        }
+        if (dataset_id >= 0) {
+            // Rewrite in place, if the existing dataset has the same type and shape
+            hid_t type_id = H5Dget_type (dataset_id);
+            hid_t space_id = H5Dget_space (dataset_id);
+            bool same = H5Tequal (type_id, filetype) > 0 && H5Sextent_equal (space_id, dataspace_id) > 0;
+            H5Tclose (type_id);
+            H5Sclose (space_id);
+            if (!same) {
+                stringstream ee;
+                ee << "Error. " << path << " exists with a different type or shape";
+                throw runtime_error (ee.str());
+            }
+            return dataset_id;
+        }
+    }
+    this->process_groups (path);
+    dataset_id = H5Dcreate2 (this->file_id, path, filetype, dataspace_id, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+    if (dataset_id >= 0 && this->transactionDepth > 0) {
+        this->datasetCache[path] = dataset_id;
+        this->cachedIds.insert (dataset_id);
+    }
+    return dataset_id;
+}
+
+herr_t
+morph::HdfData::close_dataset (hid_t dataset_id)
+{
+    HDFDATA_LOCK;
+    if (this->cachedIds.count (dataset_id) > 0) {
+        return 0;
+    }
+    return H5Dclose (dataset_id);
+}
+
+void
+morph::HdfData::begin (void)
+{
+    HDFDATA_LOCK;
+    ++this->transactionDepth;
+}
+
+void
+morph::HdfData::commit (void)
+{
+    HDFDATA_LOCK;
+    if (this->transactionDepth == 0) {
+        throw runtime_error ("Error. HdfData::commit() without begin()");
+    }
+    if (--this->transactionDepth == 0) {
+        herr_t status = H5Fflush (this->file_id, H5F_SCOPE_LOCAL);
+        this->handle_error (status, "Error. status after H5Fflush: ");
+    }
+}
+
+unsigned int
+morph::HdfData::cached_datasets (void)
+{
+    HDFDATA_LOCK;
+    return this->datasetCache.size();
+}
+
+void
+morph::HdfData::clear_cache (void)
+{
+    HDFDATA_LOCK;
+    for (hid_t id : this->cachedIds) {
+        H5Dclose (id);
+    }
+    this->cachedIds.clear();
+    this->datasetCache.clear();
+    this->knownGroups.clear();
 }
 
 /*!
@@ -584,20 +742,20 @@ morph::HdfData::verify_group (const string& path)
 void
 morph::HdfData::add_val (const char* path, const double& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     // Try hsize_t dim_singleparam[1] = {1} later...
 
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
     // NB: Always use H5T_IEEE_F64LE to save the data in the file, so this line doesn't need specialisation:
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     // This line is really the only difference between
     // add_fpoint(const char*, const float&) and add_fpoint(const
     // char*, const double&)
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -606,14 +764,14 @@ morph::HdfData::add_val (const char* path, const double& val)
 void
 morph::HdfData::add_val (const char* path, const float& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -622,14 +780,14 @@ morph::HdfData::add_val (const char* path, const float& val)
 void
 morph::HdfData::add_val (const char* path, const int& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_I64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -638,14 +796,14 @@ morph::HdfData::add_val (const char* path, const int& val)
 void
 morph::HdfData::add_val (const char* path, const unsigned int& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_U64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -654,14 +812,14 @@ morph::HdfData::add_val (const char* path, const unsigned int& val)
 void
 morph::HdfData::add_val (const char* path, const long long int& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_I64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -670,14 +828,14 @@ morph::HdfData::add_val (const char* path, const long long int& val)
 void
 morph::HdfData::add_val (const char* path, const unsigned long long int& val)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_U64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_ULLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &val);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -686,18 +844,18 @@ morph::HdfData::add_val (const char* path, const unsigned long long int& val)
 void
 morph::HdfData::add_val (const char* path, const bool& val)
 {
+    HDFDATA_LOCK;
     unsigned int uival = 0;
     if (val == true) {
         uival = 1;
     }
-    this->process_groups (path);
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = 1;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_U64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &uival);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -711,14 +869,14 @@ morph::HdfData::add_val (const char* path, const bool& val)
 void
 morph::HdfData::add_ptrarray_vals (const char* path, double*& vals, const unsigned int nvals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = nvals;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -727,18 +885,624 @@ morph::HdfData::add_ptrarray_vals (const char* path, double*& vals, const unsign
 void
 morph::HdfData::add_ptrarray_vals (const char* path, float*& vals, const unsigned int nvals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = nvals;
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals);
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (dataspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+}
+
+void
+morph::HdfData::add_ptrarray_vals (const char* path, const double* vals,
+                                   const unsigned int nrows, const unsigned int ncols,
+                                   const unsigned int rowstride)
+{
+    HDFDATA_LOCK;
+    hsize_t dims[2] = { nrows, ncols };
+    hid_t dataspace_id = H5Screate_simple (2, dims, NULL);
+    // The memory holds nrows rows of rowstride values, of which the first ncols are written
+    hsize_t memdims[2] = { nrows, rowstride };
+    hid_t memspace_id = H5Screate_simple (2, memdims, NULL);
+    hsize_t start[2] = { 0, 0 };
+    herr_t status = H5Sselect_hyperslab (memspace_id, H5S_SELECT_SET, start, NULL, dims, NULL);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
+    status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, memspace_id, H5S_ALL, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dwrite: ");
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
 }
+
+void
+morph::HdfData::add_ptrarray_vals (const char* path, const float* vals,
+                                   const unsigned int nrows, const unsigned int ncols,
+                                   const unsigned int rowstride)
+{
+    HDFDATA_LOCK;
+    hsize_t dims[2] = { nrows, ncols };
+    hid_t dataspace_id = H5Screate_simple (2, dims, NULL);
+    // The memory holds nrows rows of rowstride values, of which the first ncols are written
+    hsize_t memdims[2] = { nrows, rowstride };
+    hid_t memspace_id = H5Screate_simple (2, memdims, NULL);
+    hsize_t start[2] = { 0, 0 };
+    herr_t status = H5Sselect_hyperslab (memspace_id, H5S_SELECT_SET, start, NULL, dims, NULL);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
+    status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, memspace_id, H5S_ALL, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dwrite: ");
+    status = this->close_dataset (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Sclose (dataspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+}
+//@}
+
+/*!
+ * append_vals() overloads
+ */
+//@{
+void
+morph::HdfData::append_vals (const char* path, const vector<double>& vals, const HdfChunking& chunking)
+{
+    HDFDATA_LOCK;
+    this->append_row (path, vals.data(), vals.size(), H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, sizeof(double), chunking);
+}
+
+void
+morph::HdfData::append_vals (const char* path, const vector<float>& vals, const HdfChunking& chunking)
+{
+    HDFDATA_LOCK;
+    this->append_row (path, vals.data(), vals.size(), H5T_NATIVE_FLOAT, H5T_IEEE_F32LE, sizeof(float), chunking);
+}
+
+void
+morph::HdfData::append_ptrarray_vals (const char* path, const double* vals, const unsigned int nvals,
+                                      const HdfChunking& chunking)
+{
+    HDFDATA_LOCK;
+    this->append_row (path, vals, nvals, H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, sizeof(double), chunking);
+}
+
+void
+morph::HdfData::append_ptrarray_vals (const char* path, const float* vals, const unsigned int nvals,
+                                      const HdfChunking& chunking)
+{
+    HDFDATA_LOCK;
+    this->append_row (path, vals, nvals, H5T_NATIVE_FLOAT, H5T_IEEE_F32LE, sizeof(float), chunking);
+}
+
+hid_t
+morph::HdfData::chunked_dcpl (int rank, const hsize_t* cdims, unsigned int deflate, bool shuffle)
+{
+    HDFDATA_LOCK;
+    hid_t dcpl_id = H5Pcreate (H5P_DATASET_CREATE);
+    herr_t status = H5Pset_chunk (dcpl_id, rank, cdims);
+    this->handle_error (status, "Error. status after H5Pset_chunk: ");
+    if (shuffle == true) {
+        if (H5Zfilter_avail (H5Z_FILTER_SHUFFLE) <= 0) {
+            H5Pclose (dcpl_id);
+            throw runtime_error ("Error. The HDF5 library has no shuffle filter");
+        }
+        status = H5Pset_shuffle (dcpl_id);
+        this->handle_error (status, "Error. status after H5Pset_shuffle: ");
+    }
+    if (deflate > 0) {
+        if (H5Zfilter_avail (H5Z_FILTER_DEFLATE) <= 0) {
+            H5Pclose (dcpl_id);
+            throw runtime_error ("Error. The HDF5 library has no deflate filter");
+        }
+        status = H5Pset_deflate (dcpl_id, deflate > 9 ? 9 : deflate);
+        this->handle_error (status, "Error. status after H5Pset_deflate: ");
+    }
+    return dcpl_id;
+}
+
+void
+morph::HdfData::append_row (const char* path, const void* vals, const unsigned int nvals,
+                            hid_t memtype, hid_t filetype, size_t valsize, const HdfChunking& chunking)
+{
+    HDFDATA_LOCK;
+    if (nvals == 0) {
+        stringstream ee;
+        ee << "Error. Can't append an empty row to " << path;
+        throw runtime_error (ee.str());
+    }
+    herr_t status = 0;
+    hid_t dataset_id = -1;
+    std::map<string, hid_t>::const_iterator cached = this->datasetCache.find (path);
+    if (cached != this->datasetCache.end()) {
+        dataset_id = cached->second;
+    } else if (this->exists (path) == false) {
+        this->process_groups (path);
+        hsize_t dims[2] = { 0, nvals };
+        hsize_t maxdims[2] = { H5S_UNLIMITED, nvals };
+        hid_t dataspace_id = H5Screate_simple (2, dims, maxdims);
+        // Chunks may not be wider than the (fixed) rows
+        hsize_t ccols = (chunking.cols == 0 || chunking.cols > nvals) ? nvals : chunking.cols;
+        hsize_t crows = chunking.rows;
+        if (crows == 0) {
+            crows = (256 * 1024) / (ccols * valsize);
+            crows = crows < 1 ? 1 : crows;
+        }
+        hsize_t cdims[2] = { crows, ccols };
+        hid_t dcpl_id = this->chunked_dcpl (2, cdims, chunking.deflate, chunking.shuffle);
+        dataset_id = H5Dcreate2 (this->file_id, path, filetype, dataspace_id, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+        status = H5Pclose (dcpl_id);
+        this->handle_error (status, "Error. status after H5Pclose: ");
+        status = H5Sclose (dataspace_id);
+        this->handle_error (status, "Error. status after H5Sclose: ");
+    } else {
+        dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    }
+    if (dataset_id < 0) {
+        stringstream ee;
+        ee << "Error. Failed to create or open " << path;
+        throw runtime_error (ee.str());
+    }
+    // Held open (in or out of a begin()/commit() scope), so that a part filled chunk stays
+    // in the dataset's chunk cache and is filtered once, when it is evicted full
+    if (cached == this->datasetCache.end()) {
+        this->datasetCache[path] = dataset_id;
+        this->cachedIds.insert (dataset_id);
+    }
+
+    // Extend by one row
+    hid_t filespace_id = H5Dget_space (dataset_id);
+    hsize_t dims[2] = { 0, 0 };
+    hsize_t maxdims[2] = { 0, 0 };
+    int ndims = H5Sget_simple_extent_dims (filespace_id, dims, maxdims);
+    status = H5Sclose (filespace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    if (ndims != 2 || dims[1] != nvals || maxdims[0] != H5S_UNLIMITED) {
+        this->close_dataset (dataset_id);
+        stringstream ee;
+        ee << "Error. " << path << " isn't an extendible dataset with rows of " << nvals << " values";
+        throw runtime_error (ee.str());
+    }
+    hsize_t newdims[2] = { dims[0] + 1, dims[1] };
+    status = H5Dset_extent (dataset_id, newdims);
+    this->handle_error (status, "Error. status after H5Dset_extent: ");
+
+    // Write the new row
+    filespace_id = H5Dget_space (dataset_id);
+    hsize_t start[2] = { dims[0], 0 };
+    hsize_t count[2] = { 1, dims[1] };
+    status = H5Sselect_hyperslab (filespace_id, H5S_SELECT_SET, start, NULL, count, NULL);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    hsize_t memdims[1] = { nvals };
+    hid_t memspace_id = H5Screate_simple (1, memdims, NULL);
+    status = H5Dwrite (dataset_id, memtype, memspace_id, filespace_id, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dwrite: ");
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Sclose (filespace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = this->close_dataset (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+}
+//@}
+
+/*!
+ * map_vals() overloads
+ */
+//@{
+template <typename T>
+void
+morph::HdfData::map_view (const char* path, hid_t memtype, HdfView<T>& view)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    if (dataset_id < 0) {
+        stringstream ee;
+        ee << "Error. Failed to open " << path;
+        throw runtime_error (ee.str());
+    }
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[H5S_MAX_RANK];
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    herr_t status = H5Sclose (space_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    if (ndims < 0) {
+        this->close_dataset (dataset_id);
+        stringstream ee;
+        ee << "Error. Failed to get the dimensions of " << path;
+        throw runtime_error (ee.str());
+    }
+    view.dims.assign (dims, dims + ndims);
+    view.n = 1;
+    for (int d = 0; d < ndims; ++d) { view.n *= dims[d]; }
+
+    const void* mapped = view.n > 0 ? this->map_dataset (dataset_id, memtype, view.n * sizeof(T)) : nullptr;
+    if (mapped != nullptr) {
+        view.holder = this->fileMapping;
+        view.p = static_cast<const T*>(mapped);
+        view.isMapped = true;
+    } else {
+        std::shared_ptr<vector<T> > vals = std::make_shared<vector<T> > (view.n);
+        if (view.n > 0) {
+            status = H5Dread (dataset_id, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals->data());
+            if (status) { this->close_dataset (dataset_id); }
+            this->handle_error (status, "Error. status after H5Dread: ");
+            if (H5Tget_class (memtype) == H5T_FLOAT) {
+                this->dequantise (dataset_id, memtype, vals->data(), view.n);
+            }
+        }
+        view.p = vals->data();
+        view.holder = vals;
+        view.isMapped = false;
+    }
+    status = this->close_dataset (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+}
+
+const void*
+morph::HdfData::map_dataset (hid_t dataset_id, hid_t memtype, size_t nbytes)
+{
+    HDFDATA_LOCK;
+    // Only the default (sec2) driver keeps a dataset's bytes at their address in one file
+    hid_t fapl_id = H5Fget_access_plist (this->file_id);
+    bool sec2 = H5Pget_driver (fapl_id) == H5FD_SEC2;
+    H5Pclose (fapl_id);
+    // Contiguous and unfiltered, so that the values lie in the file as they are in memory
+    hid_t dcpl_id = H5Dget_create_plist (dataset_id);
+    bool plain = H5Pget_layout (dcpl_id) == H5D_CONTIGUOUS && H5Pget_nfilters (dcpl_id) == 0
+        && H5Pget_external_count (dcpl_id) == 0;
+    H5Pclose (dcpl_id);
+    hid_t type_id = H5Dget_type (dataset_id);
+    bool sametype = H5Tequal (type_id, memtype) > 0;
+    H5Tclose (type_id);
+    if (!sec2 || !plain || !sametype) {
+        return nullptr;
+    }
+    haddr_t offset = H5Dget_offset (dataset_id);
+    size_t valsize = H5Tget_size (memtype);
+    if (offset == HADDR_UNDEF || offset % valsize != 0) {
+        // Unallocated, or the values wouldn't be aligned in memory
+        return nullptr;
+    }
+
+    if (this->fileMapping == nullptr || offset + nbytes > this->fileMappingLength) {
+        // Put anything written so far into the file, then map the whole of it
+        herr_t status = H5Fflush (this->file_id, H5F_SCOPE_LOCAL);
+        this->handle_error (status, "Error. status after H5Fflush: ");
+        int fd = open (this->filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        void* base = MAP_FAILED;
+        if (fstat (fd, &st) == 0 && (size_t)st.st_size >= offset + nbytes) {
+            base = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close (fd);
+        if (base == MAP_FAILED) {
+            return nullptr;
+        }
+        size_t length = st.st_size;
+        // Views made earlier keep the old mapping alive for as long as they need it
+        this->fileMapping = std::shared_ptr<const void> (base, [length](const void* b) {
+                munmap (const_cast<void*>(b), length);
+            });
+        this->fileMappingLength = length;
+    }
+    return static_cast<const char*>(this->fileMapping.get()) + offset;
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<double>& view)
+{
+    this->map_view (path, H5T_NATIVE_DOUBLE, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<float>& view)
+{
+    this->map_view (path, H5T_NATIVE_FLOAT, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<int>& view)
+{
+    this->map_view (path, H5T_NATIVE_INT, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<unsigned int>& view)
+{
+    this->map_view (path, H5T_NATIVE_UINT, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<long long int>& view)
+{
+    this->map_view (path, H5T_NATIVE_LLONG, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<unsigned long long int>& view)
+{
+    this->map_view (path, H5T_NATIVE_ULLONG, view);
+}
+
+void
+morph::HdfData::map_vals (const char* path, HdfView<unsigned char>& view)
+{
+    this->map_view (path, H5T_NATIVE_UCHAR, view);
+}
+//@}
+
+/*!
+ * Resolve the counts of slab (0 meaning as many as fit) against the dimensions dims of a
+ * dataset, with block elements selected at each position, and check that the selection
+ * lies within the dataset.
+ */
+static void resolveSlab (const char* path, int ndims, const hsize_t* dims, const morph::HdfSlab& slab,
+                         const hsize_t block[2], hsize_t count[2])
+{
+    if ((unsigned int)ndims != slab.ndims) {
+        stringstream ee;
+        ee << "Error. " << path << " has " << ndims << " dimensions, but the slab has " << slab.ndims;
+        throw runtime_error (ee.str());
+    }
+    for (int d = 0; d < ndims; ++d) {
+        hsize_t stride = slab.stride[d] == 0 ? 1 : slab.stride[d];
+        count[d] = slab.count[d];
+        if (count[d] == 0 && slab.offset[d] + block[d] <= dims[d]) {
+            count[d] = (dims[d] - slab.offset[d] - block[d]) / stride + 1;
+        }
+        if (count[d] == 0 || slab.offset[d] + (count[d] - 1) * stride + block[d] > dims[d]) {
+            stringstream ee;
+            ee << "Error. The slab lies outside dimension " << d << " (of size " << dims[d] << ") of " << path;
+            throw runtime_error (ee.str());
+        }
+    }
+}
+
+/*!
+ * read_slab() overloads
+ */
+//@{
+size_t
+morph::HdfData::read_selection (const char* path, const HdfSlab& slab, const hsize_t block[2],
+                                hid_t memtype, void* vals, size_t capacity)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    if (dataset_id < 0) {
+        stringstream ee;
+        ee << "Error. Failed to open " << path;
+        throw runtime_error (ee.str());
+    }
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[H5S_MAX_RANK];
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    hsize_t count[2] = { 1, 1 };
+    hsize_t stride[2] = { 1, 1 };
+    size_t n = 1;
+    try {
+        resolveSlab (path, ndims, dims, slab, block, count);
+        for (int d = 0; d < ndims; ++d) {
+            stride[d] = slab.stride[d] == 0 ? 1 : slab.stride[d];
+            n *= count[d] * block[d];
+        }
+        if (n > capacity) {
+            stringstream ee;
+            ee << "Error. The slab of " << path << " holds " << n << " values; there's room for " << capacity;
+            throw runtime_error (ee.str());
+        }
+    } catch (...) {
+        H5Sclose (space_id);
+        H5Dclose (dataset_id);
+        throw;
+    }
+    herr_t status = H5Sselect_hyperslab (space_id, H5S_SELECT_SET, slab.offset, stride, count, block);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    hsize_t memdims[1] = { n };
+    hid_t memspace_id = H5Screate_simple (1, memdims, NULL);
+    status = H5Dread (dataset_id, memtype, memspace_id, space_id, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dread: ");
+    if (H5Tget_class (memtype) == H5T_FLOAT) {
+        this->dequantise (dataset_id, memtype, vals, n);
+    }
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Sclose (space_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Dclose (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    return n;
+}
+
+size_t
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, double* vals, size_t capacity)
+{
+    const hsize_t block[2] = { 1, 1 };
+    return this->read_selection (path, slab, block, H5T_NATIVE_DOUBLE, vals, capacity);
+}
+
+size_t
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, float* vals, size_t capacity)
+{
+    const hsize_t block[2] = { 1, 1 };
+    return this->read_selection (path, slab, block, H5T_NATIVE_FLOAT, vals, capacity);
+}
+
+size_t
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, int* vals, size_t capacity)
+{
+    const hsize_t block[2] = { 1, 1 };
+    return this->read_selection (path, slab, block, H5T_NATIVE_INT, vals, capacity);
+}
+
+size_t
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, unsigned int* vals, size_t capacity)
+{
+    const hsize_t block[2] = { 1, 1 };
+    return this->read_selection (path, slab, block, H5T_NATIVE_UINT, vals, capacity);
+}
+
+size_t
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, array<float, 3>* vals, size_t capacity)
+{
+    if (slab.ndims != 1) {
+        throw runtime_error ("Error. Select coordinates with a 1D slab");
+    }
+    // Each coordinate is a row of 3 in the dataset
+    HdfSlab s = HdfSlab::block (slab.offset[0], slab.count[0], 0, 1, slab.stride[0], 1);
+    const hsize_t block[2] = { 1, 3 };
+    return this->read_selection (path, s, block, H5T_NATIVE_FLOAT, vals, capacity * 3) / 3;
+}
+
+void
+morph::HdfData::read_slab (const char* path, const HdfSlab& slab, cv::Mat& vals)
+{
+    HDFDATA_LOCK;
+    if (slab.ndims != 2) {
+        throw runtime_error ("Error. Select part of a cv::Mat with a 2D slab");
+    }
+    int cv_type = 0;
+    int channels = 0;
+    this->read_val ((string(path) + "_type").c_str(), cv_type);
+    this->read_val ((string(path) + "_channels").c_str(), channels);
+    hid_t memtype = H5T_NATIVE_UCHAR;
+    switch (CV_MAT_DEPTH (cv_type)) {
+    case CV_8U: { memtype = H5T_NATIVE_UCHAR; break; }
+    case CV_8S: { memtype = H5T_NATIVE_CHAR; break; }
+    case CV_16U: { memtype = H5T_NATIVE_USHORT; break; }
+    case CV_16S: { memtype = H5T_NATIVE_SHORT; break; }
+    case CV_32S: { memtype = H5T_NATIVE_INT; break; }
+    case CV_32F: { memtype = H5T_NATIVE_FLOAT; break; }
+    case CV_64F: { memtype = H5T_NATIVE_DOUBLE; break; }
+    default:
+    {
+        stringstream ee;
+        ee << "Error. Unknown cv::Mat type " << cv_type << " for " << path;
+        throw runtime_error (ee.str());
+    }
+    }
+
+    // The selection in the Mat's rows and columns
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[H5S_MAX_RANK];
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    H5Sclose (space_id);
+    H5Dclose (dataset_id);
+    hsize_t matdims[2] = { dims[0], dims[1] / (channels > 0 ? channels : 1) };
+    const hsize_t unit[2] = { 1, 1 };
+    hsize_t count[2] = { 0, 0 };
+    resolveSlab (path, ndims, matdims, slab, unit, count);
+
+    // create() keeps vals' memory if it already has this size and type
+    vals.create ((int)count[0], (int)count[1], cv_type);
+    if (!vals.isContinuous()) {
+        throw runtime_error ("Error. read_slab needs a continuous cv::Mat");
+    }
+    // In the dataset, each Mat column is a block of channels values
+    HdfSlab s = HdfSlab::block (slab.offset[0], count[0], slab.offset[1] * channels, count[1],
+                                slab.stride[0], (slab.stride[1] == 0 ? 1 : slab.stride[1]) * channels);
+    const hsize_t block[2] = { 1, (hsize_t)channels };
+    this->read_selection (path, s, block, memtype, vals.data, (size_t)count[0] * count[1] * channels);
+}
+
+size_t
+morph::HdfData::slab_size (const char* path, const HdfSlab& slab)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    if (dataset_id < 0) {
+        stringstream ee;
+        ee << "Error. Failed to open " << path;
+        throw runtime_error (ee.str());
+    }
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[H5S_MAX_RANK];
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    H5Sclose (space_id);
+    H5Dclose (dataset_id);
+    const hsize_t unit[2] = { 1, 1 };
+    hsize_t count[2] = { 1, 1 };
+    resolveSlab (path, ndims, dims, slab, unit, count);
+    return ndims == 2 ? (size_t)count[0] * count[1] : (size_t)count[0];
+}
+//@}
+
+/*!
+ * read_ptrarray_vals() overloads
+ */
+//@{
+void
+morph::HdfData::read_ptrarray_vals (const char* path, double* vals,
+                                    const unsigned int nrows, const unsigned int ncols,
+                                    const unsigned int rowstride)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[2] = { 0, 0 };
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    if (ndims != 2 || dims[0] != nrows || dims[1] != ncols) {
+        stringstream ee;
+        ee << "Error. Expected " << nrows << " by " << ncols << " data to be stored in " << path;
+        throw runtime_error (ee.str());
+    }
+    // The memory holds nrows rows of rowstride values, of which the first ncols are read
+    hsize_t memdims[2] = { nrows, rowstride };
+    hid_t memspace_id = H5Screate_simple (2, memdims, NULL);
+    hsize_t start[2] = { 0, 0 };
+    herr_t status = H5Sselect_hyperslab (memspace_id, H5S_SELECT_SET, start, NULL, dims, NULL);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    status = H5Dread (dataset_id, H5T_NATIVE_DOUBLE, memspace_id, H5S_ALL, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dread: ");
+    status = H5Dclose (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Sclose (space_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+}
+
+void
+morph::HdfData::read_ptrarray_vals (const char* path, float* vals,
+                                    const unsigned int nrows, const unsigned int ncols,
+                                    const unsigned int rowstride)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[2] = { 0, 0 };
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    if (ndims != 2 || dims[0] != nrows || dims[1] != ncols) {
+        stringstream ee;
+        ee << "Error. Expected " << nrows << " by " << ncols << " data to be stored in " << path;
+        throw runtime_error (ee.str());
+    }
+    hsize_t memdims[2] = { nrows, rowstride };
+    hid_t memspace_id = H5Screate_simple (2, memdims, NULL);
+    hsize_t start[2] = { 0, 0 };
+    herr_t status = H5Sselect_hyperslab (memspace_id, H5S_SELECT_SET, start, NULL, dims, NULL);
+    this->handle_error (status, "Error. status after H5Sselect_hyperslab: ");
+    status = H5Dread (dataset_id, H5T_NATIVE_FLOAT, memspace_id, H5S_ALL, H5P_DEFAULT, vals);
+    this->handle_error (status, "Error. status after H5Dread: ");
+    status = H5Dclose (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (memspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Sclose (space_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+}
 //@}
 
 /*!
@@ -748,14 +1512,14 @@ morph::HdfData::add_ptrarray_vals (const char* path, float*& vals, const unsigne
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<double>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -764,14 +1528,14 @@ morph::HdfData::add_contained_vals (const char* path, const vector<double>& vals
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<float>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -780,6 +1544,7 @@ morph::HdfData::add_contained_vals (const char* path, const vector<float>& vals)
 void
 morph::HdfData::add_contained_vals (const char* path, const list<pair<float, float>>& vals)
 {
+    HDFDATA_LOCK;
     // A list of pairs is two cols. Write into two vectors, first and second, then
     // add_contained_vals from that.
     vector<float> first (vals.size(), 0.0f);
@@ -801,6 +1566,7 @@ morph::HdfData::add_contained_vals (const char* path, const list<pair<float, flo
 void
 morph::HdfData::add_contained_vals (const char* path, const list<pair<double, double>>& vals)
 {
+    HDFDATA_LOCK;
     // A list of pairs is two cols. Write into two vectors, first and second, then
     // add_contained_vals from that.
     vector<double> first (vals.size(), 0.0f);
@@ -822,16 +1588,16 @@ morph::HdfData::add_contained_vals (const char* path, const list<pair<double, do
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<array<float, 3>>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_vec3dcoords[2]; // 2 Dims
     dim_vec3dcoords[0] = vals.size();
     dim_vec3dcoords[1] = 3; // 3 floats in each array<float,3>
     // Note 2 dims (1st arg, which is rank = 2)
     hid_t dataspace_id = H5Screate_simple (2, dim_vec3dcoords, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -840,15 +1606,15 @@ morph::HdfData::add_contained_vals (const char* path, const vector<array<float,
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<array<float, 12>>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_vec12f[2];
     dim_vec12f[0] = vals.size();
     dim_vec12f[1] = 12;
     hid_t dataspace_id = H5Screate_simple (2, dim_vec12f, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -857,16 +1623,16 @@ morph::HdfData::add_contained_vals (const char* path, const vector<array<float,
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2i>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_vec2dcoords[2]; // 2 Dims
     dim_vec2dcoords[0] = vals.size();
     dim_vec2dcoords[1] = 2; // 2 ints in each cv::Point
     // Note 2 dims (1st arg, which is rank = 2)
     hid_t dataspace_id = H5Screate_simple (2, dim_vec2dcoords, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_I64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -875,16 +1641,16 @@ morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2i>&
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2d>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_vec2dcoords[2]; // 2 Dims
     dim_vec2dcoords[0] = vals.size();
     dim_vec2dcoords[1] = 2; // 2 doubles in each cv::Point2d
     // Note 2 dims (1st arg, which is rank = 2)
     hid_t dataspace_id = H5Screate_simple (2, dim_vec2dcoords, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -893,16 +1659,16 @@ morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2d>&
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2f>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_vec2dcoords[2]; // 2 Dims
     dim_vec2dcoords[0] = vals.size();
     dim_vec2dcoords[1] = 2; // 2 doubles in each cv::Point2d
     // Note 2 dims (1st arg, which is rank = 2)
     hid_t dataspace_id = H5Screate_simple (2, dim_vec2dcoords, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -911,7 +1677,7 @@ morph::HdfData::add_contained_vals (const char* path, const vector<cv::Point2f>&
 void
 morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
 
     hsize_t dim_mat[2]; // 2 dimensions supported (even though Mat's can do n dimensions)
 
@@ -937,7 +1703,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_8UC3:
     case CV_8UC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U8LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_STD_U8LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -946,7 +1712,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_8SC3:
     case CV_8SC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I8LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_STD_I8LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -955,7 +1721,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_16UC3:
     case CV_16UC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U16LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_STD_U16LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_USHORT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -964,7 +1730,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_16SC3:
     case CV_16SC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I16LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_STD_I16LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_SHORT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -973,7 +1739,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_32SC3:
     case CV_32SC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I32LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_STD_I32LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -982,7 +1748,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_32FC3:
     case CV_32FC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F32LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_IEEE_F32LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -991,7 +1757,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     case CV_64FC3:
     case CV_64FC4:
     {
-        dataset_id = H5Dcreate2 (this->file_id, path, H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dataset_id = this->create_dataset (path, H5T_IEEE_F64LE, dataspace_id);
         status = H5Dwrite (dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, vals.data);
         break;
     }
@@ -1004,7 +1770,7 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
     }
 
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -1020,14 +1786,14 @@ morph::HdfData::add_contained_vals (const char* path, const cv::Mat& vals)
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<int>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_I64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -1036,14 +1802,14 @@ morph::HdfData::add_contained_vals (const char* path, const vector<int>& vals)
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<unsigned int>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_U64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -1052,14 +1818,14 @@ morph::HdfData::add_contained_vals (const char* path, const vector<unsigned int>
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<long long int>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_I64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_I64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -1068,22 +1834,247 @@ morph::HdfData::add_contained_vals (const char* path, const vector<long long int
 void
 morph::HdfData::add_contained_vals (const char* path, const vector<unsigned long long int>& vals)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singleparam[1];
     dim_singleparam[0] = vals.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singleparam, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_STD_U64LE, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_STD_U64LE, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_NATIVE_ULLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &(vals[0]));
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    status = H5Sclose (dataspace_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+}
+
+/*!
+ * Round the mantissa of each finite value in v to keep of its mantissa bits, to nearest
+ * with ties to even, by adding half of the bits dropped and then clearing them. UInt is
+ * an unsigned integer of the size of Flt.
+ */
+template <typename Flt, typename UInt>
+static void bitRound (vector<Flt>& v, unsigned int keep)
+{
+    const unsigned int mantissa = std::numeric_limits<Flt>::digits - 1;
+    if (keep >= mantissa) {
+        return;
+    }
+    const unsigned int drop = mantissa - keep;
+    const UInt half = (UInt)1 << (drop - 1);
+    const UInt mask = ~(((UInt)1 << drop) - 1);
+    for (Flt& x : v) {
+        if (!std::isfinite (x)) {
+            continue;
+        }
+        UInt u = 0;
+        std::memcpy (&u, &x, sizeof(UInt));
+        u += half - 1 + ((u >> drop) & 1);
+        u &= mask;
+        std::memcpy (&x, &u, sizeof(UInt));
+    }
+}
+
+template <typename Flt>
+void
+morph::HdfData::add_quantised (const char* path, const vector<Flt>& vals, hid_t memtype, hid_t filetype,
+                               const HdfQuantisation& quant)
+{
+    HDFDATA_LOCK;
+    const bool scaleoffset = quant.method == HdfQuantisation::Method::ScaleOffset;
+    const unsigned int mantissa = std::numeric_limits<Flt>::digits - 1;
+    if (vals.empty()) {
+        stringstream ee;
+        ee << "Error. Can't quantise an empty field into " << path;
+        throw runtime_error (ee.str());
+    }
+    if ((scaleoffset && (quant.bits < 2 || quant.bits > 16)) || (!scaleoffset && quant.bits > mantissa)) {
+        stringstream ee;
+        ee << "Error. Can't quantise " << path << " to " << quant.bits << " bits";
+        throw runtime_error (ee.str());
+    }
+
+    double maxerr = 0.0;
+    double offset = 0.0;
+    double scale = 1.0;
+    vector<Flt> rounded;
+    vector<unsigned short> codes;
+    const void* data = nullptr;
+    size_t valsize = sizeof(Flt);
+    if (scaleoffset) {
+        double lo = std::numeric_limits<double>::infinity();
+        double hi = -lo;
+        for (Flt v : vals) {
+            if (std::isfinite (v)) {
+                lo = std::min (lo, (double)v);
+                hi = std::max (hi, (double)v);
+            }
+        }
+        if (lo > hi) {
+            lo = hi = 0.0;
+        }
+        // Codes 0 to levels are values; the top code is NaN
+        const unsigned int nancode = (1u << quant.bits) - 1;
+        const double levels = nancode - 1;
+        offset = lo;
+        scale = hi > lo ? (hi - lo) / levels : 1.0;
+        codes.resize (vals.size());
+        for (size_t i = 0; i < vals.size(); ++i) {
+            if (std::isnan (vals[i])) {
+                codes[i] = nancode;
+                continue;
+            }
+            double c = std::round ((vals[i] - offset) / scale);
+            c = c < 0.0 ? 0.0 : (c > levels ? levels : c);
+            codes[i] = (unsigned short)c;
+            if (std::isfinite (vals[i])) {
+                maxerr = std::max (maxerr, std::fabs (offset + c * scale - vals[i]));
+            }
+        }
+        data = codes.data();
+        memtype = H5T_NATIVE_USHORT;
+        filetype = quant.bits <= 8 ? H5T_STD_U8LE : H5T_STD_U16LE;
+        valsize = quant.bits <= 8 ? 1 : 2;
+    } else {
+        rounded = vals;
+        if (sizeof(Flt) == sizeof(unsigned int)) {
+            bitRound<Flt, unsigned int> (rounded, quant.bits);
+        } else {
+            bitRound<Flt, unsigned long long int> (rounded, quant.bits);
+        }
+        for (size_t i = 0; i < vals.size(); ++i) {
+            if (std::isfinite (vals[i])) {
+                maxerr = std::max (maxerr, std::fabs ((double)rounded[i] - (double)vals[i]));
+            }
+        }
+        data = rounded.data();
+    }
+
+    // Chunks of about 256 KB, as append_vals makes
+    hsize_t dims[1] = { vals.size() };
+    hsize_t cdims[1] = { std::min ((hsize_t)vals.size(), (hsize_t)(256 * 1024 / valsize)) };
+    hid_t dcpl_id = this->chunked_dcpl (1, cdims, quant.deflate, quant.shuffle);
+    hid_t dataspace_id = H5Screate_simple (1, dims, NULL);
+    hid_t dataset_id = this->create_dataset (path, filetype, dataspace_id, dcpl_id);
+    herr_t status = H5Pclose (dcpl_id);
+    this->handle_error (status, "Error. status after H5Pclose: ");
+    status = H5Dwrite (dataset_id, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
+    this->handle_error (status, "Error. status after H5Dwrite: ");
+    this->write_attribute (dataset_id, "quantisation", string(scaleoffset ? "scaleoffset" : "bitround"));
+    this->write_attribute (dataset_id, "bits", quant.bits);
+    this->write_attribute (dataset_id, "max_error", maxerr);
+    if (scaleoffset) {
+        this->write_attribute (dataset_id, "offset", offset);
+        this->write_attribute (dataset_id, "scale", scale);
+    }
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
 }
 
+void
+morph::HdfData::add_contained_vals (const char* path, const vector<double>& vals, const HdfQuantisation& quant)
+{
+    this->add_quantised (path, vals, H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, quant);
+}
+
+void
+morph::HdfData::add_contained_vals (const char* path, const vector<float>& vals, const HdfQuantisation& quant)
+{
+    this->add_quantised (path, vals, H5T_NATIVE_FLOAT, H5T_IEEE_F32LE, quant);
+}
+
+//! Read the scalar attribute name of obj_id as memtype into val
+static herr_t readAttribute (hid_t obj_id, const char* name, hid_t memtype, void* val)
+{
+    hid_t attr_id = H5Aopen (obj_id, name, H5P_DEFAULT);
+    if (attr_id < 0) {
+        return -1;
+    }
+    herr_t status = H5Aread (attr_id, memtype, val);
+    H5Aclose (attr_id);
+    return status;
+}
+
+void
+morph::HdfData::dequantise (hid_t dataset_id, hid_t memtype, void* vals, size_t n)
+{
+    HDFDATA_LOCK;
+    // Only ScaleOffset datasets have a scale
+    if (H5Aexists (dataset_id, "scale") <= 0) {
+        return;
+    }
+    double scale = 1.0;
+    double offset = 0.0;
+    unsigned int bits = 0;
+    herr_t status = readAttribute (dataset_id, "scale", H5T_NATIVE_DOUBLE, &scale);
+    status |= readAttribute (dataset_id, "offset", H5T_NATIVE_DOUBLE, &offset);
+    status |= readAttribute (dataset_id, "bits", H5T_NATIVE_UINT, &bits);
+    this->handle_error (status, "Error. status after reading the quantisation attributes: ");
+    const double nancode = (1u << bits) - 1;
+    if (H5Tequal (memtype, H5T_NATIVE_DOUBLE) > 0) {
+        double* v = static_cast<double*>(vals);
+        for (size_t i = 0; i < n; ++i) {
+            v[i] = v[i] == nancode ? std::numeric_limits<double>::quiet_NaN() : offset + v[i] * scale;
+        }
+    } else {
+        float* v = static_cast<float*>(vals);
+        for (size_t i = 0; i < n; ++i) {
+            v[i] = v[i] == nancode ? std::numeric_limits<float>::quiet_NaN() : (float)(offset + v[i] * scale);
+        }
+    }
+}
+
+/*!
+ * Set the scalar attribute name of obj_id, stored as filetype, to the value at val (of
+ * type memtype), replacing any attribute of that name.
+ */
+static herr_t writeAttribute (hid_t obj_id, const char* name, hid_t filetype, hid_t memtype, const void* val)
+{
+    if (H5Aexists (obj_id, name) > 0 && H5Adelete (obj_id, name) < 0) {
+        return -1;
+    }
+    hid_t space_id = H5Screate (H5S_SCALAR);
+    hid_t attr_id = H5Acreate2 (obj_id, name, filetype, space_id, H5P_DEFAULT, H5P_DEFAULT);
+    herr_t status = attr_id < 0 ? -1 : H5Awrite (attr_id, memtype, val);
+    if (attr_id >= 0) {
+        H5Aclose (attr_id);
+    }
+    H5Sclose (space_id);
+    return status;
+}
+
+void
+morph::HdfData::write_attribute (hid_t obj_id, const char* name, double val)
+{
+    HDFDATA_LOCK;
+    herr_t status = writeAttribute (obj_id, name, H5T_IEEE_F64LE, H5T_NATIVE_DOUBLE, &val);
+    this->handle_error (status, "Error. status after writing an attribute: ");
+}
+
+void
+morph::HdfData::write_attribute (hid_t obj_id, const char* name, unsigned int val)
+{
+    HDFDATA_LOCK;
+    herr_t status = writeAttribute (obj_id, name, H5T_STD_U32LE, H5T_NATIVE_UINT, &val);
+    this->handle_error (status, "Error. status after writing an attribute: ");
+}
+
+void
+morph::HdfData::write_attribute (hid_t obj_id, const char* name, const string& val)
+{
+    HDFDATA_LOCK;
+    hid_t type_id = H5Tcopy (H5T_C_S1);
+    H5Tset_size (type_id, val.empty() ? 1 : val.size());
+    herr_t status = writeAttribute (obj_id, name, type_id, type_id, val.c_str());
+    H5Tclose (type_id);
+    this->handle_error (status, "Error. status after writing an attribute: ");
+}
+
 void
 morph::HdfData::add_contained_vals (const char* path, const pair<float, float>& vals)
 {
+    HDFDATA_LOCK;
     vector<float> vf;
     vf.push_back (vals.first);
     vf.push_back (vals.second);
@@ -1093,6 +2084,7 @@ morph::HdfData::add_contained_vals (const char* path, const pair<float, float>&
 void
 morph::HdfData::add_contained_vals (const char* path, const pair<double, double>& vals)
 {
+    HDFDATA_LOCK;
     vector<double> vf;
     vf.push_back (vals.first);
     vf.push_back (vals.second);
@@ -1107,14 +2099,14 @@ morph::HdfData::add_contained_vals (const char* path, const pair<double, double>
 void
 morph::HdfData::add_string (const char* path, const string& str)
 {
-    this->process_groups (path);
+    HDFDATA_LOCK;
     hsize_t dim_singlestring[1];
     dim_singlestring[0] = str.size();
     hid_t dataspace_id = H5Screate_simple (1, dim_singlestring, NULL);
-    hid_t dataset_id = H5Dcreate2 (this->file_id, path, H5T_C_S1, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t dataset_id = this->create_dataset (path, H5T_C_S1, dataspace_id);
     herr_t status = H5Dwrite (dataset_id, H5T_C_S1, H5S_ALL, H5S_ALL, H5P_DEFAULT, str.c_str());
     this->handle_error (status, "Error. status after H5Dwrite: ");
-    status = H5Dclose (dataset_id);
+    status = this->close_dataset (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
     status = H5Sclose (dataspace_id);
     this->handle_error (status, "Error. status after H5Sclose: ");
@@ -1123,6 +2115,7 @@ morph::HdfData::add_string (const char* path, const string& str)
 void
 morph::HdfData::read_string (const char* path, string& str)
 {
+    HDFDATA_LOCK;
     hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
     hid_t space_id = H5Dget_space (dataset_id);
     hsize_t dims[1] = {0};
@@ -1138,4 +2131,39 @@ morph::HdfData::read_string (const char* path, string& str)
     status = H5Dclose (dataset_id);
     this->handle_error (status, "Error. status after H5Dclose: ");
 }
+
+bool
+morph::HdfData::exists (const char* path)
+{
+    HDFDATA_LOCK;
+    // Check each group on the way, as H5Lexists fails if an intermediate one is missing
+    string p (path);
+    string::size_type pos = 0;
+    while ((pos = p.find ('/', pos + 1)) != string::npos) {
+        if (H5Lexists (this->file_id, p.substr (0, pos).c_str(), H5P_DEFAULT) <= 0) {
+            return false;
+        }
+    }
+    return H5Lexists (this->file_id, path, H5P_DEFAULT) > 0;
+}
+
+unsigned int
+morph::HdfData::num_rows (const char* path)
+{
+    HDFDATA_LOCK;
+    hid_t dataset_id = H5Dopen2 (this->file_id, path, H5P_DEFAULT);
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[2] = { 0, 0 };
+    int ndims = H5Sget_simple_extent_dims (space_id, dims, NULL);
+    herr_t status = H5Sclose (space_id);
+    this->handle_error (status, "Error. status after H5Sclose: ");
+    status = H5Dclose (dataset_id);
+    this->handle_error (status, "Error. status after H5Dclose: ");
+    if (ndims != 2) {
+        stringstream ee;
+        ee << "Error. Expected 2D data to be stored in " << path;
+        throw runtime_error (ee.str());
+    }
+    return dims[0];
+}
 //@}
@@ -19,13 +19,156 @@ using std::string;
 using std::pair;
 #include <bitset>
 using std::bitset;
+#include <mutex>
+#include <map>
+#include <set>
+#include <memory>
 
 namespace morph {
 
+    /*!
+     * How HdfData::append_vals lays out a dataset that it creates: the shape of its chunks
+     * and the filters applied to each chunk. Ignored when appending to an existing
+     * dataset.
+     */
+    struct HdfChunking
+    {
+        //! Rows (frames) per chunk; 0 for enough rows to make chunks of about 256 KB
+        unsigned int rows = 0;
+        //! Columns per chunk; 0 for whole rows
+        unsigned int cols = 0;
+        //! The deflate (zlib) compression level, from 0 (no compression) to 9
+        unsigned int deflate = 0;
+        //! Apply the byte shuffle filter before deflate, which helps floating point data compress
+        bool shuffle = false;
+    };
+
+    /*!
+     * Lossy storage for HdfData::add_contained_vals, for fields that need only a few bits
+     * of precision. The quantised values are stored in chunks, shuffled and deflated, with
+     * the method, bits, parameters and the largest error made as attributes of the
+     * dataset. read_contained_vals, read_slab and map_vals return values, not codes.
+     */
+    struct HdfQuantisation
+    {
+        enum class Method
+        {
+            /*!
+             * Round each value to bits bits of mantissa (of the 23 of a float, or 52 of a
+             * double), keeping its type. The zeroed low bits compress well, and the
+             * relative error is at most 2^-(bits+1).
+             */
+            BitRound,
+            /*!
+             * Store each value as a bits-bit integer code (1 < bits <= 16), scaled between
+             * the minimum and maximum of the values, as offset + code * scale. The absolute
+             * error is at most scale/2. The top code stands for NaN, and infinities are
+             * clamped to the range of the finite values.
+             */
+            ScaleOffset
+        };
+        Method method = Method::BitRound;
+        unsigned int bits = 12;
+        //! The deflate (zlib) compression level, from 0 (no compression) to 9
+        unsigned int deflate = 4;
+        //! Apply the byte shuffle filter before deflate
+        bool shuffle = true;
+    };
+
+    /*!
+     * A hyperslab selection for HdfData::read_slab: in each dimension of a 1D or 2D
+     * dataset, the index of the first element, the number of elements and the step between
+     * them. A count of 0 selects as many elements as there are from offset, at stride.
+     */
+    struct HdfSlab
+    {
+        //! The number of dimensions of the dataset, 1 or 2
+        unsigned int ndims = 1;
+        hsize_t offset[2] = { 0, 0 };
+        hsize_t count[2] = { 0, 0 };
+        hsize_t stride[2] = { 1, 1 };
+
+        //! count elements of a 1D dataset, from offset, stride apart
+        static HdfSlab range (hsize_t offset, hsize_t count = 0, hsize_t stride = 1) {
+            HdfSlab s;
+            s.offset[0] = offset;
+            s.count[0] = count;
+            s.stride[0] = stride;
+            return s;
+        }
+
+        //! count whole rows of a 2D dataset from row (with count 1, a frame of a time series)
+        static HdfSlab rows (hsize_t row, hsize_t count = 1, hsize_t stride = 1) {
+            HdfSlab s = HdfSlab::block (row, count, 0, 0);
+            s.stride[0] = stride;
+            return s;
+        }
+
+        //! Column col of every row of a 2D dataset (the time series of one element)
+        static HdfSlab column (hsize_t col) {
+            return HdfSlab::block (0, 0, col, 1);
+        }
+
+        //! A block of a 2D dataset
+        static HdfSlab block (hsize_t row, hsize_t nrows, hsize_t col, hsize_t ncols,
+                              hsize_t rowstride = 1, hsize_t colstride = 1) {
+            HdfSlab s;
+            s.ndims = 2;
+            s.offset[0] = row;
+            s.offset[1] = col;
+            s.count[0] = nrows;
+            s.count[1] = ncols;
+            s.stride[0] = rowstride;
+            s.stride[1] = colstride;
+            return s;
+        }
+    };
+
+    /*!
+     * A read-only view of the values of a dataset, from HdfData::map_vals. If the dataset
+     * is stored contiguously and unfiltered, as the type viewed, the view points straight
+     * into a memory mapping of the file, so nothing is read until it is touched; otherwise
+     * it holds a copy, read in the usual way. Copies of a view share its values, which
+     * remain valid after the HdfData is destroyed. Values mapped from a file change if
+     * their dataset is rewritten.
+     */
+    template <typename T>
+    class HdfView
+    {
+    public:
+        const T* data (void) const { return this->p; }
+        size_t size (void) const { return this->n; }
+        bool empty (void) const { return this->n == 0; }
+        const T& operator[] (size_t i) const { return this->p[i]; }
+        const T* begin (void) const { return this->p; }
+        const T* end (void) const { return this->p + this->n; }
+
+        //! The dimensions of the dataset, slowest varying first
+        const vector<hsize_t>& shape (void) const { return this->dims; }
+
+        //! True if the values are mapped from the file, false if they were read into memory
+        bool mapped (void) const { return this->isMapped; }
+
+    private:
+        friend class HdfData;
+        //! Keeps the values alive: the file's mapping, or the vector<T> they were read into
+        std::shared_ptr<const void> holder;
+        const T* p = nullptr;
+        size_t n = 0;
+        vector<hsize_t> dims;
+        bool isMapped = false;
+    };
+
     /*!
      * Very simple data access class, wrapping around the HDF5 C
      * API. Operates either in write mode (the default) or read
      * mode. Choose which when constructing.
+     *
+     * HdfData objects may be used on several threads at once (as by HdfDataAsync, or when
+     * RD_Base writes a checkpoint in the background), though each object must be used by
+     * one thread at a time. If the HDF5 library was built without thread safety
+     * (H5_HAVE_THREADSAFE undefined), each call holds a process-wide lock, so that only
+     * one thread at a time is in the library.
      */
     class HdfData
     {
@@ -46,11 +189,36 @@ namespace morph {
          */
         void handle_error (const herr_t& status, const string& emsg);
 
+        //! The lock that serialises use of a non-threadsafe HDF5 library
+        static std::recursive_mutex& libraryMutex (void);
+
+        //! Groups known to exist in the file, so that process_groups needn't look for them
+        std::set<string> knownGroups;
+
+        //! Datasets held open since a begin(), by path, and the set of their ids
+        //@{
+        std::map<string, hid_t> datasetCache;
+        std::set<hid_t> cachedIds;
+        //@}
+
+        //! The number of begin() calls not yet matched by commit()
+        unsigned int transactionDepth = 0;
+
+        //! The file's name, and the mapping of it (and its length) shared by map_vals views
+        //@{
+        string filename;
+        std::shared_ptr<const void> fileMapping;
+        size_t fileMappingLength = 0;
+        //@}
+
     public:
         /*!
-         * Construct, creating open file_id. If read_data is
+         * Construct, creating open file_id. If read_data is false, fname is created (or
+         * truncated) for writing. If read_data is true, the existing file is opened for
+         * reading and writing, or, if read_only is also true, for reading only, which
+         * needs only read permission and leaves the file as it was.
          */
-        HdfData (const string fname, const bool read_data = false);
+        HdfData (const string fname, const bool read_data = false, const bool read_only = false);
 
         /*!
          * Deconstruct, closing the file_id
@@ -115,6 +283,108 @@ namespace morph {
         //! Read a string of chars
         void read_string (const char* path, string& str);
 
+        /*!
+         * Read the nrows by ncols 2D dataset at path into vals, in which row r starts at
+         * vals + r * rowstride; the inverse of the 2D add_ptrarray_vals. Throws if the
+         * dataset isn't nrows by ncols.
+         */
+        //@{
+        void read_ptrarray_vals (const char* path, double* vals,
+                                 const unsigned int nrows, const unsigned int ncols,
+                                 const unsigned int rowstride);
+        void read_ptrarray_vals (const char* path, float* vals,
+                                 const unsigned int nrows, const unsigned int ncols,
+                                 const unsigned int rowstride);
+        //@}
+
+        /*!
+         * Read the part of the dataset at path selected by slab into vals, in row major
+         * order, without allocating. vals must have room for capacity values; throws if
+         * the selection is bigger, or doesn't fit in the dataset. Returns the number of
+         * values read. slab_size() gives the number that a selection holds, to size a
+         * buffer by.
+         */
+        //@{
+        size_t read_slab (const char* path, const HdfSlab& slab, double* vals, size_t capacity);
+        size_t read_slab (const char* path, const HdfSlab& slab, float* vals, size_t capacity);
+        size_t read_slab (const char* path, const HdfSlab& slab, int* vals, size_t capacity);
+        size_t read_slab (const char* path, const HdfSlab& slab, unsigned int* vals, size_t capacity);
+        /*!
+         * For data saved from a vector<array<float, 3>>; slab is a 1D selection of the
+         * coordinates, and capacity is in coordinates.
+         */
+        size_t read_slab (const char* path, const HdfSlab& slab, array<float, 3>* vals, size_t capacity);
+        /*!
+         * For a cv::Mat saved by add_contained_vals; slab is a 2D selection of the Mat's
+         * rows and columns (all channels of each column are read). vals is reused if it
+         * already has the size and type of the selection, and created otherwise.
+         */
+        void read_slab (const char* path, const HdfSlab& slab, cv::Mat& vals);
+        size_t slab_size (const char* path, const HdfSlab& slab);
+        //@}
+
+        //! True if there is a dataset or group at path
+        bool exists (const char* path);
+
+        //! The number of rows in the 2D dataset at path, as appended by append_vals
+        unsigned int num_rows (const char* path);
+
+        /*!
+         * Get a read-only view of all the values of the dataset at path, without reading
+         * or copying them if that can be avoided. A contiguous, unfiltered dataset stored
+         * as the type viewed is memory mapped from the file (add_contained_vals stores
+         * vector<float> and vector<double> as doubles, and vector<int> as long long ints,
+         * so view those as HdfView<double> and HdfView<long long int>). A chunked or
+         * compressed dataset, one that needs a type conversion, or one whose values don't
+         * start at a suitably aligned file offset is read into memory instead, so any
+         * numeric dataset may be viewed. Each HdfData maps its file once
+         * and shares the mapping between its views.
+         */
+        //@{
+        void map_vals (const char* path, HdfView<double>& view);
+        void map_vals (const char* path, HdfView<float>& view);
+        void map_vals (const char* path, HdfView<int>& view);
+        void map_vals (const char* path, HdfView<unsigned int>& view);
+        void map_vals (const char* path, HdfView<long long int>& view);
+        void map_vals (const char* path, HdfView<unsigned long long int>& view);
+        void map_vals (const char* path, HdfView<unsigned char>& view);
+        //@}
+
+        /*!
+         * Batch the writes up to the matching commit(). Within a begin()/commit() scope,
+         * the datasets written are kept open, and a write to a path that already holds a
+         * dataset of the same type and shape rewrites it in place (outside one, that
+         * write fails). A save that is repeated into the same file layout every N steps
+         * then costs little more than writing the data:
+         *
+         *\code
+         HdfData data (fname);
+         for (...) {
+             data.begin();
+             data.add_contained_vals ("/c", this->c);
+             data.add_val ("/t", this->t);
+             data.commit();
+         }
+         \endcode
+         *
+         * commit() flushes the file, but keeps the datasets open for the next begin(). It
+         * is not a rollback point; writes made before a failure stay made. begin() and
+         * commit() may be nested, in which case only the outermost commit() flushes.
+         */
+        //@{
+        void begin (void);
+        void commit (void);
+        //@}
+
+        //! The number of datasets held open by begin()/commit() scopes and append_vals
+        unsigned int cached_datasets (void);
+
+        /*!
+         * Close the datasets held open, writing out any partly filled chunks of those
+         * appended to, and forget the groups known to exist
+         */
+        void clear_cache (void);
+
         //! Templated read_val for bitsets
         template <size_t N>
         void read_val (const char* path, bitset<N>& val) {
@@ -199,6 +469,16 @@ namespace morph {
         void add_contained_vals (const char* path, const vector<unsigned long long int>& vals);
         //@}
 
+        /*!
+         * Store vals lossily, as quant says (see HdfQuantisation). With BitRound, floats
+         * are stored as floats and doubles as doubles; with ScaleOffset, as 8 or 16 bit
+         * codes. Read them back with read_contained_vals as usual.
+         */
+        //@{
+        void add_contained_vals (const char* path, const vector<double>& vals, const HdfQuantisation& quant);
+        void add_contained_vals (const char* path, const vector<float>& vals, const HdfQuantisation& quant);
+        //@}
+
         /*!
          * Containers of coordinates
          */
@@ -241,8 +521,112 @@ namespace morph {
         void add_ptrarray_vals (const char* path, float*& vals, const unsigned int nvals);
         //@}
 
+        /*!
+         * Add an nrows by ncols 2D dataset from vals, in which row r starts at
+         * vals + r * rowstride (rowstride may exceed ncols, for memory with padded rows).
+         * Written with a single H5Dwrite.
+         */
+        //@{
+        void add_ptrarray_vals (const char* path, const double* vals,
+                                const unsigned int nrows, const unsigned int ncols,
+                                const unsigned int rowstride);
+        void add_ptrarray_vals (const char* path, const float* vals,
+                                const unsigned int nrows, const unsigned int ncols,
+                                const unsigned int rowstride);
+        //@}
+
+        /*!
+         * Append vals as a new row of the 2D dataset at path, creating the dataset (with
+         * an unlimited number of rows, each of vals.size() values, laid out as chunking
+         * says) if it doesn't exist. This stores a time series of a field as one dataset
+         * of time by nhex, rather than as a dataset per frame. The values are stored in the
+         * precision given. To append to a dataset in an existing file, open the file with
+         * read_data true (which opens it for reading and writing).
+         *
+         * The dataset is held open until clear_cache() or the destructor, so that the chunk
+         * being filled stays in HDF5's chunk cache and is compressed once, when it is full
+         * or the dataset is closed, rather than on every append. Chunks larger than the
+         * chunk cache (1 MB by default) are written through on every append.
+         */
+        //@{
+        void append_vals (const char* path, const vector<double>& vals,
+                          const HdfChunking& chunking = HdfChunking());
+        void append_vals (const char* path, const vector<float>& vals,
+                          const HdfChunking& chunking = HdfChunking());
+        void append_ptrarray_vals (const char* path, const double* vals, const unsigned int nvals,
+                                   const HdfChunking& chunking = HdfChunking());
+        void append_ptrarray_vals (const char* path, const float* vals, const unsigned int nvals,
+                                   const HdfChunking& chunking = HdfChunking());
+        //@}
+
         //@} // writing methods
 
+    private:
+        /*!
+         * Create the dataset at path (and the groups on the way to it), or, within a
+         * begin()/commit() scope, reuse one of the same type and shape that is already
+         * there. Release the id with close_dataset.
+         */
+        hid_t create_dataset (const char* path, hid_t filetype, hid_t dataspace_id,
+                              hid_t dcpl_id = H5P_DEFAULT);
+
+        //! Close a dataset, unless it is held open in datasetCache
+        herr_t close_dataset (hid_t dataset_id);
+
+        /*!
+         * Dataset creation properties for chunks of cdims (of rank rank), with the shuffle
+         * and deflate filters if asked for. Throws if a filter isn't available.
+         */
+        hid_t chunked_dcpl (int rank, const hsize_t* cdims, unsigned int deflate, bool shuffle);
+
+        /*!
+         * The implementation of the quantising add_contained_vals, for values of memory
+         * type memtype that are stored as filetype by BitRound.
+         */
+        template <typename Flt>
+        void add_quantised (const char* path, const vector<Flt>& vals, hid_t memtype, hid_t filetype,
+                            const HdfQuantisation& quant);
+
+        /*!
+         * If the dataset dataset_id holds ScaleOffset codes, turn the n codes just read
+         * into vals (as memtype, which must be a native float or double) into values.
+         */
+        void dequantise (hid_t dataset_id, hid_t memtype, void* vals, size_t n);
+
+        //! Set (or replace) an attribute of the object obj_id
+        //@{
+        void write_attribute (hid_t obj_id, const char* name, double val);
+        void write_attribute (hid_t obj_id, const char* name, unsigned int val);
+        void write_attribute (hid_t obj_id, const char* name, const string& val);
+        //@}
+
+        /*!
+         * The implementation of map_vals, for values of memory type memtype: map the
+         * dataset at path if possible, otherwise read it.
+         */
+        template <typename T>
+        void map_view (const char* path, hid_t memtype, HdfView<T>& view);
+
+        /*!
+         * If nbytes of the open dataset dataset_id can be mapped as memtype, (re)map the
+         * file as necessary and return a pointer to them; otherwise return nullptr.
+         */
+        const void* map_dataset (hid_t dataset_id, hid_t memtype, size_t nbytes);
+
+        /*!
+         * The implementation of read_slab: reads slab (with blocks of block[d] elements at
+         * each selected position in dimension d) as memtype into vals.
+         */
+        size_t read_selection (const char* path, const HdfSlab& slab, const hsize_t block[2],
+                               hid_t memtype, void* vals, size_t capacity);
+
+        /*!
+         * The implementation of append_vals, for nvals values of memory type memtype, to
+         * be stored as filetype.
+         */
+        void append_row (const char* path, const void* vals, const unsigned int nvals,
+                         hid_t memtype, hid_t filetype, size_t valsize, const HdfChunking& chunking);
+
     }; // class hdf5
 
 } // namespace morph
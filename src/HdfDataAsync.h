@@ -0,0 +1,252 @@
+/*
+ * An HdfData whose writes are carried out on a dedicated I/O thread.
+ */
+
+#ifndef _HDFDATAASYNC_H_
+#define _HDFDATAASYNC_H_
+
+#include "HdfData.h"
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <iostream>
+
+namespace morph {
+
+    /*!
+     * Writes to an HDF5 file in the background, so that a simulation can carry on while
+     * its data are compressed and written. Each write is queued with a copy of its data
+     * (or, for the containers passed by value, the data moved in with std::move) and the
+     * writes are made in order by an I/O thread which owns the file's HdfData:
+     *
+     *\code
+     HdfDataAsync data (fname);
+     data.add_contained_vals ("/c", this->c);              // c is copied
+     data.add_contained_vals ("/n", std::move (scratch));  // scratch is moved
+     \endcode
+     *
+     * The queue is bounded: once maxQueueBytes of data are waiting, a write waits for
+     * the I/O thread to catch up. flush() waits until everything queued is written. The
+     * destructor flushes and closes the file, so that once it returns everything is on
+     * disk. An exception from a write is rethrown by the next write or flush() (or, from
+     * the destructor, which mustn't throw, reported on stderr).
+     */
+    class HdfDataAsync
+    {
+    public:
+        /*!
+         * Open fname as HdfData (fname, read_data) would, on the I/O thread. Throws if the
+         * file can't be opened.
+         */
+        HdfDataAsync (const string fname, const bool read_data = false,
+                      size_t maxQueueBytes_ = 256 * 1024 * 1024)
+            : maxQueueBytes(maxQueueBytes_) {
+            std::unique_lock<std::mutex> lock (this->m);
+            this->io = std::thread (&HdfDataAsync::run, this, fname, read_data);
+            this->cv.wait (lock, [this]{ return this->opened || this->error; });
+            if (!this->opened) {
+                lock.unlock();
+                this->io.join();
+                std::rethrow_exception (this->error);
+            }
+        }
+
+        HdfDataAsync (const HdfDataAsync&) = delete;
+        HdfDataAsync& operator= (const HdfDataAsync&) = delete;
+
+        //! Write everything queued, close the file and stop the I/O thread
+        ~HdfDataAsync (void) {
+            {
+                std::unique_lock<std::mutex> lock (this->m);
+                this->stopping = true;
+            }
+            this->cv.notify_all();
+            this->io.join();
+            if (this->error) {
+                try {
+                    std::rethrow_exception (this->error);
+                } catch (const std::exception& e) {
+                    std::cerr << "HdfDataAsync: a write failed: " << e.what() << std::endl;
+                }
+            }
+        }
+
+        //! The bound on the bytes of data waiting to be written
+        const size_t maxQueueBytes;
+
+        /*!
+         * Queue a write of a single value, as HdfData::add_val.
+         */
+        template <typename T>
+        void add_val (const char* path, const T& val) {
+            string p (path);
+            this->submit ([p, val](HdfData& d) { d.add_val (p.c_str(), val); }, sizeof(T));
+        }
+
+        //! Queue a write of a string, as HdfData::add_string
+        void add_string (const char* path, const string& str) {
+            string p (path);
+            this->submit ([p, str](HdfData& d) { d.add_string (p.c_str(), str); }, str.size());
+        }
+
+        /*!
+         * Queue a write of a container, as HdfData::add_contained_vals. vals is taken by
+         * value, so pass it with std::move to hand it over rather than copy it.
+         */
+        template <typename C>
+        void add_contained_vals (const char* path, C vals) {
+            string p (path);
+            size_t bytes = vals.size() * sizeof(typename C::value_type);
+            std::shared_ptr<C> v = std::make_shared<C> (std::move (vals));
+            this->submit ([p, v](HdfData& d) { d.add_contained_vals (p.c_str(), *v); }, bytes);
+        }
+
+        /*!
+         * Queue a write of an nrows by ncols 2D dataset from vals, in which row r starts at
+         * vals + r * rowstride, as HdfData::add_ptrarray_vals. The values are copied.
+         */
+        template <typename Flt>
+        void add_ptrarray_vals (const char* path, const Flt* vals, const unsigned int nrows,
+                                const unsigned int ncols, const unsigned int rowstride) {
+            string p (path);
+            std::shared_ptr<vector<Flt> > v = std::make_shared<vector<Flt> > ((size_t)nrows * ncols);
+            for (unsigned int r = 0; r < nrows; ++r) {
+                std::copy (vals + (size_t)r * rowstride, vals + (size_t)r * rowstride + ncols,
+                           v->begin() + (size_t)r * ncols);
+            }
+            this->submit ([p, v, nrows, ncols](HdfData& d) {
+                    d.add_ptrarray_vals (p.c_str(), (const Flt*)v->data(), nrows, ncols, ncols);
+                }, v->size() * sizeof(Flt));
+        }
+
+        /*!
+         * Queue a row to append, as HdfData::append_vals. vals is taken by value, as for
+         * add_contained_vals.
+         */
+        template <typename Flt>
+        void append_vals (const char* path, vector<Flt> vals, const HdfChunking& chunking = HdfChunking()) {
+            string p (path);
+            size_t bytes = vals.size() * sizeof(Flt);
+            std::shared_ptr<vector<Flt> > v = std::make_shared<vector<Flt> > (std::move (vals));
+            this->submit ([p, v, chunking](HdfData& d) { d.append_vals (p.c_str(), *v, chunking); }, bytes);
+        }
+
+        /*!
+         * Queue any other work on the file: f is called with the HdfData on the I/O thread,
+         * in order with the writes. bytes is what f holds, counted against maxQueueBytes.
+         */
+        void submit (std::function<void(HdfData&)> f, size_t bytes = 0) {
+            std::unique_lock<std::mutex> lock (this->m);
+            // Wait for room, though a write bigger than the whole bound may go into an empty queue
+            this->cv.wait (lock, [this, bytes]{
+                    return this->queue.empty() || this->queuedBytes + bytes <= this->maxQueueBytes;
+                });
+            this->rethrow();
+            this->queue.push_back (Job{ std::move (f), bytes });
+            this->queuedBytes += bytes;
+            if (this->queuedBytes > this->peakBytes) {
+                this->peakBytes = this->queuedBytes;
+            }
+            lock.unlock();
+            this->cv.notify_all();
+        }
+
+        //! Wait until every queued write has been made
+        void flush (void) {
+            std::unique_lock<std::mutex> lock (this->m);
+            this->cv.wait (lock, [this]{ return this->queue.empty() && !this->busy; });
+            this->rethrow();
+        }
+
+        //! The bytes waiting to be written now, and the most that have been waiting
+        //@{
+        size_t pending (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            return this->queuedBytes;
+        }
+        size_t peak (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            return this->peakBytes;
+        }
+        //@}
+
+    private:
+        struct Job
+        {
+            std::function<void(HdfData&)> f;
+            size_t bytes;
+        };
+
+        //! The I/O thread, which owns the HdfData from opening to closing
+        void run (string fname, bool read_data) {
+            std::unique_ptr<HdfData> d;
+            try {
+                d.reset (new HdfData (fname, read_data));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock (this->m);
+                this->error = std::current_exception();
+                this->cv.notify_all();
+                return;
+            }
+            std::unique_lock<std::mutex> lock (this->m);
+            this->opened = true;
+            this->cv.notify_all();
+            for (;;) {
+                this->cv.wait (lock, [this]{ return !this->queue.empty() || this->stopping; });
+                if (this->queue.empty()) {
+                    break;
+                }
+                Job job = std::move (this->queue.front());
+                this->queue.pop_front();
+                this->busy = true;
+                lock.unlock();
+                try {
+                    job.f (*d);
+                } catch (...) {
+                    std::lock_guard<std::mutex> elock (this->m);
+                    if (!this->error) {
+                        this->error = std::current_exception();
+                    }
+                }
+                job.f = nullptr;
+                lock.lock();
+                this->busy = false;
+                this->queuedBytes -= job.bytes;
+                this->cv.notify_all();
+            }
+            lock.unlock();
+            // Close the file on this thread
+            d.reset();
+        }
+
+        //! Rethrow (once) an exception from a write. Call with m held.
+        void rethrow (void) {
+            if (this->error) {
+                std::exception_ptr e = this->error;
+                this->error = nullptr;
+                std::rethrow_exception (e);
+            }
+        }
+
+        std::deque<Job> queue;
+        size_t queuedBytes = 0;
+        size_t peakBytes = 0;
+        bool opened = false;
+        bool busy = false;
+        bool stopping = false;
+        std::exception_ptr error;
+        std::thread io;
+        std::mutex m;
+        std::condition_variable cv;
+    };
+
+} // namespace morph
+
+#endif // _HDFDATAASYNC_H_
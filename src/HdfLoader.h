@@ -0,0 +1,218 @@
+/*
+ * Reads a set of datasets from each of many HDF5 files, on a pool of threads.
+ */
+
+#ifndef _HDFLOADER_H_
+#define _HDFLOADER_H_
+
+#include "HdfData.h"
+#include "tools.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+using std::vector;
+using std::string;
+using std::stringstream;
+using std::runtime_error;
+
+namespace morph {
+
+    /*!
+     * Loads the same datasets from every file of a sweep, such as the HDF5 logs under a
+     * logpath tree, for post-processing:
+     *
+     *\code
+     HdfLoader<double> loader ("logs", ".h5");
+     loader.datasets = { "/c_0", "/c_1" };
+     vector<double> all (loader.files.size() * loader.rowLength());
+     loader.load (all.data(), loader.rowLength()); // Row i holds /c_0 then /c_1 of files[i]
+     \endcode
+     *
+     * or, to work on each file's data as it arrives, without keeping it all:
+     *
+     *\code
+     loader.load ([](size_t i, const string& file, const vector<HdfView<double> >& v) { ... });
+     \endcode
+     *
+     * The files are shared out between nthreads workers, each of which opens one file at
+     * a time, read only, with its own HdfData, and reads the datasets with
+     * HdfData::map_vals (so that contiguous datasets are mapped rather than read, and
+     * quantised ones dequantised). HDF5 runs one call at a time whether or not it was
+     * built thread safe, so what runs in parallel is the work outside the library: the
+     * disk reads as the mapped values are touched, the copies into the 2D array, and the
+     * callbacks. Only contiguous, unfiltered datasets (as written by add_contained_vals)
+     * are mapped, so only they load faster with more threads. Chunked datasets (those
+     * of append_vals, and compressed or quantised ones) are read and decompressed inside
+     * HDF5, one file at a time, at the speed of one thread. Each file is read through
+     * even if another fails; the first failure is rethrown once all the files are done.
+     */
+    template <typename Flt = double>
+    class HdfLoader
+    {
+    public:
+        //! Load the files listed in files_
+        explicit HdfLoader (const vector<string>& files_) : files(files_) {}
+
+        /*!
+         * Load every file in the directory tree under dirPath whose name ends in suffix,
+         * in sorted order.
+         */
+        HdfLoader (const string& dirPath, const string& suffix) {
+            vector<string> tree;
+            morph::Tools::readDirectoryTree (tree, dirPath);
+            std::sort (tree.begin(), tree.end());
+            for (const string& f : tree) {
+                if (f.size() >= suffix.size()
+                    && f.compare (f.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                    this->files.push_back (dirPath + "/" + f);
+                }
+            }
+        }
+
+        //! The files to load from
+        vector<string> files;
+
+        //! The paths of the datasets to read from each file
+        vector<string> datasets;
+
+        //! The number of worker threads. 0 means one per hardware thread.
+        unsigned int nthreads = 0;
+
+        //! The time that the last load() took, and the number of values it loaded
+        //@{
+        double loadSeconds = 0.0;
+        size_t loadedValues = 0;
+        //@}
+
+        /*!
+         * The function called with each file's data: the index of the file in files, its
+         * name, and views of its datasets, in the order of datasets. It is called from the
+         * worker threads, for different files at once, so it must only touch shared state
+         * under a lock, or state that belongs to file i. The views stay valid after the
+         * call if copied.
+         */
+        typedef std::function<void(size_t, const string&, const vector<HdfView<Flt> >&)> Callback;
+
+        //! Load every file, passing its data to f
+        void load (Callback f) {
+            this->run (f);
+        }
+
+        /*!
+         * The number of values in all the datasets of the first file; the length of each
+         * row that load (Flt*, size_t) writes.
+         */
+        size_t rowLength (void) {
+            if (this->files.empty()) {
+                return 0;
+            }
+            HdfData d (this->files[0], true, true);
+            size_t n = 0;
+            HdfView<Flt> v;
+            for (const string& p : this->datasets) {
+                d.map_vals (p.c_str(), v);
+                n += v.size();
+            }
+            return n;
+        }
+
+        /*!
+         * Load every file into out, a preallocated files.size() by rowstride array: the
+         * datasets of files[i] go one after another at the start of row i. Every file must
+         * hold the same number of values, at most rowstride of them, or its load fails.
+         */
+        void load (Flt* out, size_t rowstride) {
+            const size_t rowlen = this->rowLength();
+            if (rowlen > rowstride) {
+                stringstream ee;
+                ee << "HdfLoader: rows of " << rowlen << " values don't fit in a rowstride of " << rowstride;
+                throw runtime_error (ee.str());
+            }
+            this->run ([out, rowstride, rowlen](size_t i, const string& file, const vector<HdfView<Flt> >& views) {
+                    size_t n = 0;
+                    for (const HdfView<Flt>& v : views) { n += v.size(); }
+                    if (n != rowlen) {
+                        stringstream ee;
+                        ee << "HdfLoader: " << file << " holds " << n << " values, not " << rowlen;
+                        throw runtime_error (ee.str());
+                    }
+                    Flt* row = out + i * rowstride;
+                    for (const HdfView<Flt>& v : views) {
+                        row = std::copy (v.begin(), v.end(), row);
+                    }
+                });
+        }
+
+    private:
+        //! Share the files out between the workers, calling f with each file's views
+        void run (Callback f) {
+            const size_t nf = this->files.size();
+            unsigned int nt = this->nthreads;
+            if (nt == 0) {
+                nt = std::thread::hardware_concurrency();
+            }
+            if (nt == 0) {
+                nt = 1;
+            }
+            if (nt > nf) {
+                nt = nf;
+            }
+
+            std::atomic<size_t> next (0);
+            std::atomic<size_t> values (0);
+            vector<std::exception_ptr> errors (nf);
+
+            auto worker = [&]() {
+                vector<HdfView<Flt> > views (this->datasets.size());
+                size_t i;
+                while ((i = next++) < nf) {
+                    try {
+                        {
+                            HdfData d (this->files[i], true, true);
+                            for (size_t k = 0; k < this->datasets.size(); ++k) {
+                                d.map_vals (this->datasets[k].c_str(), views[k]);
+                            }
+                        } // The views outlive the file's HdfData
+                        f (i, this->files[i], views);
+                        for (const HdfView<Flt>& v : views) { values += v.size(); }
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+
+            auto t0 = std::chrono::steady_clock::now();
+            if (nt <= 1) {
+                worker();
+            } else {
+                vector<std::thread> pool;
+                for (unsigned int t = 0; t < nt; ++t) {
+                    pool.emplace_back (worker);
+                }
+                for (std::thread& t : pool) {
+                    t.join();
+                }
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            this->loadSeconds = std::chrono::duration<double>(t1 - t0).count();
+            this->loadedValues = values;
+
+            for (size_t i = 0; i < nf; ++i) {
+                if (errors[i]) {
+                    std::rethrow_exception (errors[i]);
+                }
+            }
+        }
+    };
+
+} // namespace morph
+
+#endif // _HDFLOADER_H_
@@ -0,0 +1,195 @@
+/*
+ * The narrow band of hexes that are changing, for stepping only where the dynamics are.
+ */
+
+#ifndef _HEXACTIVESET_H_
+#define _HEXACTIVESET_H_
+
+#include "HexGrid.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+namespace morph {
+
+    /*!
+     * Maintains the list of the hexes of a HexGrid that are active: those whose fields
+     * changed faster than threshold in the last step, plus every hex within halo
+     * neighbour steps of them. In models where only a band of hexes (near a moving front,
+     * say) changes at any time, stepping just those hexes saves most of the work.
+     *
+     * Use begin() before and end() after each step; RD_Base::integrate does this when
+     * enabled is true. Between them, indices() is the list of hexes to step, in ascending
+     * order, unless full() is true, in which case every hex is stepped. The first step and
+     * every fullSweepEvery'th step after it are full sweeps, which let changes that arose
+     * outside the band (or that the band couldn't keep up with) join it.
+     *
+     * A hex leaves the band only once it and all its neighbours within halo steps have
+     * stopped changing, so the band moves with a front of up to halo hexes per step.
+     */
+    template <class Flt>
+    class HexActiveSet
+    {
+    public:
+        //! If true, RD_Base::integrate steps only the active hexes
+        bool enabled = false;
+
+        /*!
+         * A hex is active if any of its fields changed at a rate (|dy|/dt) greater than
+         * this in the last step.
+         */
+        Flt threshold = 1e-6;
+
+        //! How many rings of neighbours around the changing hexes are also active
+        unsigned int halo = 2;
+
+        //! Make every fullSweepEvery'th step a full sweep (0 for only the first)
+        unsigned int fullSweepEvery = 100;
+
+        //! The active hexes, in ascending order (meaningful while full() is false)
+        const vector<unsigned int>& indices (void) const { return this->active; }
+
+        //! True if the current (or, outside a step, the next) step is a full sweep
+        bool full (void) const { return this->fullSweep; }
+
+        //! True between begin() and end() of a step that isn't a full sweep
+        bool stepping (void) const { return this->inStep && !this->fullSweep; }
+
+        /*!
+         * The fraction of the hexes stepped in the last step, and the mean of that
+         * fraction over all the steps since reset().
+         */
+        //@{
+        double fraction (void) const { return this->lastFraction; }
+        double meanFraction (void) const {
+            return this->steps > 0 ? this->fractionSum / this->steps : 1.0;
+        }
+        //@}
+
+        //! Forget the band, so that the next step is a full sweep
+        void reset (void) {
+            this->steps = 0;
+            this->fractionSum = 0.0;
+            this->lastFraction = 1.0;
+            this->active.clear();
+            this->prev.clear();
+            this->n = 0;
+        }
+
+        /*!
+         * Call before a step of the first nhex elements of the fields. Decides whether the
+         * step is a full sweep and records the values of the hexes that will be stepped.
+         */
+        void begin (const vector<vector<Flt> >& fields, unsigned int nhex) {
+            if (nhex != this->n || this->prev.size() != fields.size()) {
+                this->reset();
+                this->n = nhex;
+                this->prev.resize (fields.size());
+                for (auto& p : this->prev) {
+                    p.assign (nhex, 0.0);
+                }
+                this->mark.assign (nhex, 0);
+            }
+            this->fullSweep = (this->steps == 0
+                               || (this->fullSweepEvery > 0 && this->steps % this->fullSweepEvery == 0));
+            for (unsigned int f = 0; f < fields.size(); ++f) {
+                const Flt* y = fields[f].data();
+                Flt* p = this->prev[f].data();
+                if (this->fullSweep) {
+                    std::copy (y, y + nhex, p);
+                } else {
+                    const unsigned int* idx = this->active.data();
+                    int m = this->active.size();
+#pragma omp parallel for schedule(static)
+                    for (int j = 0; j < m; ++j) {
+                        p[idx[j]] = y[idx[j]];
+                    }
+                }
+            }
+            this->inStep = true;
+        }
+
+        /*!
+         * Call after the step, which was of size dt. Rebuilds the band from the hexes that
+         * changed in the step.
+         */
+        void end (const HexGrid& hg, const vector<vector<Flt> >& fields, Flt dt) {
+            unsigned int stepped = this->fullSweep ? this->n : this->active.size();
+            this->lastFraction = this->n > 0 ? (double)stepped / this->n : 1.0;
+            this->fractionSum += this->lastFraction;
+            ++this->steps;
+            this->inStep = false;
+
+            // The seeds: the stepped hexes that changed by more than threshold * dt
+            Flt lim = this->threshold * dt;
+            vector<unsigned int> band;
+            for (unsigned int j = 0; j < stepped; ++j) {
+                unsigned int h = this->fullSweep ? j : this->active[j];
+                for (unsigned int f = 0; f < fields.size(); ++f) {
+                    if (std::abs (fields[f][h] - this->prev[f][h]) > lim) {
+                        this->mark[h] = 1;
+                        band.push_back (h);
+                        break;
+                    }
+                }
+            }
+
+            // Grow the seeds by halo rings of neighbours
+            const vector<int>* nbs[6] = { &hg.d_ne, &hg.d_nne, &hg.d_nnw,
+                                          &hg.d_nw, &hg.d_nsw, &hg.d_nse };
+            size_t ringstart = 0;
+            for (unsigned int r = 0; r < this->halo; ++r) {
+                size_t ringend = band.size();
+                for (size_t b = ringstart; b < ringend; ++b) {
+                    unsigned int h = band[b];
+                    for (unsigned int k = 0; k < 6; ++k) {
+                        int nb = (*nbs[k])[h];
+                        if (nb >= 0 && (unsigned int)nb < this->n && !this->mark[nb]) {
+                            this->mark[nb] = 1;
+                            band.push_back (nb);
+                        }
+                    }
+                }
+                ringstart = ringend;
+            }
+
+            // Into ascending order, by sorting a small band or by scanning the marks of a big one
+            if (band.size() < this->n / 16) {
+                for (unsigned int h : band) {
+                    this->mark[h] = 0;
+                }
+                std::sort (band.begin(), band.end());
+            } else {
+                band.clear();
+                for (unsigned int h = 0; h < this->n; ++h) {
+                    if (this->mark[h]) {
+                        band.push_back (h);
+                        this->mark[h] = 0;
+                    }
+                }
+            }
+            this->active.swap (band);
+            this->fullSweep = (this->fullSweepEvery > 0 && this->steps % this->fullSweepEvery == 0);
+        }
+
+    private:
+        //! The active hexes
+        vector<unsigned int> active;
+        //! The values of the stepped hexes at the start of the step
+        vector<vector<Flt> > prev;
+        //! Scratch flags for building the band (all 0 between steps)
+        vector<unsigned char> mark;
+        //! The number of hexes
+        unsigned int n = 0;
+        bool fullSweep = true;
+        bool inStep = false;
+        unsigned long long int steps = 0;
+        double fractionSum = 0.0;
+        double lastFraction = 1.0;
+    };
+
+} // namespace morph
+
+#endif // _HEXACTIVESET_H_
@@ -0,0 +1,299 @@
+/*
+ * An implicit diffusion solve on a HexGrid.
+ */
+
+#ifndef _HEXDIFFUSION_H_
+#define _HEXDIFFUSION_H_
+
+#include "HexGrid.h"
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+using std::vector;
+using std::runtime_error;
+
+namespace morph {
+
+    /*!
+     * Solves (I - c L) x = b on a HexGrid, where L is the hex Laplacian of
+     * RD_Base::compute_laplace (with its no-flux boundary) and c > 0. This is the
+     * implicit half of an IMEX step of diffusion, with c = dt * D.
+     *
+     * setup() builds I - c L once as a sparse matrix (compressed rows, from the d_
+     * neighbour vectors) and computes its incomplete Cholesky factor. solve() then runs
+     * conjugate gradients, preconditioned with that factor, and can be called each time
+     * step for as long as c is unchanged. The matrix is symmetric positive definite because
+     * the neighbour relation is symmetric and the boundary is no-flux.
+     */
+    template <class Flt>
+    class HexDiffusion
+    {
+    public:
+        /*!
+         * Relative residual at which solve() stops. The default is looser for float, in
+         * which the residual can't be computed much below 1e-6.
+         */
+        Flt tol = (sizeof(Flt) < sizeof(double) ? 1e-5 : 1e-8);
+
+        /*!
+         * Iteration limit for solve().
+         */
+        unsigned int maxIter = 1000;
+
+        /*!
+         * The number of iterations and the relative residual of the last solve().
+         */
+        //@{
+        unsigned int lastIterations = 0;
+        double lastResidual = 0.0;
+        //@}
+
+        /*!
+         * The c for which setup() was last called (0 if it hasn't been).
+         */
+        Flt c = 0.0;
+
+        /*!
+         * Build the matrix I - c_ L for the first nhex hexes of hg and factorise it. norm is
+         * the Laplacian's normalisation, 2/(3d^2).
+         */
+        void setup (const HexGrid* hg, unsigned int nhex, Flt norm, Flt c_) {
+            this->c = c_;
+            this->n = nhex;
+            unsigned int n = nhex;
+            const vector<int>* nbs[6] = { &hg->d_ne, &hg->d_nne, &hg->d_nnw,
+                                          &hg->d_nw, &hg->d_nsw, &hg->d_nse };
+
+            // The matrix, with each row's columns in ascending order
+            Flt off = -c_ * norm;
+            this->rowstart.assign (n+1, 0);
+            this->cols.clear();
+            this->vals.clear();
+            this->cols.reserve (7*n);
+            this->vals.reserve (7*n);
+            for (unsigned int i = 0; i < n; ++i) {
+                int row[7];
+                unsigned int nr = 0;
+                for (unsigned int j = 0; j < 6; ++j) {
+                    int nb = (*nbs[j])[i];
+                    if (nb >= 0) {
+                        row[nr++] = nb;
+                    }
+                }
+                Flt diag = 1.0 - off * nr;
+                row[nr++] = (int)i;
+                // Insertion sort of at most 7 columns
+                for (unsigned int a = 1; a < nr; ++a) {
+                    int v = row[a];
+                    unsigned int b = a;
+                    while (b > 0 && row[b-1] > v) { row[b] = row[b-1]; --b; }
+                    row[b] = v;
+                }
+                for (unsigned int a = 0; a < nr; ++a) {
+                    this->cols.push_back (row[a]);
+                    this->vals.push_back (row[a] == (int)i ? diag : off);
+                }
+                this->rowstart[i+1] = this->cols.size();
+            }
+
+            this->factorise();
+
+            this->r.assign (n, 0.0);
+            this->z.assign (n, 0.0);
+            this->p.assign (n, 0.0);
+            this->q.assign (n, 0.0);
+        }
+
+        /*!
+         * Solve (I - c L) x = b for x, starting from the value in x. b and x are n long
+         * (anything beyond n, such as ghost slots, is untouched). Returns the number of
+         * iterations taken; throws if the solve fails to converge in maxIter iterations.
+         */
+        unsigned int solve (const Flt* b, Flt* x) {
+            if (this->rowstart.empty()) {
+                throw runtime_error ("HexDiffusion::solve: call setup() first");
+            }
+            int nn = this->n;
+            double bnorm = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:bnorm)
+            for (int i = 0; i < nn; ++i) {
+                bnorm += (double)b[i] * b[i];
+            }
+            bnorm = std::sqrt (bnorm);
+            if (bnorm == 0.0) {
+                for (int i = 0; i < nn; ++i) { x[i] = 0.0; }
+                this->lastIterations = 0;
+                this->lastResidual = 0.0;
+                return 0;
+            }
+
+            // r = b - A x
+            this->multiply (x, this->q.data());
+            double rr = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:rr)
+            for (int i = 0; i < nn; ++i) {
+                this->r[i] = b[i] - this->q[i];
+                rr += (double)this->r[i] * this->r[i];
+            }
+            this->precondition (this->r.data(), this->z.data());
+            double rz = this->dot (this->r.data(), this->z.data());
+            this->p = this->z;
+
+            unsigned int it = 0;
+            double res = std::sqrt (rr) / bnorm;
+            while (res > this->tol && it < this->maxIter) {
+                this->multiply (this->p.data(), this->q.data());
+                double alpha = rz / this->dot (this->p.data(), this->q.data());
+                rr = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:rr)
+                for (int i = 0; i < nn; ++i) {
+                    x[i] += alpha * this->p[i];
+                    this->r[i] -= alpha * this->q[i];
+                    rr += (double)this->r[i] * this->r[i];
+                }
+                res = std::sqrt (rr) / bnorm;
+                ++it;
+                if (res <= this->tol) {
+                    break;
+                }
+                this->precondition (this->r.data(), this->z.data());
+                double rznew = this->dot (this->r.data(), this->z.data());
+                double beta = rznew / rz;
+                rz = rznew;
+#pragma omp parallel for schedule(static)
+                for (int i = 0; i < nn; ++i) {
+                    this->p[i] = this->z[i] + beta * this->p[i];
+                }
+            }
+
+            this->lastIterations = it;
+            this->lastResidual = res;
+            if (res > this->tol) {
+                throw runtime_error ("HexDiffusion::solve: no convergence within maxIter iterations");
+            }
+            return it;
+        }
+
+        /*!
+         * y = (I - c L) x
+         */
+        void multiply (const Flt* x, Flt* y) const {
+            int nn = this->n;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < nn; ++i) {
+                Flt sum = 0.0;
+                for (unsigned int k = this->rowstart[i]; k < this->rowstart[i+1]; ++k) {
+                    sum += this->vals[k] * x[this->cols[k]];
+                }
+                y[i] = sum;
+            }
+        }
+
+    private:
+        /*!
+         * Incomplete Cholesky, IC(0): the lower triangular lfac, with the sparsity of the
+         * lower triangle of the matrix, such that lfac lfac^T approximates it.
+         */
+        void factorise (void) {
+            this->lstart.assign (this->n+1, 0);
+            this->lcols.clear();
+            this->lvals.clear();
+            this->ldiag.assign (this->n, 0.0);
+            for (unsigned int i = 0; i < this->n; ++i) {
+                for (unsigned int k = this->rowstart[i]; k < this->rowstart[i+1]; ++k) {
+                    if (this->cols[k] < (int)i) {
+                        this->lcols.push_back (this->cols[k]);
+                        this->lvals.push_back (this->vals[k]);
+                    } else if (this->cols[k] == (int)i) {
+                        this->ldiag[i] = this->vals[k];
+                    }
+                }
+                this->lstart[i+1] = this->lcols.size();
+            }
+            for (unsigned int i = 0; i < this->n; ++i) {
+                unsigned int a0 = this->lstart[i];
+                unsigned int a1 = this->lstart[i+1];
+                for (unsigned int a = a0; a < a1; ++a) {
+                    int kk = this->lcols[a];
+                    // Subtract the sum over the columns that rows i and kk share (below kk)
+                    double s = this->lvals[a];
+                    unsigned int b = this->lstart[kk];
+                    for (unsigned int a2 = a0; a2 < a; ++a2) {
+                        while (b < this->lstart[kk+1] && this->lcols[b] < this->lcols[a2]) { ++b; }
+                        if (b < this->lstart[kk+1] && this->lcols[b] == this->lcols[a2]) {
+                            s -= (double)this->lvals[a2] * this->lvals[b];
+                        }
+                    }
+                    this->lvals[a] = s / this->ldiag[kk];
+                }
+                double d = this->ldiag[i];
+                for (unsigned int a = a0; a < a1; ++a) {
+                    d -= (double)this->lvals[a] * this->lvals[a];
+                }
+                if (d <= 0.0) {
+                    throw runtime_error ("HexDiffusion::setup: incomplete Cholesky breakdown");
+                }
+                this->ldiag[i] = std::sqrt (d);
+            }
+        }
+
+        /*!
+         * z = (lfac lfac^T)^-1 r, by forward then backward substitution.
+         */
+        void precondition (const Flt* rv, Flt* zv) const {
+            for (unsigned int i = 0; i < this->n; ++i) {
+                double s = rv[i];
+                for (unsigned int a = this->lstart[i]; a < this->lstart[i+1]; ++a) {
+                    s -= (double)this->lvals[a] * zv[this->lcols[a]];
+                }
+                zv[i] = s / this->ldiag[i];
+            }
+            for (unsigned int i = this->n; i-- > 0; ) {
+                zv[i] /= this->ldiag[i];
+                for (unsigned int a = this->lstart[i]; a < this->lstart[i+1]; ++a) {
+                    zv[this->lcols[a]] -= this->lvals[a] * zv[i];
+                }
+            }
+        }
+
+        double dot (const Flt* a, const Flt* b) const {
+            int nn = this->n;
+            double s = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:s)
+            for (int i = 0; i < nn; ++i) {
+                s += (double)a[i] * b[i];
+            }
+            return s;
+        }
+
+        //! The number of unknowns
+        unsigned int n = 0;
+
+        //! The matrix in compressed row form
+        //@{
+        vector<unsigned int> rowstart;
+        vector<int> cols;
+        vector<Flt> vals;
+        //@}
+
+        //! The strictly lower part of the incomplete Cholesky factor, by rows, and its diagonal
+        //@{
+        vector<unsigned int> lstart;
+        vector<int> lcols;
+        vector<Flt> lvals;
+        vector<Flt> ldiag;
+        //@}
+
+        //! Conjugate gradient work vectors
+        //@{
+        vector<Flt> r;
+        vector<Flt> z;
+        vector<Flt> p;
+        vector<Flt> q;
+        //@}
+    };
+
+} // namespace morph
+
+#endif // _HEXDIFFUSION_H_
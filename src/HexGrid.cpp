@@ -16,9 +16,13 @@
 #include <vector>
 #include <set>
 #include <stdexcept>
+#include <queue>
+#include <functional>
+#include <algorithm>
 #include "BezCurvePath.h"
 #include "BezCoord.h"
 #include "HdfData.h"
+#include "Instrument.h"
 
 #define DBGSTREAM std::cout
 //#define DEBUG 1
@@ -56,15 +60,21 @@ morph::HexGrid::HexGrid (const string& path)
     this->load (path);
 }
 
-morph::HexGrid::HexGrid (float d_, float x_span_, float z_, morph::HexDomainShape shape)
+morph::HexGrid::HexGrid (float d_, float x_span_, float z_,
+                         morph::HexDomainShape shape, morph::HexGridStorage storage_)
 {
     this->d = d_;
     this->v = this->d * SQRT_OF_3_OVER_2_F;
     this->x_span = x_span_;
     this->z = z_;
     this->domainShape = shape;
+    this->storage = storage_;
 
-    this->init();
+    if (this->storage == morph::HexGridStorage::Flat) {
+        this->initFlat();
+    } else {
+        this->init();
+    }
 }
 
 void
@@ -94,11 +104,16 @@ morph::HexGrid::load (const string& path)
     hgdata.read_contained_vals ("/d_nw", this->d_nw);
     hgdata.read_contained_vals ("/d_nsw", this->d_nsw);
     hgdata.read_contained_vals ("/d_nse", this->d_nse);
+    hgdata.read_contained_vals ("/d_flags", this->d_flags);
+    if (hgdata.exists ("/d_canonical")) {
+        hgdata.read_contained_vals ("/d_canonical", this->d_canonical);
+    }
 
     // Assume a boundary has been applied so set this true. Also, the HexGrid::save method doesn't
     // save HexGrid::vertexE, etc
     this->gridReduced = true;
 
+    this->invalidateHexIndex();
     unsigned int hcount = 0;
     hgdata.read_val ("/hcount", hcount);
     for (unsigned int i = 0; i < hcount; ++i) {
@@ -108,116 +123,50 @@ morph::HexGrid::load (const string& path)
     }
 
     // After creating hexen list, need to set neighbour relations in each Hex, as loaded in d_ne,
-    // etc.
-    for (Hex& _h : this->hexen) {
-        DBG ("Set neighbours for Hex " << _h.outputRG());
-        // For each Hex, six loops through hexen:
-        if (_h.has_ne() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_ne[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.ne = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour E relation...");
-            }
+    // etc. The d_ vectors are indexed by Hex::di and hold the di of each neighbour, so first make
+    // a lookup from di to iterator. Then each relation is set in constant time.
+    vector<list<Hex>::iterator> di_to_hex (this->d_x.size(), this->hexen.end());
+    for (list<Hex>::iterator hi = this->hexen.begin(); hi != this->hexen.end(); ++hi) {
+        if (hi->di >= di_to_hex.size()) {
+            throw runtime_error ("Hex::di is out of range of the d_ vectors.");
         }
+        di_to_hex[hi->di] = hi;
+    }
 
-        if (_h.has_nne() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_nne[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.nne = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour NE relation...");
-            }
+    auto neighbour = [&di_to_hex, this](int ndi, const char* dirn) {
+        if (ndi < 0 || (unsigned int)ndi >= di_to_hex.size() || di_to_hex[ndi] == this->hexen.end()) {
+            throw runtime_error (string("Failed to match hexen neighbour ") + dirn + " relation...");
         }
+        return di_to_hex[ndi];
+    };
 
-        if (_h.has_nnw() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_nnw[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.nnw = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour NW relation...");
-            }
-        }
+    for (Hex& _h : this->hexen) {
+        DBG ("Set neighbours for Hex " << _h.outputRG());
+        if (_h.has_ne() == true) { _h.ne = neighbour (this->d_ne[_h.di], "E"); }
+        if (_h.has_nne() == true) { _h.nne = neighbour (this->d_nne[_h.di], "NE"); }
+        if (_h.has_nnw() == true) { _h.nnw = neighbour (this->d_nnw[_h.di], "NW"); }
+        if (_h.has_nw() == true) { _h.nw = neighbour (this->d_nw[_h.di], "W"); }
+        if (_h.has_nsw() == true) { _h.nsw = neighbour (this->d_nsw[_h.di], "SW"); }
+        if (_h.has_nse() == true) { _h.nse = neighbour (this->d_nse[_h.di], "SE"); }
+    }
+}
 
-        if (_h.has_nw() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_nw[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.nw = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour W relation...");
-            }
-        }
+void
+morph::HexGrid::save (const string& path)
+{
+    if (!this->fhexen.empty()) { this->flatToList(); }
 
-        if (_h.has_nsw() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_nsw[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.nsw = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour SW relation...");
-            }
-        }
+    this->write (path);
 
-        if (_h.has_nse() == true) {
-            bool matched = false;
-            unsigned int neighb_it = (unsigned int) this->d_nse[_h.vi];
-            list<Hex>::iterator hi = this->hexen.begin();
-            while (hi != this->hexen.end()) {
-                if (hi->vi == neighb_it) {
-                    matched = true;
-                    _h.nse = hi;
-                    break;
-                }
-                ++hi;
-            }
-            if (!matched) {
-                throw runtime_error ("Failed to match hexen neighbour SE relation...");
-            }
-        }
-    }
+    // What about vhexen? Probably don't save and re-call method to populate.
+    this->renumberVectorIndices();
+
+    // What about bhexen? Probably re-run/test this->boundaryContiguous() on load.
+    this->boundaryContiguous();
 }
 
 void
-morph::HexGrid::save (const string& path)
+morph::HexGrid::write (const string& path) const
 {
     HdfData hgdata (path);
     hgdata.add_val ("/d", d);
@@ -257,25 +206,34 @@ morph::HexGrid::save (const string& path)
 
     // vector<unsigned int>
     hgdata.add_contained_vals ("/d_flags", d_flags);
+    // The original order of a grid that was reordered, so that toCanonical() works after load()
+    if (!this->d_canonical.empty()) {
+        hgdata.add_contained_vals ("/d_canonical", d_canonical);
+    }
 
     // list<Hex> hexen
     // for i in list, save Hex
-    list<Hex>::const_iterator h = this->hexen.begin();
     unsigned int hcount = 0;
-    while (h != this->hexen.end()) {
-        // Make up a path
-        string h5path = "/hexen/" + to_string(hcount);
-        h->save (hgdata, h5path);
-        ++h;
-        ++hcount;
+    if (!this->fhexen.empty()) {
+        // A flat grid: save each Hex as flatToList() would make it
+        for (const FlatHex& fh : this->fhexen) {
+            Hex h (hcount, this->d, fh.ri, fh.gi);
+            h.di = hcount;
+            h.setFlag (fh.flags);
+            h.save (hgdata, "/hexen/" + to_string(hcount));
+            ++hcount;
+        }
+    } else {
+        list<Hex>::const_iterator h = this->hexen.begin();
+        while (h != this->hexen.end()) {
+            // Make up a path
+            string h5path = "/hexen/" + to_string(hcount);
+            h->save (hgdata, h5path);
+            ++h;
+            ++hcount;
+        }
     }
     hgdata.add_val ("/hcount", hcount);
-
-    // What about vhexen? Probably don't save and re-call method to populate.
-    this->renumberVectorIndices();
-
-    // What about bhexen? Probably re-run/test this->boundaryContiguous() on load.
-    this->boundaryContiguous();
 }
 
 pair<float, float>
@@ -296,6 +254,8 @@ morph::HexGrid::computeCentroid (const list<Hex>& pHexes)
 void
 morph::HexGrid::setBoundaryOnOuterEdge (void)
 {
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
     // From centre head to boundary, then mark boundary and walk
     // around the edge.
     list<Hex>::iterator bpi = this->hexen.begin();
@@ -352,6 +312,8 @@ morph::HexGrid::setBoundaryOnOuterEdge (void)
 void
 morph::HexGrid::setBoundary (const list<Hex>& pHexes)
 {
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
     this->boundaryCentroid = this->computeCentroid (pHexes);
 
     list<Hex>::iterator bpoint = this->hexen.begin();
@@ -456,6 +418,8 @@ morph::HexGrid::getRegion (BezCurvePath<float>& p, pair<float, float>& regionCen
 vector<list<Hex>::iterator>
 morph::HexGrid::getRegion (vector<BezCoord<float>>& bpoints, pair<float, float>& regionCentroid, bool applyOriginalBoundaryCentroid)
 {
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
     // First clear all region boundary flags, as we'll be defining a new region boundary
     this->clearRegionBoundaryFlags();
 
@@ -592,6 +556,7 @@ morph::HexGrid::setBoundary (const BezCurvePath<float>& p)
 void
 morph::HexGrid::setBoundary (vector<BezCoord<float>>& bpoints)
 {
+    MORPH_PHASE ("hexgrid_boundary", 0);
     this->boundaryCentroid = BezCurvePath<float>::getCentroid (bpoints);
     DBG ("Boundary centroid: " << boundaryCentroid.first << "," << boundaryCentroid.second);
     auto bpi = bpoints.begin();
@@ -604,6 +569,15 @@ morph::HexGrid::setBoundary (vector<BezCoord<float>>& bpoints)
     // Zero out the centroid, as the boundary is now centred on 0,0
     this->boundaryCentroid = make_pair (0.0, 0.0);
 
+    if (!this->fhexen.empty()) {
+        if (this->domainShape == morph::HexDomainShape::Boundary) {
+            this->setBoundaryFlat (bpoints);
+            return;
+        }
+        // The regular domain shapes are set up on the list<Hex> path.
+        this->flatToList();
+    }
+
     list<Hex>::iterator nearbyBoundaryPoint = this->hexen.begin(); // i.e the Hex at 0,0
     bpi = bpoints.begin();
     while (bpi != bpoints.end()) {
@@ -654,9 +628,16 @@ morph::HexGrid::setBoundary (const BezCoord<float>& point, list<Hex>::iterator s
 list<Hex>::iterator
 morph::HexGrid::findHexNearPoint (const BezCoord<float>& point, list<Hex>::iterator startFrom)
 {
+    // The hex containing the point is the nearest of all; if there is one, we're done.
+    list<Hex>::iterator h = this->findHexAt (make_pair (point.x(), point.y()));
+    if (h != this->hexen.end()) {
+        return h;
+    }
+
+    // Otherwise the point is off the grid, so walk towards it from startFrom
     bool neighbourNearer = true;
 
-    list<Hex>::iterator h = startFrom;
+    h = startFrom;
     float d = h->distanceFrom (point);
     float d_ = 0.0f;
 
@@ -1122,6 +1103,71 @@ morph::HexGrid::markAllHexesInsideDomain (void)
 void
 morph::HexGrid::computeDistanceToBoundary (void)
 {
+    MORPH_PHASE ("hexgrid_distance", 0);
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
+    // Index the hexes by Hex::vi, which runs from 0 to hexen.size()-1
+    unsigned int n = this->hexen.size();
+    vector<Hex*> hv (n, nullptr);
+    for (Hex& h : this->hexen) {
+        hv[h.vi] = &h;
+    }
+
+    // For each hex, the nearest boundary hex found so far and the distance to it
+    vector<int> src (n, -1);
+    vector<float> dist (n, FLT_MAX);
+
+    typedef pair<float, unsigned int> dist_idx;
+    std::priority_queue<dist_idx, vector<dist_idx>, std::greater<dist_idx>> wavefront;
+    for (unsigned int i = 0; i < n; ++i) {
+        if (hv[i]->testFlags(HEX_IS_BOUNDARY) == true) {
+            src[i] = i;
+            dist[i] = 0.0f;
+            wavefront.push (make_pair (0.0f, i));
+        }
+    }
+
+    while (!wavefront.empty()) {
+        dist_idx top = wavefront.top();
+        wavefront.pop();
+        unsigned int i = top.second;
+        if (top.first > dist[i]) {
+            continue; // stale entry
+        }
+        const Hex& s = *hv[src[i]];
+        for (unsigned short j = 0; j < 6; ++j) {
+            if (!hv[i]->has_neighbour (j)) { continue; }
+            unsigned int ni = hv[i]->get_neighbour(j)->vi;
+            float dn = hv[ni]->distanceFrom (s);
+            if (dn < dist[ni]) {
+                dist[ni] = dn;
+                src[ni] = src[i];
+                wavefront.push (make_pair (dn, ni));
+            }
+        }
+    }
+
+    bool set_d = (this->d_distToBoundary.size() == n);
+    for (unsigned int i = 0; i < n; ++i) {
+        Hex* h = hv[i];
+        if (h->testFlags(HEX_IS_BOUNDARY) == true) {
+            h->distToBoundary = 0.0f;
+        } else if (h->testFlags(HEX_INSIDE_BOUNDARY) == false) {
+            h->distToBoundary = -100.0;
+        } else {
+            h->distToBoundary = src[i] < 0 ? -1.0f : dist[i];
+        }
+        if (set_d) {
+            this->d_distToBoundary[h->di] = h->distToBoundary;
+        }
+    }
+}
+
+void
+morph::HexGrid::computeDistanceToBoundaryBruteForce (void)
+{
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
     list<Hex>::iterator h = this->hexen.begin();
     while (h != this->hexen.end()) {
         if (h->testFlags(HEX_IS_BOUNDARY) == true) {
@@ -1235,6 +1281,120 @@ morph::HexGrid::d_clear (void)
     this->d_gi.clear();
     this->d_bi.clear();
     this->d_flags.clear();
+    this->d_nbtab.clear();
+    this->d_ghostsrc.clear();
+}
+
+unsigned long long
+morph::HexGrid::hilbertKey (unsigned int n, unsigned int x, unsigned int y)
+{
+    unsigned long long key = 0;
+    for (unsigned int s = n/2; s > 0; s /= 2) {
+        unsigned int rx = (x & s) > 0 ? 1 : 0;
+        unsigned int ry = (y & s) > 0 ? 1 : 0;
+        key += (unsigned long long)s * (unsigned long long)s * ((3 * rx) ^ ry);
+        // Rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            unsigned int t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return key;
+}
+
+void
+morph::HexGrid::permuteNeighbours (vector<int>& nb, const vector<unsigned int>& order, const vector<int>& newidx)
+{
+    permute (nb, order);
+    for (int& n : nb) {
+        if (n >= 0) {
+            n = newidx[n];
+        }
+    }
+}
+
+void
+morph::HexGrid::reorderHilbert (void)
+{
+    MORPH_PHASE ("hexgrid_hilbert", 0);
+    if (!this->fhexen.empty()) { this->flatToList(); }
+
+    if (this->domainShape != morph::HexDomainShape::Boundary
+        && this->domainShape != morph::HexDomainShape::Hexagon) {
+        throw runtime_error ("HexGrid::reorderHilbert: The d_ vectors of rectangular and "
+                             "parallelogram domains must stay in raster order.");
+    }
+    unsigned int n = this->d_x.size();
+    if (n == 0 || n != this->hexen.size()) {
+        throw runtime_error ("HexGrid::reorderHilbert: The d_ vectors must hold every Hex in hexen.");
+    }
+
+    // Shift (ri,gi) into the square [0,side) x [0,side)
+    int rimin = this->d_ri[0];
+    int rimax = rimin;
+    int gimin = this->d_gi[0];
+    int gimax = gimin;
+    for (unsigned int i = 1; i < n; ++i) {
+        rimin = this->d_ri[i] < rimin ? this->d_ri[i] : rimin;
+        rimax = this->d_ri[i] > rimax ? this->d_ri[i] : rimax;
+        gimin = this->d_gi[i] < gimin ? this->d_gi[i] : gimin;
+        gimax = this->d_gi[i] > gimax ? this->d_gi[i] : gimax;
+    }
+    unsigned int span = (unsigned int)std::max (rimax - rimin, gimax - gimin) + 1;
+    unsigned int side = 1;
+    while (side < span) { side *= 2; }
+
+    vector<unsigned long long> key (n);
+    for (unsigned int i = 0; i < n; ++i) {
+        key[i] = hilbertKey (side, this->d_ri[i] - rimin, this->d_gi[i] - gimin);
+    }
+
+    // order[new index] = old index; newidx[old index] = new index
+    vector<unsigned int> order (n);
+    for (unsigned int i = 0; i < n; ++i) { order[i] = i; }
+    std::sort (order.begin(), order.end(),
+               [&key](unsigned int a, unsigned int b) { return key[a] < key[b]; });
+    vector<int> newidx (n);
+    for (unsigned int k = 0; k < n; ++k) { newidx[order[k]] = k; }
+
+    permute (this->d_x, order);
+    permute (this->d_y, order);
+    permute (this->d_ri, order);
+    permute (this->d_gi, order);
+    permute (this->d_bi, order);
+    permute (this->d_flags, order);
+    permute (this->d_distToBoundary, order);
+    permuteNeighbours (this->d_ne, order, newidx);
+    permuteNeighbours (this->d_nne, order, newidx);
+    permuteNeighbours (this->d_nnw, order, newidx);
+    permuteNeighbours (this->d_nw, order, newidx);
+    permuteNeighbours (this->d_nsw, order, newidx);
+    permuteNeighbours (this->d_nse, order, newidx);
+
+    // Compose with any earlier reordering
+    if (this->d_canonical.empty()) {
+        this->d_canonical = order;
+    } else {
+        permute (this->d_canonical, order);
+    }
+
+    // Renumber the Hexes and put hexen in the new order. list::sort leaves iterators (and so
+    // neighbour relations and bhexen) valid.
+    for (Hex& h : this->hexen) {
+        h.di = newidx[h.di];
+        h.vi = h.di;
+    }
+    this->hexen.sort ([](const Hex& a, const Hex& b) { return a.vi < b.vi; });
+    this->renumberVectorIndices();
+
+    if (!this->d_nbtab.empty()) {
+        this->populate_d_ghosts();
+    }
 }
 
 void
@@ -1317,6 +1477,32 @@ morph::HexGrid::populate_d_neighbours (void)
     }
 }
 
+void
+morph::HexGrid::populate_d_ghosts (void)
+{
+    MORPH_PHASE ("hexgrid_ghosts", 0);
+    unsigned int n = this->d_x.size();
+    this->d_nbtab.resize (6 * n);
+    this->d_ghostsrc.clear();
+    const vector<int>* nbs[6] = { &this->d_ne, &this->d_nne, &this->d_nnw,
+                                  &this->d_nw, &this->d_nsw, &this->d_nse };
+    for (unsigned int hi = 0; hi < n; ++hi) {
+        int ghost = -1;
+        for (unsigned int j = 0; j < 6; ++j) {
+            int nb = (*nbs[j])[hi];
+            if (nb == -1) {
+                // One ghost slot per hex serves all of its missing neighbours
+                if (ghost == -1) {
+                    ghost = n + this->d_ghostsrc.size();
+                    this->d_ghostsrc.push_back (hi);
+                }
+                nb = ghost;
+            }
+            this->d_nbtab[6 * hi + j] = nb;
+        }
+    }
+}
+
 void
 morph::HexGrid::setDomain (void)
 {
@@ -1573,7 +1759,12 @@ morph::HexGrid::discardOutsideBoundary (void)
 list<Hex>::iterator
 morph::HexGrid::findHexNearest (const pair<float, float>& pos)
 {
-    list<Hex>::iterator nearest = this->hexen.end();
+    list<Hex>::iterator nearest = this->findHexAt (pos);
+    if (nearest != this->hexen.end()) {
+        return nearest;
+    }
+
+    // pos is off the grid; search all hexes.
     list<Hex>::iterator hi = this->hexen.begin();
     float dist = FLT_MAX;
     while (hi != this->hexen.end()) {
@@ -1592,9 +1783,93 @@ morph::HexGrid::findHexNearest (const pair<float, float>& pos)
     return nearest;
 }
 
+void
+morph::HexGrid::axialRound (float x, float y, int& ri_, int& gi_) const
+{
+    // Invert Hex::computeLocation() (with bi=0) to get fractional r and g
+    float fg = y / this->v;
+    float fr = (x - (this->d/2.0f) * fg) / this->d;
+    float fs = -fr - fg;
+
+    float rr = std::round (fr);
+    float rg = std::round (fg);
+    float rs = std::round (fs);
+
+    float dr = abs(rr - fr);
+    float dg = abs(rg - fg);
+    float ds = abs(rs - fs);
+
+    if (dr > dg && dr > ds) {
+        rr = -rg - rs;
+    } else if (dg > ds) {
+        rg = -rr - rs;
+    }
+    ri_ = (int)rr;
+    gi_ = (int)rg;
+}
+
+void
+morph::HexGrid::invalidateHexIndex (void)
+{
+    this->hexIndexValid = false;
+}
+
+void
+morph::HexGrid::buildHexIndex (void)
+{
+    this->hexIndex.clear();
+    this->hexIndexRiLen = 0;
+    this->hexIndexGiLen = 0;
+    if (this->hexen.empty()) {
+        this->hexIndexValid = true;
+        return;
+    }
+
+    int rimin = numeric_limits<int>::max();
+    int rimax = numeric_limits<int>::min();
+    int gimin = numeric_limits<int>::max();
+    int gimax = numeric_limits<int>::min();
+    for (const Hex& h : this->hexen) {
+        // Assumes bi is 0, as elsewhere in HexGrid
+        rimin = h.ri < rimin ? h.ri : rimin;
+        rimax = h.ri > rimax ? h.ri : rimax;
+        gimin = h.gi < gimin ? h.gi : gimin;
+        gimax = h.gi > gimax ? h.gi : gimax;
+    }
+    this->hexIndexRiMin = rimin;
+    this->hexIndexGiMin = gimin;
+    this->hexIndexRiLen = rimax - rimin + 1;
+    this->hexIndexGiLen = gimax - gimin + 1;
+
+    this->hexIndex.assign (this->hexIndexRiLen * this->hexIndexGiLen, this->hexen.end());
+    for (list<Hex>::iterator hi = this->hexen.begin(); hi != this->hexen.end(); ++hi) {
+        this->hexIndex[(hi->ri - rimin) * this->hexIndexGiLen + (hi->gi - gimin)] = hi;
+    }
+    this->hexIndexValid = true;
+}
+
+list<Hex>::iterator
+morph::HexGrid::findHexAt (const pair<float, float>& pos)
+{
+    if (!this->fhexen.empty()) { this->flatToList(); }
+    if (this->hexIndexValid == false) {
+        this->buildHexIndex();
+    }
+
+    int r = 0, g = 0;
+    this->axialRound (pos.first, pos.second, r, g);
+    r -= this->hexIndexRiMin;
+    g -= this->hexIndexGiMin;
+    if (r < 0 || g < 0 || r >= this->hexIndexRiLen || g >= this->hexIndexGiLen) {
+        return this->hexen.end();
+    }
+    return this->hexIndex[r * this->hexIndexGiLen + g];
+}
+
 void
 morph::HexGrid::renumberVectorIndices (void)
 {
+    this->invalidateHexIndex();
     unsigned int vi = 0;
     this->vhexen.clear();
     auto hi = this->hexen.begin();
@@ -1608,12 +1883,18 @@ morph::HexGrid::renumberVectorIndices (void)
 unsigned int
 morph::HexGrid::num (void) const
 {
+    if (!this->fhexen.empty()) {
+        return this->fhexen.size();
+    }
     return this->hexen.size();
 }
 
 unsigned int
 morph::HexGrid::lastVectorIndex (void) const
 {
+    if (!this->fhexen.empty()) {
+        return this->fhexen.size() - 1;
+    }
     return this->hexen.rbegin()->vi;
 }
 
@@ -1747,6 +2028,7 @@ morph::HexGrid::init (float d_, float x_span_, float z_)
 void
 morph::HexGrid::init (void)
 {
+    MORPH_PHASE ("hexgrid_init", 0);
     // Use span_x to determine how many rings out to traverse.
     float halfX = this->x_span/2.0f;
     DBG ("halfX:" << halfX);
@@ -1756,6 +2038,8 @@ morph::HexGrid::init (void)
 
     DBG ("Creating hexagonal hex grid with maxRing: " << maxRing);
 
+    this->invalidateHexIndex();
+
     // The "vector iterator" - this is an identity iterator that is added to each Hex in the grid.
     unsigned int vi = 0;
 
@@ -2229,3 +2513,290 @@ morph::HexGrid::init (void)
 
     DBG ("Finished creating " << this->hexen.size() << " hexes in " << maxRing << " rings.");
 }
+
+void
+morph::HexGrid::initFlat (void)
+{
+    MORPH_PHASE ("hexgrid_init", 0);
+    float halfX = this->x_span/2.0f;
+    int maxRing = abs(ceil(halfX/this->d));
+    DBG ("Creating flat hexagonal hex grid with maxRing: " << maxRing);
+
+    // Every hex in the hexagonal grid has |ri| <= maxRing, |gi| <= maxRing and |ri+gi| <=
+    // maxRing, so a dense, square lookup from (ri,gi) to fhexen index allows each neighbour to
+    // be found in constant time. It's kept, as fhexIndex, for findFlatHexNearPoint().
+    int side = 2 * maxRing + 1;
+    this->fhexIndexMaxRing = maxRing;
+    this->fhexIndex.assign (side * side, -1);
+
+    this->fhexen.clear();
+    this->fhexen.reserve (1 + 3 * maxRing * (maxRing + 1));
+
+    // Hex x,y are computed exactly as in Hex::computeLocation()
+    float hv = (this->d*morph::SQRT_OF_3_F)/2.0f;
+    auto addFlatHex = [&](int r, int g) {
+        FlatHex fh;
+        fh.ri = r;
+        fh.gi = g;
+        fh.x = this->d*r + (this->d/2.0f)*g;
+        fh.y = hv*g;
+        this->fhexIndex[(r + maxRing) * side + (g + maxRing)] = (int)this->fhexen.size();
+        this->fhexen.push_back (fh);
+    };
+
+    // Walk the rings in the same order as init(void), so that indices match the list path.
+    int ri = 0;
+    int gi = 0;
+    addFlatHex (ri, gi);
+    for (int ring = 1; ring <= maxRing; ++ring) {
+        --ri; ++gi;
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri++, gi); }       // r
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri++, gi--); }     // -b
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri, gi--); }       // -g
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri--, gi); }       // -r
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri--, gi++); }     // b
+        for (int i = 0; i < ring; ++i) { addFlatHex (ri, gi++); }       // g
+    }
+
+    // Neighbour offsets in (ri,gi) for E, NE, NW, W, SW and SE.
+    const int dr[6] = { 1, 0, -1, -1,  0,  1 };
+    const int dg[6] = { 0, 1,  1,  0, -1, -1 };
+    for (FlatHex& fh : this->fhexen) {
+        for (unsigned int j = 0; j < 6; ++j) {
+            int nr = fh.ri + dr[j];
+            int ng = fh.gi + dg[j];
+            if (abs(nr) > maxRing || abs(ng) > maxRing) { continue; }
+            int ni = this->fhexIndex[(nr + maxRing) * side + (ng + maxRing)];
+            if (ni >= 0) {
+                fh.nb[j] = ni;
+                fh.flags |= (0x1 << j); // HEX_HAS_NE to HEX_HAS_NSE
+            }
+        }
+    }
+
+    // There are no list iterators to the grid vertices in flat mode.
+    this->gridReduced = true;
+
+    DBG ("Finished creating " << this->fhexen.size() << " flat hexes in " << maxRing << " rings.");
+}
+
+void
+morph::HexGrid::setBoundaryFlat (const vector<BezCoord<float>>& bpoints)
+{
+    int nearbyBoundaryPoint = 0; // i.e the Hex at 0,0
+    for (const BezCoord<float>& bp : bpoints) {
+        nearbyBoundaryPoint = this->findFlatHexNearPoint (bp, nearbyBoundaryPoint);
+        this->fhexen[nearbyBoundaryPoint].flags |= (HEX_IS_BOUNDARY | HEX_INSIDE_BOUNDARY);
+    }
+
+    int centroidHex = this->findFlatHexNearest (this->boundaryCentroid);
+    this->markFlatHexesInside (centroidHex);
+
+    vector<int> newidx = this->discardFlatOutsideBoundary();
+    nearbyBoundaryPoint = newidx[nearbyBoundaryPoint];
+
+    this->populate_d_vectors_flat();
+
+    // Client code expects hexen and bhexen, so materialise them now. The contiguity check
+    // populates bhexen.
+    vector<list<Hex>::iterator> hexits = this->flatToList();
+    set<unsigned int> seen;
+    list<Hex>::iterator bhi = hexits[nearbyBoundaryPoint];
+    list<Hex>::iterator hi = bhi;
+    if (this->boundaryContiguous (bhi, hi, seen) == false) {
+        stringstream ee;
+        ee << "The constructed boundary is not a contiguous sequence of hexes.";
+        throw runtime_error (ee.str());
+    }
+}
+
+int
+morph::HexGrid::findFlatHexNearPoint (const BezCoord<float>& point, int startFrom) const
+{
+    // The hex containing the point, if it's on the grid, is the nearest.
+    if (!this->fhexIndex.empty()) {
+        int r = 0, g = 0;
+        this->axialRound (point.x(), point.y(), r, g);
+        int mr = this->fhexIndexMaxRing;
+        if (abs(r) <= mr && abs(g) <= mr) {
+            int fi = this->fhexIndex[(r + mr) * (2 * mr + 1) + (g + mr)];
+            if (fi >= 0) { return fi; }
+        }
+    }
+
+    int h = startFrom;
+    float dx = point.x() - this->fhexen[h].x;
+    float dy = point.y() - this->fhexen[h].y;
+    float dh = sqrt (dx*dx + dy*dy);
+
+    bool neighbourNearer = true;
+    while (neighbourNearer == true) {
+        neighbourNearer = false;
+        // Test neighbours in the same order as findHexNearPoint(), taking the first nearer one
+        for (unsigned int j = 0; j < 6; ++j) {
+            int n = this->fhexen[h].nb[j];
+            if (n < 0) { continue; }
+            dx = point.x() - this->fhexen[n].x;
+            dy = point.y() - this->fhexen[n].y;
+            float dn = sqrt (dx*dx + dy*dy);
+            if (dn < dh) {
+                dh = dn;
+                h = n;
+                neighbourNearer = true;
+                break;
+            }
+        }
+    }
+
+    return h;
+}
+
+int
+morph::HexGrid::findFlatHexNearest (const pair<float, float>& pos) const
+{
+    if (!this->fhexIndex.empty()) {
+        int r = 0, g = 0;
+        this->axialRound (pos.first, pos.second, r, g);
+        int mr = this->fhexIndexMaxRing;
+        if (abs(r) <= mr && abs(g) <= mr) {
+            int fi = this->fhexIndex[(r + mr) * (2 * mr + 1) + (g + mr)];
+            if (fi >= 0) { return fi; }
+        }
+    }
+
+    int nearest = -1;
+    float dist = FLT_MAX;
+    for (unsigned int i = 0; i < this->fhexen.size(); ++i) {
+        float dx = pos.first - this->fhexen[i].x;
+        float dy = pos.second - this->fhexen[i].y;
+        float dl = sqrt (dx*dx + dy*dy);
+        if (dl < dist) {
+            dist = dl;
+            nearest = (int)i;
+        }
+    }
+    return nearest;
+}
+
+void
+morph::HexGrid::markFlatHexesInside (int start)
+{
+    // A contiguous chain of boundary hexes encloses its interior for hex-neighbour
+    // connectivity, so a flood fill stopped by boundary hexes marks exactly the inside.
+    vector<int> stack;
+    if ((this->fhexen[start].flags & HEX_IS_BOUNDARY) == 0x0) {
+        this->fhexen[start].flags |= HEX_INSIDE_BOUNDARY;
+        stack.push_back (start);
+    }
+    while (!stack.empty()) {
+        int h = stack.back();
+        stack.pop_back();
+        for (int n : this->fhexen[h].nb) {
+            if (n < 0) { continue; }
+            unsigned int& nf = this->fhexen[n].flags;
+            if ((nf & (HEX_IS_BOUNDARY | HEX_INSIDE_BOUNDARY)) == 0x0) {
+                nf |= HEX_INSIDE_BOUNDARY;
+                stack.push_back (n);
+            }
+        }
+    }
+}
+
+vector<int>
+morph::HexGrid::discardFlatOutsideBoundary (void)
+{
+    vector<int> newidx (this->fhexen.size(), -1);
+    int ni = 0;
+    for (unsigned int i = 0; i < this->fhexen.size(); ++i) {
+        if (this->fhexen[i].flags & HEX_INSIDE_BOUNDARY) {
+            newidx[i] = ni++;
+        }
+    }
+
+    // Compact in place (ni <= i always), re-indexing neighbours as we go
+    ni = 0;
+    for (unsigned int i = 0; i < this->fhexen.size(); ++i) {
+        if (newidx[i] < 0) { continue; }
+        FlatHex fh = this->fhexen[i];
+        for (unsigned int j = 0; j < 6; ++j) {
+            if (fh.nb[j] >= 0) {
+                fh.nb[j] = newidx[fh.nb[j]];
+            }
+            if (fh.nb[j] < 0) {
+                fh.flags &= ~(0x1 << j);
+            }
+        }
+        this->fhexen[ni++] = fh;
+    }
+    this->fhexen.resize (ni);
+    // fhexIndex refers to the old indices
+    this->fhexIndex.clear();
+    DBG ("Number of hexes in this->fhexen is now: " << this->fhexen.size());
+
+    return newidx;
+}
+
+void
+morph::HexGrid::populate_d_vectors_flat (void)
+{
+    this->d_clear();
+    unsigned int n = this->fhexen.size();
+    this->d_x.resize (n);
+    this->d_y.resize (n);
+    this->d_ri.resize (n);
+    this->d_gi.resize (n);
+    this->d_bi.assign (n, 0);
+    this->d_flags.resize (n);
+    this->d_distToBoundary.assign (n, -1.0f);
+    this->d_ne.resize (n);
+    this->d_nne.resize (n);
+    this->d_nnw.resize (n);
+    this->d_nw.resize (n);
+    this->d_nsw.resize (n);
+    this->d_nse.resize (n);
+    for (unsigned int i = 0; i < n; ++i) {
+        const FlatHex& fh = this->fhexen[i];
+        this->d_x[i] = fh.x;
+        this->d_y[i] = fh.y;
+        this->d_ri[i] = fh.ri;
+        this->d_gi[i] = fh.gi;
+        this->d_flags[i] = fh.flags;
+        this->d_ne[i] = fh.nb[HEX_NEIGHBOUR_POS_E];
+        this->d_nne[i] = fh.nb[HEX_NEIGHBOUR_POS_NE];
+        this->d_nnw[i] = fh.nb[HEX_NEIGHBOUR_POS_NW];
+        this->d_nw[i] = fh.nb[HEX_NEIGHBOUR_POS_W];
+        this->d_nsw[i] = fh.nb[HEX_NEIGHBOUR_POS_SW];
+        this->d_nse[i] = fh.nb[HEX_NEIGHBOUR_POS_SE];
+    }
+}
+
+vector<list<Hex>::iterator>
+morph::HexGrid::flatToList (void)
+{
+    this->hexen.clear();
+    vector<list<Hex>::iterator> hexits (this->fhexen.size());
+    for (unsigned int i = 0; i < this->fhexen.size(); ++i) {
+        this->hexen.emplace_back (i, this->d, this->fhexen[i].ri, this->fhexen[i].gi);
+        hexits[i] = --this->hexen.end();
+        hexits[i]->di = i;
+    }
+    for (unsigned int i = 0; i < this->fhexen.size(); ++i) {
+        const FlatHex& fh = this->fhexen[i];
+        list<Hex>::iterator hi = hexits[i];
+        // Sets HEX_HAS_NE etc. along with the iterators
+        if (fh.nb[HEX_NEIGHBOUR_POS_E] >= 0) { hi->set_ne (hexits[fh.nb[HEX_NEIGHBOUR_POS_E]]); }
+        if (fh.nb[HEX_NEIGHBOUR_POS_NE] >= 0) { hi->set_nne (hexits[fh.nb[HEX_NEIGHBOUR_POS_NE]]); }
+        if (fh.nb[HEX_NEIGHBOUR_POS_NW] >= 0) { hi->set_nnw (hexits[fh.nb[HEX_NEIGHBOUR_POS_NW]]); }
+        if (fh.nb[HEX_NEIGHBOUR_POS_W] >= 0) { hi->set_nw (hexits[fh.nb[HEX_NEIGHBOUR_POS_W]]); }
+        if (fh.nb[HEX_NEIGHBOUR_POS_SW] >= 0) { hi->set_nsw (hexits[fh.nb[HEX_NEIGHBOUR_POS_SW]]); }
+        if (fh.nb[HEX_NEIGHBOUR_POS_SE] >= 0) { hi->set_nse (hexits[fh.nb[HEX_NEIGHBOUR_POS_SE]]); }
+        hi->setFlag (fh.flags);
+    }
+    this->renumberVectorIndices();
+
+    this->fhexen.clear();
+    this->fhexen.shrink_to_fit();
+    this->fhexIndex.clear();
+
+    return hexits;
+}
@@ -15,10 +15,12 @@
 #include <list>
 #include <string>
 #include <array>
+#include <vector>
 
 using std::set;
 using std::list;
 using std::array;
+using std::vector;
 using std::string;
 using morph::BezCurvePath;
 using morph::Hex;
@@ -35,6 +37,33 @@ namespace morph {
         Boundary // The shape of the arbitrary boundary set with HexGrid::setBoundary
     };
 
+    /*!
+     * How HexGrid holds its Hexes while the grid is being built. In List mode, the hexagonal
+     * grid is a list<Hex> with neighbour relations held as list iterators from the start. In
+     * Flat mode, the grid is built into a contiguous vector<FlatHex> with int neighbour indices,
+     * the boundary is applied on that vector and the d_ vectors are filled directly from it;
+     * HexGrid::hexen is only materialised once, at the end, for the benefit of client code.
+     */
+    enum class HexGridStorage {
+        List,
+        Flat
+    };
+
+    /*!
+     * A compact record of one hex used by HexGrid when it is built in HexGridStorage::Flat
+     * mode. The neighbour indices in nb index into the same vector and are ordered E, NE, NW,
+     * W, SW, SE (as HEX_NEIGHBOUR_POS_E to HEX_NEIGHBOUR_POS_SE). -1 means no neighbour.
+     */
+    struct FlatHex
+    {
+        int ri = 0;
+        int gi = 0;
+        float x = 0.0f;
+        float y = 0.0f;
+        unsigned int flags = 0x0;
+        array<int, 6> nb = {{-1, -1, -1, -1, -1, -1}};
+    };
+
     /*!
      * This class is used to build an hexagonal grid of hexagons. The
      * member hexagons are all arranged with a vertex pointing
@@ -100,6 +129,23 @@ namespace morph {
         alignas(8) vector<int> d_nse;
         //@}
 
+        /*!
+         * Packed neighbour table with ghost slots, for branch-free stencils. Populated only by
+         * populate_d_ghosts(). Holds 6 entries per hex, in the order E, NE, NW, W, SW, SE (as
+         * HEX_NEIGHBOUR_POS_E to HEX_NEIGHBOUR_POS_SE), so that d_nbtab[6*hi+HEX_NEIGHBOUR_POS_E]
+         * == d_ne[hi] where hi has a neighbour east. Where there is no neighbour, the entry is
+         * instead a ghost slot index, d_x.size() + g. Data vectors then need d_x.size() +
+         * d_ghostsrc.size() elements.
+         */
+        alignas(8) vector<int> d_nbtab;
+
+        /*!
+         * For ghost slot g (index d_x.size() + g), the index of the hex whose value the slot
+         * should take for a no-flux boundary. There is one ghost slot per hex that is missing
+         * any neighbours.
+         */
+        alignas(8) vector<int> d_ghostsrc;
+
         /*!
          * Flags, such as "on boundary", "inside boundary", "outside
          * boundary", "has neighbour east", etc.
@@ -152,10 +198,63 @@ namespace morph {
          */
         void populate_d_neighbours (void);
 
+        /*!
+         * Once d_ne and friends have been populated, populate d_nbtab and d_ghostsrc.
+         */
+        void populate_d_ghosts (void);
+
         /*!
          * Clear out all the d_ vectors
          */
         void d_clear (void);
+
+        /*!
+         * Renumber the hexes of the domain in the order in which a Hilbert curve through
+         * (ri,gi) space visits them, so that neighbouring hexes are mostly close together in
+         * the d_ vectors. All the d_ vectors, Hex::di and Hex::vi are permuted consistently
+         * and hexen is re-sorted to match. Only for HexDomainShape::Boundary and
+         * HexDomainShape::Hexagon, where the d_ vectors are not in raster order.
+         */
+        void reorderHilbert (void);
+
+        /*!
+         * After reorderHilbert(), d_canonical[i] is the index which the hex now at index i
+         * had before any reordering. Empty if the hexes have not been reordered.
+         */
+        vector<unsigned int> d_canonical;
+
+        /*!
+         * Copy data indexed in the current d_ order into @a out, in the order that the
+         * hexes had before reorderHilbert() was called. Use this to save fields in the
+         * canonical order.
+         */
+        template <typename T>
+        void toCanonical (const vector<T>& in, vector<T>& out) const {
+            if (this->d_canonical.empty()) {
+                out = in;
+                return;
+            }
+            out.resize (in.size());
+            for (unsigned int i = 0; i < in.size(); ++i) {
+                out[this->d_canonical[i]] = in[i];
+            }
+        }
+
+        /*!
+         * The inverse of toCanonical(); copy data in canonical order into the current d_
+         * order.
+         */
+        template <typename T>
+        void fromCanonical (const vector<T>& in, vector<T>& out) const {
+            if (this->d_canonical.empty()) {
+                out = in;
+                return;
+            }
+            out.resize (in.size());
+            for (unsigned int i = 0; i < in.size(); ++i) {
+                out[i] = in[this->d_canonical[i]];
+            }
+        }
         //@}
 
         /*!
@@ -164,6 +263,14 @@ namespace morph {
          */
         void save (const string& path);
 
+        /*!
+         * Write the file that save() writes, leaving this HexGrid unchanged (save() first
+         * builds hexen if the grid is held flat, and renumbers it afterwards). Other
+         * threads may read the grid while it is written, so the first RD_Base::checkpoint()
+         * has it written on the checkpoint writer's thread.
+         */
+        void write (const string& path) const;
+
         /*!
          * Populate this HexGrid from the HDF5 file at the location
          * @path.
@@ -186,9 +293,13 @@ namespace morph {
          * x_span_. Set z to @a z_ which may be useful as an
          * identifier if several HexGrids are being managed by client
          * code, but it not otherwise made use of.
+         *
+         * @a storage chooses whether the grid is built as a list<Hex> (the default) or in a
+         * flat, index-based vector<FlatHex> (see HexGridStorage).
          */
         HexGrid (float d_, float x_span_, float z_ = 0.0f,
-                 HexDomainShape shape = HexDomainShape::Parallelogram);
+                 HexDomainShape shape = HexDomainShape::Parallelogram,
+                 HexGridStorage storage = HexGridStorage::List);
 
         /*!
          * Initialise with the passed-in parameters; a hex to hex
@@ -341,11 +452,27 @@ namespace morph {
         //@}
 
         /*!
-         * Run through all the hexes and compute the distance to the
-         * nearest boundary hex.
+         * Compute the distance from each hex to the nearest boundary hex, setting
+         * Hex::distToBoundary and, if they are populated, d_distToBoundary. Hexes outside the
+         * boundary get -100.
+         *
+         * The boundary hexes are the sources of a wavefront which spreads over the hex
+         * neighbour graph in order of increasing distance. Each hex inherits the nearest
+         * boundary hex of whichever neighbour gives it the shortest Euclidean distance, so the
+         * cost is O(N log N) rather than the O(N^2) of computeDistanceToBoundaryBruteForce().
+         * Most hexes get the exact distance; the rest (deep inside the boundary, where the
+         * nearest boundary hex's region is not connected on the grid) are out by a fraction of
+         * d.
          */
         void computeDistanceToBoundary (void);
 
+        /*!
+         * Run through all the hexes and compute the distance to the nearest boundary hex by
+         * testing every boundary hex. O(N^2). Kept as a reference for
+         * computeDistanceToBoundary().
+         */
+        void computeDistanceToBoundaryBruteForce (void);
+
         /*!
          * Populate d_ vectors. simple version. (Finds extents, then
          * calls populate_d_vectors(const array<int, 6>&)
@@ -386,6 +513,19 @@ namespace morph {
          */
         void clearRegionBoundaryFlags (void);
 
+        /*!
+         * Find the Hex whose hexagon contains the Cartesian position @pos, in constant time,
+         * using a spatial index from (ri,gi) to Hex. Returns hexen.end() if there is no such
+         * Hex in the grid. The index is built on first use after hexen has changed; client code
+         * that adds or erases Hexes in hexen directly should call invalidateHexIndex().
+         */
+        list<Hex>::iterator findHexAt (const pair<float, float>& pos);
+
+        /*!
+         * Mark the spatial index used by findHexAt() as needing to be rebuilt.
+         */
+        void invalidateHexIndex (void);
+
         /*!
          * What shape domain to set? Set this to the non-default
          * BEFORE calling HexGrid::setBoundary (const BezCurvePath& p)
@@ -394,10 +534,23 @@ namespace morph {
         HexDomainShape domainShape = HexDomainShape::Parallelogram;
 
         /*!
-         * The list of hexes that make up this HexGrid.
+         * How the grid is held while it is built. Set by the constructor.
+         */
+        HexGridStorage storage = HexGridStorage::List;
+
+        /*!
+         * The list of hexes that make up this HexGrid. In HexGridStorage::Flat mode this is
+         * empty until the boundary has been applied (or until a list-only operation is
+         * requested).
          */
         list<Hex> hexen;
 
+        /*!
+         * The flat hex store used in HexGridStorage::Flat mode. It is emptied once hexen has
+         * been materialised from it.
+         */
+        vector<FlatHex> fhexen;
+
         /*!
          * Once boundary secured, fill this vector. Experimental - can
          * I do parallel loops with vectors of hexes? Ans: Not very
@@ -604,6 +757,109 @@ namespace morph {
          */
         void renumberVectorIndices (void);
 
+        /*!
+         * Compute the (ri,gi) of the lattice hex whose hexagon contains the point (x,y). Works
+         * in cube coordinates (ri, gi and -ri-gi), rounding each and then fixing up whichever
+         * changed the most, so that the three still sum to zero.
+         */
+        void axialRound (float x, float y, int& ri_, int& gi_) const;
+
+        /*!
+         * Distance along a Hilbert curve filling an n by n square (n a power of 2) of the
+         * point (x,y). Used by reorderHilbert().
+         */
+        static unsigned long long hilbertKey (unsigned int n, unsigned int x, unsigned int y);
+
+        /*!
+         * Permute v so that, afterwards, v[k] holds what was in v[order[k]].
+         */
+        template <typename T>
+        static void permute (vector<T>& v, const vector<unsigned int>& order) {
+            vector<T> tmp (v.size());
+            for (unsigned int k = 0; k < order.size(); ++k) {
+                tmp[k] = v[order[k]];
+            }
+            v.swap (tmp);
+        }
+
+        /*!
+         * Permute the neighbour index vector nb by order, then renumber the indices it holds
+         * with newidx (which maps old index to new index).
+         */
+        static void permuteNeighbours (vector<int>& nb, const vector<unsigned int>& order,
+                                       const vector<int>& newidx);
+
+        /*!
+         * (Re)build hexIndex from hexen.
+         */
+        void buildHexIndex (void);
+
+        /*!
+         * The spatial index used by findHexAt(). A dense table over the bounding box of (ri,gi)
+         * in hexen, holding hexen.end() where there is no Hex.
+         */
+        //@{
+        vector<list<Hex>::iterator> hexIndex;
+        int hexIndexRiMin = 0;
+        int hexIndexGiMin = 0;
+        int hexIndexRiLen = 0;
+        int hexIndexGiLen = 0;
+        bool hexIndexValid = false;
+        //@}
+
+        /*!
+         * In flat mode, a dense lookup from (ri,gi) to fhexen index, valid from initFlat()
+         * until hexes are discarded from fhexen. Covers the square |ri|,|gi| <= fhexIndexMaxRing.
+         */
+        //@{
+        vector<int> fhexIndex;
+        int fhexIndexMaxRing = 0;
+        //@}
+
+        /*!
+         * Flat mode equivalent of init(void). Populates fhexen in the same ring-by-ring order
+         * as init() so that vector indices match the list path.
+         */
+        void initFlat (void);
+
+        /*!
+         * Flat mode equivalent of setBoundary (vector<BezCoord<float>>&) for
+         * HexDomainShape::Boundary. Expects the boundary points to already be centred on 0,0.
+         */
+        void setBoundaryFlat (const vector<BezCoord<float>>& bpoints);
+
+        /*!
+         * Flat mode equivalents of findHexNearPoint() and findHexNearest(). Both return an
+         * index into fhexen.
+         */
+        //@{
+        int findFlatHexNearPoint (const BezCoord<float>& point, int startFrom) const;
+        int findFlatHexNearest (const pair<float, float>& pos) const;
+        //@}
+
+        /*!
+         * Flood fill HEX_INSIDE_BOUNDARY outwards from fhexen[start] until boundary hexes are
+         * reached.
+         */
+        void markFlatHexesInside (int start);
+
+        /*!
+         * Remove the hexes in fhexen that are not inside the boundary, re-indexing the
+         * neighbour relations. Returns the map from old to new indices (-1 for discarded hexes).
+         */
+        vector<int> discardFlatOutsideBoundary (void);
+
+        /*!
+         * Fill the d_ vectors directly from fhexen (for HexDomainShape::Boundary).
+         */
+        void populate_d_vectors_flat (void);
+
+        /*!
+         * Build hexen (and vhexen) from fhexen, then empty fhexen. Returns iterators into
+         * hexen, indexed by the old fhexen index.
+         */
+        vector<list<Hex>::iterator> flatToList (void);
+
         /*!
          * The centre to centre hex distance between adjacent members
          * of the hex grid.
@@ -0,0 +1,260 @@
+/*!
+ * Implementation of HexKernels
+ */
+
+#include "HexKernels.h"
+
+// The AVX2 kernels are compiled with per-function target attributes, so the library itself
+// doesn't need to be built with -mavx2. They're only called if the CPU reports AVX2.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# define MORPH_AVX2_KERNELS 1
+# include <immintrin.h>
+#endif
+
+using morph::HexGrid;
+using morph::HexKernels;
+using morph::KernelPath;
+
+#ifdef MORPH_AVX2_KERNELS
+namespace {
+
+    /*
+     * In each of these, the neighbour index vectors are read 4 (double) or 8 (float) at a
+     * time and the neighbour values gathered, with the lanes that have no neighbour (index -1)
+     * masked off so that they keep the value of the central hex. The arithmetic is done in
+     * the same order as the scalar code. The hexes left over at the end go to the scalar
+     * templates.
+     */
+
+    __attribute__((target("avx2")))
+    void laplace_avx2 (const HexGrid& hg, const double* F, double* lapF, unsigned int n, double norm)
+    {
+        const int* nb[6] = { hg.d_ne.data(), hg.d_nne.data(), hg.d_nnw.data(),
+                             hg.d_nw.data(), hg.d_nsw.data(), hg.d_nse.data() };
+        const __m256d vnorm = _mm256_set1_pd (norm);
+        const __m256d vminus6 = _mm256_set1_pd (-6.0);
+        const __m128i vminus1 = _mm_set1_epi32 (-1);
+        int nv = (int)(n - n % 4);
+
+#pragma omp parallel for schedule(static)
+        for (int hi = 0; hi < nv; hi += 4) {
+            __m256d fc = _mm256_loadu_pd (F + hi);
+            __m256d sum = _mm256_mul_pd (vminus6, fc);
+            for (unsigned int j = 0; j < 6; ++j) {
+                __m128i idx = _mm_loadu_si128 ((const __m128i*)(nb[j] + hi));
+                __m128i have = _mm_xor_si128 (_mm_cmpeq_epi32 (idx, vminus1), vminus1);
+                __m256d mask = _mm256_castsi256_pd (_mm256_cvtepi32_epi64 (have));
+                sum = _mm256_add_pd (sum, _mm256_mask_i32gather_pd (fc, F, idx, mask, 8));
+            }
+            _mm256_storeu_pd (lapF + hi, _mm256_mul_pd (vnorm, sum));
+        }
+        HexKernels::laplace_scalar<double> (hg, F, lapF, n, norm, nv);
+    }
+
+    __attribute__((target("avx2")))
+    void laplace_avx2 (const HexGrid& hg, const float* F, float* lapF, unsigned int n, float norm)
+    {
+        const int* nb[6] = { hg.d_ne.data(), hg.d_nne.data(), hg.d_nnw.data(),
+                             hg.d_nw.data(), hg.d_nsw.data(), hg.d_nse.data() };
+        const __m256 vnorm = _mm256_set1_ps (norm);
+        const __m256 vminus6 = _mm256_set1_ps (-6.0f);
+        const __m256i vminus1 = _mm256_set1_epi32 (-1);
+        int nv = (int)(n - n % 8);
+
+#pragma omp parallel for schedule(static)
+        for (int hi = 0; hi < nv; hi += 8) {
+            __m256 fc = _mm256_loadu_ps (F + hi);
+            __m256 sum = _mm256_mul_ps (vminus6, fc);
+            for (unsigned int j = 0; j < 6; ++j) {
+                __m256i idx = _mm256_loadu_si256 ((const __m256i*)(nb[j] + hi));
+                __m256i have = _mm256_xor_si256 (_mm256_cmpeq_epi32 (idx, vminus1), vminus1);
+                sum = _mm256_add_ps (sum, _mm256_mask_i32gather_ps (fc, F, idx, _mm256_castsi256_ps (have), 4));
+            }
+            _mm256_storeu_ps (lapF + hi, _mm256_mul_ps (vnorm, sum));
+        }
+        HexKernels::laplace_scalar<float> (hg, F, lapF, n, norm, nv);
+    }
+
+    __attribute__((target("avx2")))
+    void spacegrad2D_avx2 (const HexGrid& hg, const double* f, double* gx, double* gy, unsigned int n,
+                           double oneoverd, double oneover2d, double oneoverv, double oneover2v,
+                           double oneover4v)
+    {
+        const int* nb[6] = { hg.d_ne.data(), hg.d_nne.data(), hg.d_nnw.data(),
+                             hg.d_nw.data(), hg.d_nsw.data(), hg.d_nse.data() };
+        const __m128i vminus1 = _mm_set1_epi32 (-1);
+        const __m256d vhalf = _mm256_set1_pd (0.5);
+        const __m256d vd = _mm256_set1_pd (oneoverd);
+        const __m256d v2d = _mm256_set1_pd (oneover2d);
+        const __m256d vv = _mm256_set1_pd (oneoverv);
+        const __m256d v2v = _mm256_set1_pd (oneover2v);
+        const __m256d v4v = _mm256_set1_pd (oneover4v);
+        int nv = (int)(n - n % 4);
+
+#pragma omp parallel for schedule(static)
+        for (int hi = 0; hi < nv; hi += 4) {
+            __m256d fc = _mm256_loadu_pd (f + hi);
+            // Neighbour values and presence masks in the order E, NE, NW, W, SW, SE
+            __m256d fn[6];
+            __m256d h[6];
+            for (unsigned int j = 0; j < 6; ++j) {
+                __m128i idx = _mm_loadu_si128 ((const __m128i*)(nb[j] + hi));
+                __m128i have = _mm_xor_si128 (_mm_cmpeq_epi32 (idx, vminus1), vminus1);
+                h[j] = _mm256_castsi256_pd (_mm256_cvtepi32_epi64 (have));
+                fn[j] = _mm256_mask_i32gather_pd (fc, f, idx, h[j], 8);
+            }
+
+            // x gradient. A missing E or W neighbour has the central value, giving the
+            // one-sided difference (or zero if both are missing).
+            __m256d xfac = _mm256_blendv_pd (vd, v2d, _mm256_and_pd (h[0], h[3]));
+            _mm256_storeu_pd (gx + hi, _mm256_mul_pd (_mm256_sub_pd (fn[0], fn[3]), xfac));
+
+            // y gradient. Compute every case, then blend in order of increasing precedence.
+            __m256d c1 = _mm256_mul_pd (_mm256_add_pd (_mm256_sub_pd (fn[1], fn[5]),
+                                                       _mm256_sub_pd (fn[2], fn[4])), v4v);
+            __m256d c2 = _mm256_mul_pd (_mm256_sub_pd (_mm256_mul_pd (_mm256_add_pd (fn[1], fn[2]), vhalf), fc), vv);
+            __m256d c3 = _mm256_mul_pd (_mm256_sub_pd (fc, _mm256_mul_pd (_mm256_add_pd (fn[5], fn[4]), vhalf)), vv);
+            __m256d c4 = _mm256_mul_pd (_mm256_sub_pd (fn[2], fn[4]), v2v);
+            __m256d c5 = _mm256_mul_pd (_mm256_sub_pd (fn[1], fn[5]), v2v);
+            __m256d y = _mm256_setzero_pd();
+            y = _mm256_blendv_pd (y, c5, _mm256_and_pd (h[1], h[5]));
+            y = _mm256_blendv_pd (y, c4, _mm256_and_pd (h[2], h[4]));
+            y = _mm256_blendv_pd (y, c3, _mm256_and_pd (h[4], h[5]));
+            y = _mm256_blendv_pd (y, c2, _mm256_and_pd (h[1], h[2]));
+            y = _mm256_blendv_pd (y, c1, _mm256_and_pd (_mm256_and_pd (h[1], h[2]), _mm256_and_pd (h[4], h[5])));
+            _mm256_storeu_pd (gy + hi, y);
+        }
+        HexKernels::spacegrad2D_scalar<double> (hg, f, gx, gy, n, oneoverd, oneover2d,
+                                                oneoverv, oneover2v, oneover4v, nv);
+    }
+
+    __attribute__((target("avx2")))
+    void spacegrad2D_avx2 (const HexGrid& hg, const float* f, float* gx, float* gy, unsigned int n,
+                           float oneoverd, float oneover2d, float oneoverv, float oneover2v,
+                           float oneover4v)
+    {
+        const int* nb[6] = { hg.d_ne.data(), hg.d_nne.data(), hg.d_nnw.data(),
+                             hg.d_nw.data(), hg.d_nsw.data(), hg.d_nse.data() };
+        const __m256i vminus1 = _mm256_set1_epi32 (-1);
+        const __m256 vhalf = _mm256_set1_ps (0.5f);
+        const __m256 vd = _mm256_set1_ps (oneoverd);
+        const __m256 v2d = _mm256_set1_ps (oneover2d);
+        const __m256 vv = _mm256_set1_ps (oneoverv);
+        const __m256 v2v = _mm256_set1_ps (oneover2v);
+        const __m256 v4v = _mm256_set1_ps (oneover4v);
+        int nv = (int)(n - n % 8);
+
+#pragma omp parallel for schedule(static)
+        for (int hi = 0; hi < nv; hi += 8) {
+            __m256 fc = _mm256_loadu_ps (f + hi);
+            __m256 fn[6];
+            __m256 h[6];
+            for (unsigned int j = 0; j < 6; ++j) {
+                __m256i idx = _mm256_loadu_si256 ((const __m256i*)(nb[j] + hi));
+                h[j] = _mm256_castsi256_ps (_mm256_xor_si256 (_mm256_cmpeq_epi32 (idx, vminus1), vminus1));
+                fn[j] = _mm256_mask_i32gather_ps (fc, f, idx, h[j], 4);
+            }
+
+            __m256 xfac = _mm256_blendv_ps (vd, v2d, _mm256_and_ps (h[0], h[3]));
+            _mm256_storeu_ps (gx + hi, _mm256_mul_ps (_mm256_sub_ps (fn[0], fn[3]), xfac));
+
+            __m256 c1 = _mm256_mul_ps (_mm256_add_ps (_mm256_sub_ps (fn[1], fn[5]),
+                                                      _mm256_sub_ps (fn[2], fn[4])), v4v);
+            __m256 c2 = _mm256_mul_ps (_mm256_sub_ps (_mm256_mul_ps (_mm256_add_ps (fn[1], fn[2]), vhalf), fc), vv);
+            __m256 c3 = _mm256_mul_ps (_mm256_sub_ps (fc, _mm256_mul_ps (_mm256_add_ps (fn[5], fn[4]), vhalf)), vv);
+            __m256 c4 = _mm256_mul_ps (_mm256_sub_ps (fn[2], fn[4]), v2v);
+            __m256 c5 = _mm256_mul_ps (_mm256_sub_ps (fn[1], fn[5]), v2v);
+            __m256 y = _mm256_setzero_ps();
+            y = _mm256_blendv_ps (y, c5, _mm256_and_ps (h[1], h[5]));
+            y = _mm256_blendv_ps (y, c4, _mm256_and_ps (h[2], h[4]));
+            y = _mm256_blendv_ps (y, c3, _mm256_and_ps (h[4], h[5]));
+            y = _mm256_blendv_ps (y, c2, _mm256_and_ps (h[1], h[2]));
+            y = _mm256_blendv_ps (y, c1, _mm256_and_ps (_mm256_and_ps (h[1], h[2]), _mm256_and_ps (h[4], h[5])));
+            _mm256_storeu_ps (gy + hi, y);
+        }
+        HexKernels::spacegrad2D_scalar<float> (hg, f, gx, gy, n, oneoverd, oneover2d,
+                                               oneoverv, oneover2v, oneover4v, nv);
+    }
+
+} // anonymous namespace
+#endif // MORPH_AVX2_KERNELS
+
+bool
+morph::HexKernels::haveAVX2 (void)
+{
+#ifdef MORPH_AVX2_KERNELS
+    static const bool have = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports ("avx2") ? true : false;
+    }();
+    return have;
+#else
+    return false;
+#endif
+}
+
+KernelPath
+morph::HexKernels::bestPath (void)
+{
+    return HexKernels::haveAVX2() ? KernelPath::AVX2 : KernelPath::Scalar;
+}
+
+void
+morph::HexKernels::laplace (const HexGrid& hg, const float* F, float* lapF,
+                            unsigned int n, float norm, KernelPath p)
+{
+    if (p == KernelPath::Auto) { p = KernelPath::Scalar; }
+#ifdef MORPH_AVX2_KERNELS
+    if (p == KernelPath::AVX2 && HexKernels::haveAVX2()) {
+        laplace_avx2 (hg, F, lapF, n, norm);
+        return;
+    }
+#endif
+    HexKernels::laplace_scalar<float> (hg, F, lapF, n, norm);
+}
+
+void
+morph::HexKernels::laplace (const HexGrid& hg, const double* F, double* lapF,
+                            unsigned int n, double norm, KernelPath p)
+{
+    if (p == KernelPath::Auto) { p = KernelPath::Scalar; }
+#ifdef MORPH_AVX2_KERNELS
+    if (p == KernelPath::AVX2 && HexKernels::haveAVX2()) {
+        laplace_avx2 (hg, F, lapF, n, norm);
+        return;
+    }
+#endif
+    HexKernels::laplace_scalar<double> (hg, F, lapF, n, norm);
+}
+
+void
+morph::HexKernels::spacegrad2D (const HexGrid& hg, const float* f, float* gx, float* gy, unsigned int n,
+                                float oneoverd, float oneover2d, float oneoverv, float oneover2v,
+                                float oneover4v, KernelPath p)
+{
+    if (p == KernelPath::Auto) { p = KernelPath::Scalar; }
+#ifdef MORPH_AVX2_KERNELS
+    if (p == KernelPath::AVX2 && HexKernels::haveAVX2()) {
+        spacegrad2D_avx2 (hg, f, gx, gy, n, oneoverd, oneover2d, oneoverv, oneover2v, oneover4v);
+        return;
+    }
+#endif
+    HexKernels::spacegrad2D_scalar<float> (hg, f, gx, gy, n, oneoverd, oneover2d,
+                                           oneoverv, oneover2v, oneover4v);
+}
+
+void
+morph::HexKernels::spacegrad2D (const HexGrid& hg, const double* f, double* gx, double* gy, unsigned int n,
+                                double oneoverd, double oneover2d, double oneoverv, double oneover2v,
+                                double oneover4v, KernelPath p)
+{
+    if (p == KernelPath::Auto) { p = KernelPath::Scalar; }
+#ifdef MORPH_AVX2_KERNELS
+    if (p == KernelPath::AVX2 && HexKernels::haveAVX2()) {
+        spacegrad2D_avx2 (hg, f, gx, gy, n, oneoverd, oneover2d, oneoverv, oneover2v, oneover4v);
+        return;
+    }
+#endif
+    HexKernels::spacegrad2D_scalar<double> (hg, f, gx, gy, n, oneoverd, oneover2d,
+                                            oneoverv, oneover2v, oneover4v);
+}
@@ -0,0 +1,174 @@
+/*
+ * Stencil kernels over the d_ neighbour vectors of a HexGrid, with explicitly vectorised
+ * versions selected at runtime according to CPU features.
+ */
+
+#ifndef _HEXKERNELS_H_
+#define _HEXKERNELS_H_
+
+#include "HexGrid.h"
+
+namespace morph {
+
+    /*!
+     * Which implementation of a kernel to run. Auto picks the one that measures fastest,
+     * which is currently Scalar for every kernel.
+     */
+    enum class KernelPath {
+        Auto,
+        Scalar,
+        AVX2
+    };
+
+    /*!
+     * The Laplacian and 2D gradient stencils used by RD_Base, for a field of n values
+     * (indexed as the HexGrid's d_ vectors). The float and double overloads run the scalar
+     * templates unless asked for KernelPath::AVX2, when they dispatch to an AVX2
+     * implementation, which gathers neighbour values through d_ne and friends, if the CPU
+     * has AVX2. Auto means Scalar because the AVX2 versions measured slower than the scalar
+     * ones for some grid sizes (testhexkernels reports both); the gathers cost more than
+     * the scalar branches save. The AVX2 Laplacian is bitwise identical to the scalar one.
+     * The AVX2 float gradient works wholly in float, where the scalar code computes two of
+     * its one-sided cases in double, so may differ by an ULP or so on hexes which lack a
+     * neighbour.
+     */
+    class HexKernels
+    {
+    public:
+        /*!
+         * True if the CPU supports the AVX2 kernels. Tested once, then cached.
+         */
+        static bool haveAVX2 (void);
+
+        /*!
+         * The widest path that the CPU supports: AVX2 if it has it, otherwise Scalar. Auto
+         * doesn't resolve to this (see above).
+         */
+        static KernelPath bestPath (void);
+
+        /*!
+         * lapF = norm * (sum of six neighbours - 6 F). A missing neighbour takes the value
+         * of the central hex (a no-flux boundary).
+         */
+        //@{
+        static void laplace (const HexGrid& hg, const float* F, float* lapF,
+                             unsigned int n, float norm, KernelPath p = KernelPath::Auto);
+        static void laplace (const HexGrid& hg, const double* F, double* lapF,
+                             unsigned int n, double norm, KernelPath p = KernelPath::Auto);
+
+        /*!
+         * The scalar Laplacian, for hexes start to n-1.
+         */
+        template <typename Flt>
+        static void laplace_scalar (const HexGrid& hg, const Flt* F, Flt* lapF,
+                                    unsigned int n, Flt norm, unsigned int start = 0) {
+            const int* ne = hg.d_ne.data();
+            const int* nne = hg.d_nne.data();
+            const int* nnw = hg.d_nnw.data();
+            const int* nw = hg.d_nw.data();
+            const int* nsw = hg.d_nsw.data();
+            const int* nse = hg.d_nse.data();
+#pragma omp parallel for schedule(static)
+            for (unsigned int hi=start; hi<n; ++hi) {
+                Flt thesum = -6 * F[hi];
+                thesum += ne[hi] == -1 ? F[hi] : F[ne[hi]];
+                thesum += nne[hi] == -1 ? F[hi] : F[nne[hi]];
+                thesum += nnw[hi] == -1 ? F[hi] : F[nnw[hi]];
+                thesum += nw[hi] == -1 ? F[hi] : F[nw[hi]];
+                thesum += nsw[hi] == -1 ? F[hi] : F[nsw[hi]];
+                thesum += nse[hi] == -1 ? F[hi] : F[nse[hi]];
+                lapF[hi] = norm * thesum;
+            }
+        }
+        //@}
+
+        /*!
+         * The scalar Laplacian for the count hexes listed in idx only (as for the narrow
+         * band of HexActiveSet). The other elements of lapF are untouched.
+         */
+        template <typename Flt>
+        static void laplace_indexed (const HexGrid& hg, const Flt* F, Flt* lapF,
+                                     const unsigned int* idx, unsigned int count, Flt norm) {
+            const int* ne = hg.d_ne.data();
+            const int* nne = hg.d_nne.data();
+            const int* nnw = hg.d_nnw.data();
+            const int* nw = hg.d_nw.data();
+            const int* nsw = hg.d_nsw.data();
+            const int* nse = hg.d_nse.data();
+            int m = count;
+#pragma omp parallel for schedule(static)
+            for (int j = 0; j < m; ++j) {
+                unsigned int hi = idx[j];
+                Flt thesum = -6 * F[hi];
+                thesum += ne[hi] == -1 ? F[hi] : F[ne[hi]];
+                thesum += nne[hi] == -1 ? F[hi] : F[nne[hi]];
+                thesum += nnw[hi] == -1 ? F[hi] : F[nnw[hi]];
+                thesum += nw[hi] == -1 ? F[hi] : F[nw[hi]];
+                thesum += nsw[hi] == -1 ? F[hi] : F[nsw[hi]];
+                thesum += nse[hi] == -1 ? F[hi] : F[nse[hi]];
+                lapF[hi] = norm * thesum;
+            }
+        }
+
+        /*!
+         * The x (gx) and y (gy) gradient of f, using whichever neighbours are available.
+         */
+        //@{
+        static void spacegrad2D (const HexGrid& hg, const float* f, float* gx, float* gy, unsigned int n,
+                                 float oneoverd, float oneover2d, float oneoverv, float oneover2v,
+                                 float oneover4v, KernelPath p = KernelPath::Auto);
+        static void spacegrad2D (const HexGrid& hg, const double* f, double* gx, double* gy, unsigned int n,
+                                 double oneoverd, double oneover2d, double oneoverv, double oneover2v,
+                                 double oneover4v, KernelPath p = KernelPath::Auto);
+
+        /*!
+         * The scalar gradient, for hexes start to n-1. f, gx and gy are pointers, or any
+         * other type indexed with [] (such as a FieldView).
+         */
+        template <typename Flt, typename In = const Flt*, typename Out = Flt*>
+        static void spacegrad2D_scalar (const HexGrid& hg, In f, Out gx, Out gy, unsigned int n,
+                                        Flt oneoverd, Flt oneover2d, Flt oneoverv, Flt oneover2v,
+                                        Flt oneover4v, unsigned int start = 0) {
+            const int* ne = hg.d_ne.data();
+            const int* nne = hg.d_nne.data();
+            const int* nnw = hg.d_nnw.data();
+            const int* nw = hg.d_nw.data();
+            const int* nsw = hg.d_nsw.data();
+            const int* nse = hg.d_nse.data();
+            // Note - East is positive x; North is positive y.
+#pragma omp parallel for schedule(static)
+            for (unsigned int hi=start; hi<n; ++hi) {
+                // Find x gradient
+                if (ne[hi] != -1 && nw[hi] != -1) {
+                    gx[hi] = (f[ne[hi]] - f[nw[hi]]) * oneover2d;
+                } else if (ne[hi] != -1) {
+                    gx[hi] = (f[ne[hi]] - f[hi]) * oneoverd;
+                } else if (nw[hi] != -1) {
+                    gx[hi] = (f[hi] - f[nw[hi]]) * oneoverd;
+                } else {
+                    gx[hi] = 0.0;
+                }
+
+                // Find y gradient
+                if (nnw[hi] != -1 && nne[hi] != -1 && nsw[hi] != -1 && nse[hi] != -1) {
+                    // Full complement. Compute the mean of the nse->nne and nsw->nnw gradients
+                    gy[hi] = ( (f[nne[hi]] - f[nse[hi]]) + (f[nnw[hi]] - f[nsw[hi]]) ) * oneover4v;
+                } else if (nnw[hi] != -1 && nne[hi] != -1) {
+                    gy[hi] = ( (f[nne[hi]] + f[nnw[hi]]) * 0.5 - f[hi]) * oneoverv;
+                } else if (nsw[hi] != -1 && nse[hi] != -1) {
+                    gy[hi] = (f[hi] - (f[nse[hi]] + f[nsw[hi]]) * 0.5) * oneoverv;
+                } else if (nnw[hi] != -1 && nsw[hi] != -1) {
+                    gy[hi] = (f[nnw[hi]] - f[nsw[hi]]) * oneover2v;
+                } else if (nne[hi] != -1 && nse[hi] != -1) {
+                    gy[hi] = (f[nne[hi]] - f[nse[hi]]) * oneover2v;
+                } else {
+                    gy[hi] = 0.0;
+                }
+            }
+        }
+        //@}
+    };
+
+} // namespace morph
+
+#endif // _HEXKERNELS_H_
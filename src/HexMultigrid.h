@@ -0,0 +1,452 @@
+/*
+ * A geometric multigrid solver for (alpha - beta Laplacian) u = f on a HexGrid.
+ */
+
+#ifndef _HEXMULTIGRID_H_
+#define _HEXMULTIGRID_H_
+
+#include "HexGrid.h"
+#include <vector>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+using std::vector;
+using std::array;
+using std::runtime_error;
+
+namespace morph {
+
+    /*!
+     * Solves the Helmholtz equation (alpha - beta L) u = f, where L is the hex Laplacian of
+     * RD_Base::compute_laplace with its no-flux boundary, alpha > 0 and beta >= 0. A
+     * quasi-steady chemoattractant with diffusion D, decay k and source s, for example, is
+     * the solution of (k - D L) u = s.
+     *
+     * The constructor builds a hierarchy of coarser hex lattices, each with twice the hex to
+     * hex distance of the one before, down to a few tens of hexes. Level 0 is the HexGrid.
+     * The hexes of each coarser level are the even (ri,gi) points of the level above, so
+     * every hex of a level either coincides with a hex of the next coarser level or lies at
+     * the midpoint between two of them. Prolongation P is linear interpolation along those
+     * lattice edges, restriction is its transpose and each coarse operator is the Galerkin
+     * product P^T A P of the one above. On the hex lattice that product is again a seven
+     * point stencil, and it carries the no-flux boundary down to the coarse levels
+     * consistently, which rediscretising on the (coarser) coarse boundary would not.
+     *
+     * solve() runs V-cycles until the residual has fallen by tol. Each level is smoothed
+     * with Gauss-Seidel in three colours (the hex lattice is three-colourable, so each
+     * colour can be updated in parallel) and the coarsest level is solved directly. The
+     * work per cycle, and the number of cycles needed, are independent of the grid size.
+     */
+    template <class Flt>
+    class HexMultigrid
+    {
+    public:
+        /*!
+         * Relative residual reduction at which solve() stops.
+         */
+        Flt tol = (sizeof(Flt) < sizeof(double) ? 1e-5 : 1e-8);
+
+        /*!
+         * Limit on the V-cycles in one solve().
+         */
+        unsigned int maxCycles = 100;
+
+        /*!
+         * Gauss-Seidel sweeps before and after the coarse grid correction.
+         */
+        //@{
+        unsigned int preSweeps = 2;
+        unsigned int postSweeps = 2;
+        //@}
+
+        /*!
+         * The relative residual after each V-cycle of the last solve(). Its size is the
+         * number of cycles taken.
+         */
+        vector<double> residuals;
+
+        /*!
+         * Set up the hierarchy for the hexes of hg (in their d_ vector order). Stops
+         * coarsening when a level has coarsest hexes or fewer.
+         */
+        HexMultigrid (const HexGrid& hg, Flt alpha_, Flt beta_, unsigned int coarsest = 64) {
+            if (alpha_ <= 0 || beta_ < 0) {
+                throw runtime_error ("HexMultigrid: need alpha > 0 and beta >= 0");
+            }
+            unsigned int n0 = hg.num();
+            this->levels.resize (1);
+            Level& l0 = this->levels[0];
+            l0.n = n0;
+            l0.d = hg.getd();
+            l0.ri = hg.d_ri;
+            l0.gi = hg.d_gi;
+            l0.nb.resize (6*n0);
+            l0.w.assign (6*n0, 0.0);
+            l0.diag.assign (n0, alpha_);
+            const vector<int>* nbs[6] = { &hg.d_ne, &hg.d_nne, &hg.d_nnw,
+                                          &hg.d_nw, &hg.d_nsw, &hg.d_nse };
+            Flt bnorm = beta_ * (Flt)2 / ((Flt)3 * l0.d * l0.d);
+            for (unsigned int i = 0; i < n0; ++i) {
+                for (unsigned int j = 0; j < 6; ++j) {
+                    l0.nb[6*i+j] = (*nbs[j])[i];
+                    if (l0.nb[6*i+j] >= 0) {
+                        l0.w[6*i+j] = -bnorm;
+                        l0.diag[i] += bnorm;
+                    }
+                }
+            }
+            this->finishLevel (l0);
+
+            while (this->levels.back().n > coarsest) {
+                unsigned int before = this->levels.back().n;
+                this->coarsen();
+                if (this->levels.back().n >= before) {
+                    // No further reduction is possible
+                    this->levels.pop_back();
+                    break;
+                }
+            }
+            this->factoriseCoarsest();
+        }
+
+        //! The number of levels, including the finest
+        unsigned int numLevels (void) const { return this->levels.size(); }
+
+        //! The number of hexes on level l
+        unsigned int levelSize (unsigned int l) const { return this->levels[l].n; }
+
+        /*!
+         * Solve for u, starting from the value in u. f and u have the number of hexes in
+         * the HexGrid. Returns the number of V-cycles; throws if tol isn't reached in
+         * maxCycles.
+         */
+        unsigned int solve (const Flt* f, Flt* u) {
+            Level& l0 = this->levels[0];
+            std::copy (f, f + l0.n, l0.f.begin());
+            std::copy (u, u + l0.n, l0.u.begin());
+            this->residuals.clear();
+
+            double fnorm = std::sqrt (this->dot (l0.f, l0.f));
+            if (fnorm == 0.0) {
+                std::fill (u, u + l0.n, 0.0);
+                return 0;
+            }
+            this->residual (l0);
+            double res = std::sqrt (this->dot (l0.r, l0.r)) / fnorm;
+            unsigned int cycles = 0;
+            while (res > this->tol && cycles < this->maxCycles) {
+                this->vcycle (0);
+                this->residual (l0);
+                res = std::sqrt (this->dot (l0.r, l0.r)) / fnorm;
+                this->residuals.push_back (res);
+                ++cycles;
+            }
+            std::copy (l0.u.begin(), l0.u.end(), u);
+            if (res > this->tol) {
+                throw runtime_error ("HexMultigrid::solve: no convergence within maxCycles V-cycles");
+            }
+            return cycles;
+        }
+
+    private:
+        //! The offsets to the six neighbours in (ri,gi), in the order of HexGrid::d_ne etc.
+        static const array<array<int, 2>, 6>& offsets (void) {
+            static const array<array<int, 2>, 6> o = {{ {{1,0}}, {{0,1}}, {{-1,1}},
+                                                        {{-1,0}}, {{0,-1}}, {{1,-1}} }};
+            return o;
+        }
+
+        /*!
+         * One level of the hierarchy
+         */
+        struct Level {
+            //! Number of hexes
+            unsigned int n = 0;
+            //! Hex to hex distance
+            Flt d = 1.0;
+            //! Lattice coordinates of each hex
+            vector<int> ri;
+            vector<int> gi;
+            //! Six neighbour indices per hex (or -1)
+            vector<int> nb;
+            //! The operator: its diagonal, and its coefficient for each neighbour
+            vector<Flt> diag;
+            vector<Flt> w;
+            //! The hexes, ordered by colour, and where each colour starts in that order
+            vector<int> byColour;
+            array<unsigned int, 4> colourStart;
+            //! The two coarse hexes that each hex interpolates from (the same one twice if it
+            //! coincides with a coarse hex)
+            vector<int> par0;
+            vector<int> par1;
+            //! Solution, right hand side and residual
+            vector<Flt> u;
+            vector<Flt> f;
+            vector<Flt> r;
+        };
+
+        /*!
+         * Compute the colouring, and allocate the vectors, for a level whose n, ri and gi
+         * are set.
+         */
+        void finishLevel (Level& l) {
+            vector<int> colour (l.n, 0);
+            array<unsigned int, 3> count = {{ 0, 0, 0 }};
+            for (unsigned int i = 0; i < l.n; ++i) {
+                // No two neighbours share a value of (ri + 2gi) mod 3
+                colour[i] = ((l.ri[i] + 2 * l.gi[i]) % 3 + 3) % 3;
+                ++count[colour[i]];
+            }
+            l.colourStart[0] = 0;
+            for (unsigned int c = 0; c < 3; ++c) {
+                l.colourStart[c+1] = l.colourStart[c] + count[c];
+            }
+            l.byColour.resize (l.n);
+            array<unsigned int, 3> pos = {{ l.colourStart[0], l.colourStart[1], l.colourStart[2] }};
+            for (unsigned int i = 0; i < l.n; ++i) {
+                l.byColour[pos[colour[i]]++] = i;
+            }
+            l.u.assign (l.n, 0.0);
+            l.f.assign (l.n, 0.0);
+            l.r.assign (l.n, 0.0);
+        }
+
+        /*!
+         * Add a level, coarsened from the current coarsest level.
+         */
+        void coarsen (void) {
+            this->levels.push_back (Level());
+            Level& fine = this->levels[this->levels.size()-2];
+            Level& crs = this->levels.back();
+
+            // Each fine hex's parents, in coarse (ri,gi) coordinates
+            vector<array<int, 4> > pp (fine.n);
+            int rmin = 0, rmax = 0, gmin = 0, gmax = 0;
+            for (unsigned int i = 0; i < fine.n; ++i) {
+                int r = fine.ri[i];
+                int g = fine.gi[i];
+                bool rodd = (r & 1) != 0;
+                bool godd = (g & 1) != 0;
+                array<int, 4>& p = pp[i];
+                if (!rodd && !godd) {
+                    p = {{ r>>1, g>>1, r>>1, g>>1 }};
+                } else if (rodd && !godd) {
+                    p = {{ (r-1)>>1, g>>1, (r+1)>>1, g>>1 }};
+                } else if (!rodd && godd) {
+                    p = {{ r>>1, (g-1)>>1, r>>1, (g+1)>>1 }};
+                } else {
+                    p = {{ (r-1)>>1, (g+1)>>1, (r+1)>>1, (g-1)>>1 }};
+                }
+                if (i == 0) {
+                    rmin = rmax = p[0];
+                    gmin = gmax = p[1];
+                }
+                for (unsigned int k = 0; k < 4; k += 2) {
+                    rmin = std::min (rmin, p[k]); rmax = std::max (rmax, p[k]);
+                    gmin = std::min (gmin, p[k+1]); gmax = std::max (gmax, p[k+1]);
+                }
+            }
+
+            // The coarse hexes are the parents, numbered through a dense table over their
+            // bounding box (with a margin of one for the neighbour lookups)
+            int rlen = rmax - rmin + 3;
+            int glen = gmax - gmin + 3;
+            vector<int> table (rlen * glen, -1);
+            auto cell = [&](int R, int G) -> int& { return table[(R - rmin + 1) * glen + (G - gmin + 1)]; };
+            fine.par0.resize (fine.n);
+            fine.par1.resize (fine.n);
+            for (unsigned int i = 0; i < fine.n; ++i) {
+                for (unsigned int k = 0; k < 4; k += 2) {
+                    int& c = cell (pp[i][k], pp[i][k+1]);
+                    if (c < 0) {
+                        c = crs.n++;
+                        crs.ri.push_back (pp[i][k]);
+                        crs.gi.push_back (pp[i][k+1]);
+                    }
+                }
+                fine.par0[i] = cell (pp[i][0], pp[i][1]);
+                fine.par1[i] = cell (pp[i][2], pp[i][3]);
+            }
+
+            crs.d = fine.d * 2;
+            crs.nb.assign (6*crs.n, -1);
+            const array<array<int, 2>, 6>& o = HexMultigrid<Flt>::offsets();
+            for (unsigned int c = 0; c < crs.n; ++c) {
+                for (unsigned int j = 0; j < 6; ++j) {
+                    crs.nb[6*c+j] = cell (crs.ri[c] + o[j][0], crs.gi[c] + o[j][1]);
+                }
+            }
+
+            // The Galerkin operator. A fine hex interpolates half from each of its two
+            // parents (which may be the same coarse hex), so each fine entry A(i,k)
+            // contributes a quarter to each of the four coarse entries between the parents of
+            // i and the parents of k.
+            crs.diag.assign (crs.n, 0.0);
+            crs.w.assign (6*crs.n, 0.0);
+            auto addEntry = [&](int a, int b, Flt v) {
+                if (a == b) {
+                    crs.diag[a] += v;
+                    return;
+                }
+                for (unsigned int j = 0; j < 6; ++j) {
+                    if (crs.nb[6*a+j] == b) {
+                        crs.w[6*a+j] += v;
+                        return;
+                    }
+                }
+                throw runtime_error ("HexMultigrid: coarse operator is not a hex stencil");
+            };
+            for (unsigned int i = 0; i < fine.n; ++i) {
+                int pi[2] = { fine.par0[i], fine.par1[i] };
+                for (unsigned int j = 0; j < 7; ++j) {
+                    int k = (j == 6 ? (int)i : fine.nb[6*i+j]);
+                    if (k < 0) { continue; }
+                    Flt v = (j == 6 ? fine.diag[i] : fine.w[6*i+j]) * (Flt)0.25;
+                    int pk[2] = { fine.par0[k], fine.par1[k] };
+                    for (unsigned int a = 0; a < 2; ++a) {
+                        for (unsigned int b = 0; b < 2; ++b) {
+                            addEntry (pi[a], pk[b], v);
+                        }
+                    }
+                }
+            }
+
+            this->finishLevel (crs);
+        }
+
+        /*!
+         * Cholesky factorise the (dense) operator of the coarsest level.
+         */
+        void factoriseCoarsest (void) {
+            Level& l = this->levels.back();
+            unsigned int n = l.n;
+            this->chol.assign (n*n, 0.0);
+            vector<double>& a = this->chol;
+            for (unsigned int i = 0; i < n; ++i) {
+                a[i*n+i] = l.diag[i];
+                for (unsigned int j = 0; j < 6; ++j) {
+                    int k = l.nb[6*i+j];
+                    if (k >= 0) { a[i*n+k] = l.w[6*i+j]; }
+                }
+            }
+            for (unsigned int j = 0; j < n; ++j) {
+                double s = a[j*n+j];
+                for (unsigned int k = 0; k < j; ++k) { s -= a[j*n+k] * a[j*n+k]; }
+                if (s <= 0.0) {
+                    throw runtime_error ("HexMultigrid: coarsest operator is not positive definite");
+                }
+                a[j*n+j] = std::sqrt (s);
+                for (unsigned int i = j+1; i < n; ++i) {
+                    double t = a[i*n+j];
+                    for (unsigned int k = 0; k < j; ++k) { t -= a[i*n+k] * a[j*n+k]; }
+                    a[i*n+j] = t / a[j*n+j];
+                }
+            }
+        }
+
+        //! Solve the coarsest level exactly
+        void solveCoarsest (void) {
+            Level& l = this->levels.back();
+            unsigned int n = l.n;
+            const vector<double>& a = this->chol;
+            vector<double> y (n);
+            for (unsigned int i = 0; i < n; ++i) {
+                double s = l.f[i];
+                for (unsigned int k = 0; k < i; ++k) { s -= a[i*n+k] * y[k]; }
+                y[i] = s / a[i*n+i];
+            }
+            for (unsigned int i = n; i-- > 0; ) {
+                double s = y[i];
+                for (unsigned int k = i+1; k < n; ++k) { s -= a[k*n+i] * y[k]; }
+                y[i] = s / a[i*n+i];
+                l.u[i] = y[i];
+            }
+        }
+
+        //! Gauss-Seidel sweeps, colour by colour
+        void smooth (Level& l, unsigned int sweeps) {
+            for (unsigned int s = 0; s < sweeps; ++s) {
+                for (unsigned int c = 0; c < 3; ++c) {
+                    int c0 = l.colourStart[c];
+                    int c1 = l.colourStart[c+1];
+#pragma omp parallel for schedule(static)
+                    for (int ci = c0; ci < c1; ++ci) {
+                        int i = l.byColour[ci];
+                        const int* nb = l.nb.data() + 6*i;
+                        const Flt* w = l.w.data() + 6*i;
+                        Flt sum = 0.0;
+                        for (unsigned int j = 0; j < 6; ++j) {
+                            if (nb[j] >= 0) { sum += w[j] * l.u[nb[j]]; }
+                        }
+                        l.u[i] = (l.f[i] - sum) / l.diag[i];
+                    }
+                }
+            }
+        }
+
+        //! r = f - A u
+        void residual (Level& l) {
+            int n = l.n;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; ++i) {
+                const int* nb = l.nb.data() + 6*i;
+                const Flt* w = l.w.data() + 6*i;
+                Flt sum = l.diag[i] * l.u[i];
+                for (unsigned int j = 0; j < 6; ++j) {
+                    if (nb[j] >= 0) { sum += w[j] * l.u[nb[j]]; }
+                }
+                l.r[i] = l.f[i] - sum;
+            }
+        }
+
+        void vcycle (unsigned int li) {
+            if (li == this->levels.size() - 1) {
+                this->solveCoarsest();
+                return;
+            }
+            Level& fine = this->levels[li];
+            Level& crs = this->levels[li+1];
+
+            this->smooth (fine, this->preSweeps);
+            this->residual (fine);
+
+            // Restrict the residual to be the coarse right hand side
+            std::fill (crs.f.begin(), crs.f.end(), 0.0);
+            for (unsigned int i = 0; i < fine.n; ++i) {
+                Flt h = fine.r[i] * (Flt)0.5;
+                crs.f[fine.par0[i]] += h;
+                crs.f[fine.par1[i]] += h;
+            }
+            std::fill (crs.u.begin(), crs.u.end(), 0.0);
+
+            this->vcycle (li+1);
+
+            // Interpolate the correction back
+            int n = fine.n;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; ++i) {
+                fine.u[i] += (crs.u[fine.par0[i]] + crs.u[fine.par1[i]]) * (Flt)0.5;
+            }
+
+            this->smooth (fine, this->postSweeps);
+        }
+
+        double dot (const vector<Flt>& a, const vector<Flt>& b) const {
+            int n = a.size();
+            double s = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:s)
+            for (int i = 0; i < n; ++i) {
+                s += (double)a[i] * b[i];
+            }
+            return s;
+        }
+
+        vector<Level> levels;
+        //! Cholesky factor of the coarsest operator, dense, lower triangle by rows
+        vector<double> chol;
+    };
+
+} // namespace morph
+
+#endif // _HEXMULTIGRID_H_
@@ -0,0 +1,190 @@
+/*
+ * Per-phase timers and counters, compiled in only when MORPH_INSTRUMENT is defined.
+ */
+
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+
+namespace morph {
+
+    /*!
+     * The totals for one named phase of the computation: the number of times it was run,
+     * the time spent in it and an estimate of the bytes of memory it read and wrote. These
+     * are atomic so that models stepped on several threads (as by RD_Ensemble) can add to
+     * the same phase.
+     */
+    struct PhaseStats
+    {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> nanoseconds;
+        std::atomic<uint64_t> bytes;
+        PhaseStats (void) : calls(0), nanoseconds(0), bytes(0) {}
+    };
+
+    /*!
+     * The process-wide table of phases, by name. Code is instrumented with the macros
+     * below rather than by calling this directly, so that it costs nothing when
+     * MORPH_INSTRUMENT is not defined:
+     *
+     *\code
+     void step (void) {
+         MORPH_PHASE ("reaction", 4 * this->nhex * sizeof(Flt));
+         ...
+     }
+     \endcode
+     *
+     * Each MORPH_PHASE site looks up its phase once; after that, a timed scope costs two
+     * clock reads and three atomic adds. Phases may nest, in which case the outer phase's
+     * time includes the inner's.
+     */
+    class Instrument
+    {
+    public:
+        //! The one table
+        static Instrument& get (void) {
+            static Instrument inst;
+            return inst;
+        }
+
+        //! The stats for the phase called name, created if necessary
+        PhaseStats* phase (const std::string& name) {
+            std::lock_guard<std::mutex> lock (this->m);
+            PhaseStats*& p = this->phases[name];
+            if (p == nullptr) {
+                p = new PhaseStats();
+            }
+            return p;
+        }
+
+        //! Zero every phase's totals (the phases themselves are kept)
+        void reset (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            for (auto& p : this->phases) {
+                p.second->calls = 0;
+                p.second->nanoseconds = 0;
+                p.second->bytes = 0;
+            }
+        }
+
+        //! The names of the phases, in alphabetical order
+        std::vector<std::string> names (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            std::vector<std::string> n;
+            for (auto& p : this->phases) {
+                n.push_back (p.first);
+            }
+            return n;
+        }
+
+        /*!
+         * Write a table of the phases with their calls, total and mean time and the
+         * memory rate implied by the byte estimates.
+         */
+        void report (std::ostream& os) {
+            std::lock_guard<std::mutex> lock (this->m);
+            os << std::left << std::setw(24) << "phase" << std::right
+               << std::setw(12) << "calls" << std::setw(14) << "total s"
+               << std::setw(14) << "mean us" << std::setw(12) << "GB/s" << "\n";
+            for (auto& p : this->phases) {
+                uint64_t c = p.second->calls;
+                double s = p.second->nanoseconds * 1e-9;
+                double b = (double)p.second->bytes;
+                os << std::left << std::setw(24) << p.first << std::right
+                   << std::setw(12) << c << std::setw(14) << s
+                   << std::setw(14) << (c > 0 ? s * 1e6 / c : 0.0)
+                   << std::setw(12) << (s > 0.0 ? b * 1e-9 / s : 0.0) << "\n";
+            }
+            os.flush();
+        }
+
+        /*!
+         * Write each phase's totals to dat as /instrument/<name>/calls, /seconds and /bytes.
+         * Dat is any class with HdfData's add_val.
+         */
+        template <typename Dat>
+        void save (Dat& dat) {
+            std::lock_guard<std::mutex> lock (this->m);
+            for (auto& p : this->phases) {
+                std::string g = "/instrument/" + p.first;
+                unsigned long long int c = p.second->calls;
+                unsigned long long int b = p.second->bytes;
+                double s = p.second->nanoseconds * 1e-9;
+                dat.add_val ((g + "/calls").c_str(), c);
+                dat.add_val ((g + "/seconds").c_str(), s);
+                dat.add_val ((g + "/bytes").c_str(), b);
+            }
+        }
+
+    private:
+        Instrument (void) {}
+        ~Instrument (void) {
+            for (auto& p : this->phases) {
+                delete p.second;
+            }
+        }
+        Instrument (const Instrument&) = delete;
+        Instrument& operator= (const Instrument&) = delete;
+
+        std::mutex m;
+        std::map<std::string, PhaseStats*> phases;
+    };
+
+    /*!
+     * Adds the time from its construction to its destruction, one call and nbytes to a
+     * phase.
+     */
+    class PhaseTimer
+    {
+    public:
+        PhaseTimer (PhaseStats* p_, uint64_t nbytes)
+            : p(p_), t0(std::chrono::steady_clock::now()) {
+            this->p->calls.fetch_add (1, std::memory_order_relaxed);
+            this->p->bytes.fetch_add (nbytes, std::memory_order_relaxed);
+        }
+        ~PhaseTimer (void) {
+            auto dt = std::chrono::steady_clock::now() - this->t0;
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+            this->p->nanoseconds.fetch_add (ns, std::memory_order_relaxed);
+        }
+    private:
+        PhaseStats* p;
+        std::chrono::steady_clock::time_point t0;
+    };
+
+} // namespace morph
+
+#define MORPH_PHASE_CAT2(a, b) a##b
+#define MORPH_PHASE_CAT(a, b) MORPH_PHASE_CAT2(a, b)
+
+/*!
+ * MORPH_PHASE(name, nbytes) times the rest of the enclosing scope as the phase name and
+ * counts one call and nbytes. MORPH_COUNT(name, nbytes) counts one call and nbytes without
+ * timing. Both compile to nothing unless MORPH_INSTRUMENT is defined.
+ */
+#ifdef MORPH_INSTRUMENT
+# define MORPH_PHASE(name, nbytes)                                         \
+    static morph::PhaseStats* MORPH_PHASE_CAT(morph_phase_, __LINE__) =    \
+        morph::Instrument::get().phase (name);                             \
+    morph::PhaseTimer MORPH_PHASE_CAT(morph_timer_, __LINE__) (            \
+        MORPH_PHASE_CAT(morph_phase_, __LINE__), (nbytes))
+# define MORPH_COUNT(name, nbytes) {                                       \
+        static morph::PhaseStats* morph_count_ = morph::Instrument::get().phase (name); \
+        morph_count_->calls.fetch_add (1, std::memory_order_relaxed);      \
+        morph_count_->bytes.fetch_add ((nbytes), std::memory_order_relaxed); \
+    }
+#else
+# define MORPH_PHASE(name, nbytes)
+# define MORPH_COUNT(name, nbytes)
+#endif
+
+#endif // _INSTRUMENT_H_
@@ -0,0 +1,141 @@
+/*
+ * A counter-based random number generator, for noise that is reproducible however the
+ * work is divided between threads.
+ */
+
+#ifndef _PHILOX_H_
+#define _PHILOX_H_
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+
+namespace morph {
+
+    /*!
+     * The Philox4x32-10 generator of Salmon et al. (2011), "Parallel random numbers: as
+     * easy as 1, 2, 3". There is no state to advance: block() maps a 128 bit counter and a
+     * 64 bit key to 128 random bits. Here the key is the seed and the counter is (hex
+     * index, step, stream), so the value for each hex is a function of those alone. That
+     * makes the bulk fills below independent of the order in which the hexes are visited,
+     * and so bit-for-bit the same for any number of OpenMP threads. Use a different
+     * stream for each field (or each use) within one step.
+     *
+     * The fills have no branches and no loop-carried state, so the compiler vectorises
+     * the rounds within each thread's share of the hexes.
+     */
+    class Philox
+    {
+    public:
+        typedef std::array<uint32_t, 4> Counter;
+        typedef std::array<uint32_t, 2> Key;
+
+        Philox (void) {}
+
+        explicit Philox (uint64_t seed_) : seed(seed_) {}
+
+        /*!
+         * The seed, which is the key of every block.
+         */
+        uint64_t seed = 0;
+
+        /*!
+         * The ten rounds of Philox4x32 on the counter ctr with the key k.
+         */
+        static Counter block (Counter ctr, Key k) {
+            for (unsigned int r = 0; r < 10; ++r) {
+                if (r > 0) {
+                    k[0] += 0x9E3779B9;
+                    k[1] += 0xBB67AE85;
+                }
+                uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0];
+                uint64_t p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+                Counter c = {{ (uint32_t)(p1 >> 32) ^ ctr[1] ^ k[0], (uint32_t)p1,
+                               (uint32_t)(p0 >> 32) ^ ctr[3] ^ k[1], (uint32_t)p0 }};
+                ctr = c;
+            }
+            return ctr;
+        }
+
+        /*!
+         * The 128 random bits for element i at step, in stream.
+         */
+        Counter bits (uint32_t i, uint64_t step, uint32_t stream = 0) const {
+            Counter ctr = {{ i, (uint32_t)step, (uint32_t)(step >> 32), stream }};
+            Key k = {{ (uint32_t)this->seed, (uint32_t)(this->seed >> 32) }};
+            return Philox::block (ctr, k);
+        }
+
+        /*!
+         * A uniform value in [0,1) for element i at step, in stream. A float has 24 random
+         * bits, a double 53.
+         */
+        template <typename Flt>
+        Flt uniform (uint32_t i, uint64_t step, uint32_t stream = 0) const {
+            return Philox::toUniform<Flt> (this->bits (i, step, stream));
+        }
+
+        /*!
+         * A normally distributed value, mean 0 and standard deviation 1, for element i at
+         * step, in stream (by the Box-Muller transform).
+         */
+        template <typename Flt>
+        Flt normal (uint32_t i, uint64_t step, uint32_t stream = 0) const {
+            return Philox::toNormal<Flt> (this->bits (i, step, stream));
+        }
+
+        /*!
+         * Fill out[0] to out[n-1] with uniform values in [0,1); out[i] is uniform<Flt>(i,
+         * step, stream).
+         */
+        template <typename Flt>
+        void fillUniform (Flt* out, unsigned int n, uint64_t step, uint32_t stream = 0) const {
+            int nn = n;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < nn; ++i) {
+                out[i] = Philox::toUniform<Flt> (this->bits (i, step, stream));
+            }
+        }
+
+        /*!
+         * Fill out[0] to out[n-1] with normal values of mean 0 and standard deviation 1;
+         * out[i] is normal<Flt>(i, step, stream).
+         */
+        template <typename Flt>
+        void fillNormal (Flt* out, unsigned int n, uint64_t step, uint32_t stream = 0) const {
+            int nn = n;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < nn; ++i) {
+                out[i] = Philox::toNormal<Flt> (this->bits (i, step, stream));
+            }
+        }
+
+    private:
+        //! The top 24 (float) or 53 (double) of the bits, as a value in [0,1)
+        //@{
+        template <typename Flt>
+        static Flt toUniform (const Counter& b) {
+            return (sizeof(Flt) < sizeof(double))
+                ? (Flt)((b[0] >> 8) * (1.0f / 16777216.0f))
+                : (Flt)(((((uint64_t)b[0]) << 32 | b[1]) >> 11) * (1.0 / 9007199254740992.0));
+        }
+        template <typename Flt>
+        static Flt toUniform2 (const Counter& b) {
+            return (sizeof(Flt) < sizeof(double))
+                ? (Flt)((b[2] >> 8) * (1.0f / 16777216.0f))
+                : (Flt)(((((uint64_t)b[2]) << 32 | b[3]) >> 11) * (1.0 / 9007199254740992.0));
+        }
+        //@}
+
+        //! Box-Muller, with the first uniform moved to (0,1] so that the log is finite
+        template <typename Flt>
+        static Flt toNormal (const Counter& b) {
+            Flt u1 = (Flt)1 - Philox::toUniform<Flt> (b);
+            Flt u2 = Philox::toUniform2<Flt> (b);
+            return std::sqrt ((Flt)-2 * std::log (u1)) * std::cos ((Flt)6.283185307179586 * u2);
+        }
+    };
+
+} // namespace morph
+
+#endif // _PHILOX_H_
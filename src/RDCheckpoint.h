@@ -0,0 +1,237 @@
+/*
+ * Double buffered snapshots of an RD model's state, written to HDF5 on a background thread.
+ */
+
+#ifndef _RDCHECKPOINT_H_
+#define _RDCHECKPOINT_H_
+
+#include "FieldArena.h"
+#include "HexGrid.h"
+#include "HdfData.h"
+#include "Instrument.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+
+using std::vector;
+using std::string;
+using std::runtime_error;
+
+namespace morph {
+
+    /*!
+     * One snapshot of a model: the values of its registered fields (and FieldArenas), by
+     * name, and the scalars needed to carry on stepping from them.
+     */
+    template <class Flt>
+    struct RDCheckpointState
+    {
+        vector<string> fieldNames;
+        vector<vector<Flt> > fields;
+        vector<string> arenaNames;
+        vector<morph::FieldArena<Flt> > arenas;
+        //! The file holding the model's HexGrid, relative to the checkpoint file
+        string gridfile;
+        /*!
+         * If non-null, the writer first writes this HexGrid to gridpath, with
+         * HexGrid::write. It must not be changed until the checkpoint has been written.
+         */
+        const morph::HexGrid* grid = nullptr;
+        string gridpath;
+        Flt dt = 0;
+        unsigned int stepCount = 0;
+        double simTime = 0.0;
+        double nextSaveTime = 0.0;
+        //! The Philox seed; the noise is a function of it and the step count
+        unsigned long long int rngSeed = 0;
+
+        //! Write to dat. Fields go in /fields/<name>, arenas in /arenas/<name>.
+        void save (HdfData& dat) const {
+            dat.add_string ("/gridfile", this->gridfile);
+            dat.add_val ("/dt", this->dt);
+            dat.add_val ("/stepCount", this->stepCount);
+            dat.add_val ("/t", this->simTime);
+            dat.add_val ("/nextSaveTime", this->nextSaveTime);
+            dat.add_val ("/rng_seed", this->rngSeed);
+            for (unsigned int i = 0; i < this->fields.size(); ++i) {
+                dat.add_contained_vals (("/fields/" + this->fieldNames[i]).c_str(), this->fields[i]);
+            }
+            for (unsigned int i = 0; i < this->arenas.size(); ++i) {
+                const morph::FieldArena<Flt>& fa = this->arenas[i];
+                string path = "/arenas/" + this->arenaNames[i];
+                if (fa.layout() == morph::FieldLayout::SoA) {
+                    dat.add_ptrarray_vals (path.c_str(), fa.data(), fa.size(), fa.fieldSize(), fa.fieldStride());
+                } else {
+                    dat.add_ptrarray_vals (path.c_str(), fa.data(), fa.fieldSize(), fa.size(), fa.size());
+                }
+            }
+        }
+    };
+
+    /*!
+     * Writes RDCheckpointStates to HDF5 files on a background thread, so that a model can
+     * carry on stepping while its state is written. There are two buffers: acquire() gives
+     * the one that isn't being written (waiting, if both are busy, for the older write to
+     * start), the caller copies the model's state into it and submit() queues it to be
+     * written. So a checkpoint costs the stepping thread one copy of the state, unless
+     * checkpoints are requested faster than they can be written.
+     *
+     * Each file (and the grid file, if the state has a grid) is written to path + ".tmp"
+     * and then renamed to path, so that a crash part way through a write leaves the
+     * previous checkpoint intact. An exception thrown by a
+     * write is rethrown by the next acquire() or wait().
+     */
+    template <class Flt>
+    class RDCheckpoint
+    {
+    public:
+        RDCheckpoint (void) {}
+        RDCheckpoint (const RDCheckpoint&) = delete;
+        RDCheckpoint& operator= (const RDCheckpoint&) = delete;
+
+        //! Finishes any pending writes, then stops the thread
+        ~RDCheckpoint (void) {
+            {
+                std::unique_lock<std::mutex> lock (this->m);
+                this->cv.wait (lock, [this]{ return this->queued < 0 && this->writing < 0; });
+                this->stopping = true;
+            }
+            this->cv.notify_all();
+            if (this->writer.joinable()) {
+                this->writer.join();
+            }
+        }
+
+        /*!
+         * The buffer to fill with the next snapshot. Must be followed by submit() before
+         * acquire() is called again.
+         */
+        RDCheckpointState<Flt>& acquire (void) {
+            std::unique_lock<std::mutex> lock (this->m);
+            this->cv.wait (lock, [this]{ return this->queued < 0; });
+            this->rethrow();
+            this->filling = this->writing == 0 ? 1 : 0;
+            return this->buf[this->filling];
+        }
+
+        //! Queue the buffer given by the last acquire() to be written to path
+        void submit (const string& path) {
+            {
+                std::lock_guard<std::mutex> lock (this->m);
+                if (this->filling < 0) {
+                    throw runtime_error ("RDCheckpoint::submit: no buffer was acquired");
+                }
+                this->paths[this->filling] = path;
+                this->queued = this->filling;
+                this->filling = -1;
+                if (!this->writer.joinable()) {
+                    this->writer = std::thread (&RDCheckpoint<Flt>::run, this);
+                }
+            }
+            this->cv.notify_all();
+        }
+
+        //! Wait until every submitted checkpoint has been written
+        void wait (void) {
+            std::unique_lock<std::mutex> lock (this->m);
+            this->cv.wait (lock, [this]{ return this->queued < 0 && this->writing < 0; });
+            this->rethrow();
+        }
+
+        //! True while a checkpoint is queued or being written
+        bool busy (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            return this->queued >= 0 || this->writing >= 0;
+        }
+
+        //! The number of checkpoints written
+        unsigned int written (void) {
+            std::lock_guard<std::mutex> lock (this->m);
+            return this->nwritten;
+        }
+
+    private:
+        //! The writer thread
+        void run (void) {
+            std::unique_lock<std::mutex> lock (this->m);
+            for (;;) {
+                this->cv.wait (lock, [this]{ return this->queued >= 0 || this->stopping; });
+                if (this->queued < 0) {
+                    return;
+                }
+                this->writing = this->queued;
+                this->queued = -1;
+                lock.unlock();
+                this->cv.notify_all();
+
+                try {
+                    this->write (this->buf[this->writing], this->paths[this->writing]);
+                } catch (...) {
+                    std::lock_guard<std::mutex> elock (this->m);
+                    this->error = std::current_exception();
+                }
+
+                lock.lock();
+                if (!this->error) {
+                    ++this->nwritten;
+                }
+                this->writing = -1;
+                this->cv.notify_all();
+            }
+        }
+
+        void write (const RDCheckpointState<Flt>& state, const string& path) {
+            MORPH_PHASE ("checkpoint_write", 0);
+            if (state.grid != nullptr) {
+                state.grid->write (state.gridpath + ".tmp");
+                RDCheckpoint<Flt>::replace (state.gridpath + ".tmp", state.gridpath);
+            }
+            string tmppath = path + ".tmp";
+            {
+                HdfData dat (tmppath);
+                state.save (dat);
+            }
+            RDCheckpoint<Flt>::replace (tmppath, path);
+        }
+
+        //! Rename tmppath to path, replacing any file already there
+        static void replace (const string& tmppath, const string& path) {
+            if (std::rename (tmppath.c_str(), path.c_str()) != 0) {
+                throw runtime_error ("RDCheckpoint: failed to rename " + tmppath + " to " + path);
+            }
+        }
+
+        //! Rethrow (once) an exception from the writer. Call with m held.
+        void rethrow (void) {
+            if (this->error) {
+                std::exception_ptr e = this->error;
+                this->error = nullptr;
+                std::rethrow_exception (e);
+            }
+        }
+
+        RDCheckpointState<Flt> buf[2];
+        string paths[2];
+        //! The buffers acquired, waiting to be written and being written (-1 for none)
+        //@{
+        int filling = -1;
+        int queued = -1;
+        int writing = -1;
+        //@}
+        unsigned int nwritten = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+        std::thread writer;
+        std::mutex m;
+        std::condition_variable cv;
+    };
+
+} // namespace morph
+
+#endif // _RDCHECKPOINT_H_
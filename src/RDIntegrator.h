@@ -0,0 +1,503 @@
+#ifndef _RDINTEGRATOR_H_
+#define _RDINTEGRATOR_H_
+
+#include <vector>
+using std::vector;
+#include <array>
+using std::array;
+#include <cmath>
+#include <algorithm>
+#include <limits>
+using std::numeric_limits;
+#include <stdexcept>
+using std::runtime_error;
+
+/*!
+ * Explicit time integration for reaction-diffusion systems, used by RD_Base.
+ */
+
+namespace morph {
+
+    /*!
+     * The explicit scheme used by RDIntegrator::step.
+     */
+    enum class RDScheme {
+        Euler,  // First order, one evaluation of the right hand side per step
+        RK2,    // The midpoint method, two evaluations
+        RK4,    // Classical fourth order Runge-Kutta, four evaluations
+        BS23    // Bogacki-Shampine 3(2), adaptive; see RDIntegrator::stepAdaptive
+    };
+
+    /*!
+     * Advances a set of fields (a vector of N fields, each a vector of Flts) by one time
+     * step of an explicit scheme.
+     *
+     * The right hand side is a functor called as rhs (y, dydt), which must write the time
+     * derivative of every element of every field of y into dydt (which has the same shape
+     * as y). y is passed non-const so that rhs can fill ghost slots (RD_Base::fill_ghosts)
+     * before computing its stencils; it should change nothing else in y.
+     *
+     * The stage buffers are allocated on the first step and reused thereafter (they're
+     * reallocated only if the shape of the fields changes). RK4 holds k1 to k4 and the
+     * input to the next stage, and combines the four stages in one final pass, so a step
+     * moves 15 values per element outside rhs. Set lowMemoryRK4 to hold three buffers
+     * instead of five, at the cost of 17 values per element (see lowMemoryRK4). Both give
+     * the same result, bit for bit.
+     *
+     * The BS23 scheme is an embedded pair, which estimates its own error and so can choose
+     * its step size; use it through stepAdaptive(). Its error is measured field by field
+     * against atol + rtol * |y|, with the tolerances for each field given in the vectors
+     * atol and rtol. The error of a step is the largest of the per-field root mean square
+     * errors, and the step is rejected (and retried with a smaller dt) if that exceeds 1.
+     *
+     * If active is set, the fixed step schemes update only the elements that it lists (the
+     * narrow band of a HexActiveSet) and the rhs need only write dydt for those elements.
+     * Elements of the stage inputs that aren't listed hold the values of y, so that the
+     * stencils of listed elements can read their neighbours in any stage.
+     */
+    template <class Flt>
+    class RDIntegrator
+    {
+    public:
+        /*!
+         * Which scheme to use.
+         */
+        RDScheme scheme = RDScheme::RK4;
+
+        /*!
+         * If true, RK4 holds three buffers rather than five: each stage's contribution to
+         * the final combination is accumulated in the same pass that forms the next
+         * stage's input, with k1 written straight into the accumulator. This saves two
+         * fields' worth of memory per field, but as the running sum is read and written at
+         * each stage, it moves more data than the default (17 values per element rather
+         * than 15), so it's slower unless memory is short.
+         */
+        bool lowMemoryRK4 = false;
+
+        /*!
+         * If not null, step() updates only the elements listed here (in every field).
+         * Not supported by stepAdaptive().
+         */
+        const vector<unsigned int>* active = nullptr;
+
+        /*!
+         * Absolute and relative error tolerances for BS23, per field. A field with no
+         * entry takes the last entry (or 1e-6 absolute and 1e-4 relative if empty).
+         */
+        //@{
+        vector<Flt> atol;
+        vector<Flt> rtol;
+        //@}
+
+        /*!
+         * Limits on the step size chosen by stepAdaptive.
+         */
+        //@{
+        Flt dtmin = 0.0;
+        Flt dtmax = numeric_limits<Flt>::max();
+        //@}
+
+        /*!
+         * Counts of the steps accepted and rejected by stepAdaptive.
+         */
+        //@{
+        unsigned long long int accepted = 0;
+        unsigned long long int rejected = 0;
+        //@}
+
+        /*!
+         * True if the scheme chooses its own step size.
+         */
+        bool adaptive (void) const {
+            return this->scheme == RDScheme::BS23;
+        }
+
+        /*!
+         * BS23 reuses its last stage as the first stage of the following step. If client
+         * code changes y between steps, call restart() so that the first stage is
+         * recomputed.
+         */
+        void restart (void) {
+            this->fsalValid = false;
+            this->tmpIsY = false;
+        }
+
+        /*!
+         * Advance y by one step of size dt.
+         */
+        template <typename RHS>
+        void step (vector<vector<Flt> >& y, Flt dt, RHS rhs) {
+
+            this->prepare (y);
+            unsigned int nf = y.size();
+            Flt halfdt = dt/2.0;
+            Flt sixthdt = dt/6.0;
+            if (this->active != nullptr && this->scheme != RDScheme::Euler && !this->tmpIsY) {
+                // The unlisted elements of tmp must hold y
+                for (unsigned int i = 0; i < nf; ++i) {
+                    std::copy (y[i].begin(), y[i].end(), this->tmp[i].begin());
+                }
+            }
+            const unsigned int* idx = this->active != nullptr ? this->active->data() : nullptr;
+
+            switch (this->scheme) {
+            case RDScheme::Euler:
+            {
+                rhs (y, this->k);
+                this->update (y, dt);
+                break;
+            }
+            case RDScheme::RK2:
+            {
+                rhs (y, this->k);
+                this->stage (y, this->k, halfdt);
+                rhs (this->tmp, this->k);
+                this->update (y, dt);
+                break;
+            }
+            case RDScheme::BS23:
+            {
+                throw runtime_error ("RDIntegrator::step: BS23 is adaptive; use stepAdaptive()");
+            }
+            case RDScheme::RK4:
+            default:
+            {
+                if (!this->lowMemoryRK4) {
+                    vector<vector<Flt> >& k1 = this->ke[0];
+                    vector<vector<Flt> >& k2 = this->ke[1];
+                    vector<vector<Flt> >& k3 = this->ke[2];
+                    vector<vector<Flt> >& k4 = this->ke[3];
+                    rhs (y, k1);
+                    this->stage (y, k1, halfdt);
+                    rhs (this->tmp, k2);
+                    this->stage (y, k2, halfdt);
+                    rhs (this->tmp, k3);
+                    this->stage (y, k3, dt);
+                    rhs (this->tmp, k4);
+                    // y += (k1 + 2 k2 + 2 k3 + k4) dt/6
+                    for (unsigned int i = 0; i < nf; ++i) {
+                        Flt* yi = y[i].data();
+                        const Flt* k1i = k1[i].data();
+                        const Flt* k2i = k2[i].data();
+                        const Flt* k3i = k3[i].data();
+                        const Flt* k4i = k4[i].data();
+                        int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                        for (int j = 0; j < n; ++j) {
+                            int h = idx ? idx[j] : j;
+                            yi[h] += (k1i[h] + (Flt)2 * k2i[h] + (Flt)2 * k3i[h] + k4i[h]) * sixthdt;
+                        }
+                    }
+                    break;
+                }
+                // k1, computed straight into acc. tmp = y + k1 dt/2
+                rhs (y, this->acc);
+                for (unsigned int i = 0; i < nf; ++i) {
+                    const Flt* yi = y[i].data();
+                    const Flt* ai = this->acc[i].data();
+                    Flt* ti = this->tmp[i].data();
+                    int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                    for (int j = 0; j < n; ++j) {
+                        int h = idx ? idx[j] : j;
+                        ti[h] = yi[h] + ai[h] * halfdt;
+                    }
+                }
+                // k2. acc += 2 k2, tmp = y + k2 dt/2
+                rhs (this->tmp, this->k);
+                this->accumulate (y, halfdt);
+                // k3. acc += 2 k3, tmp = y + k3 dt
+                rhs (this->tmp, this->k);
+                this->accumulate (y, dt);
+                // k4. y += (acc + k4) dt/6
+                rhs (this->tmp, this->k);
+                for (unsigned int i = 0; i < nf; ++i) {
+                    Flt* yi = y[i].data();
+                    const Flt* ki = this->k[i].data();
+                    const Flt* ai = this->acc[i].data();
+                    int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                    for (int j = 0; j < n; ++j) {
+                        int h = idx ? idx[j] : j;
+                        yi[h] += (ai[h] + ki[h]) * sixthdt;
+                    }
+                }
+                break;
+            }
+            }
+
+            if (this->active != nullptr && this->scheme != RDScheme::Euler) {
+                // Return the listed elements of tmp to y, for the next step
+                for (unsigned int i = 0; i < nf; ++i) {
+                    const Flt* yi = y[i].data();
+                    Flt* ti = this->tmp[i].data();
+                    int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                    for (int j = 0; j < n; ++j) {
+                        ti[idx[j]] = yi[idx[j]];
+                    }
+                }
+            }
+            this->tmpIsY = (this->active != nullptr && this->scheme != RDScheme::Euler);
+        }
+
+        /*!
+         * Advance y by one accepted step of the BS23 scheme, trying dt first and reducing it
+         * until the error is within tolerance. Returns the step that was taken. On return,
+         * dt holds the step size to try next. Throws if the step size would have to fall
+         * below dtmin.
+         */
+        template <typename RHS>
+        Flt stepAdaptive (vector<vector<Flt> >& y, Flt& dt, RHS rhs) {
+
+            if (this->scheme != RDScheme::BS23) {
+                throw runtime_error ("RDIntegrator::stepAdaptive: scheme is not adaptive");
+            }
+            if (this->active != nullptr) {
+                throw runtime_error ("RDIntegrator::stepAdaptive: active element lists need a fixed step scheme");
+            }
+            this->tmpIsY = false;
+            this->prepare (y);
+            unsigned int nf = y.size();
+            vector<vector<Flt> >& k1 = this->ke[0];
+            vector<vector<Flt> >& k2 = this->ke[1];
+            vector<vector<Flt> >& k3 = this->ke[2];
+            vector<vector<Flt> >& k4 = this->ke[3];
+
+            if (!this->fsalValid) {
+                rhs (y, k1);
+                this->fsalValid = true;
+            }
+
+            bool rejectedOnce = false;
+            for (;;) {
+                Flt h = dt;
+                // k2 from y + h/2 k1
+                this->combine (this->tmp, y, h, k1, 0.5);
+                rhs (this->tmp, k2);
+                // k3 from y + 3h/4 k2
+                this->combine (this->tmp, y, h, k2, 0.75);
+                rhs (this->tmp, k3);
+                // The third order solution, into tmp
+                for (unsigned int i = 0; i < nf; ++i) {
+                    const Flt* yi = y[i].data();
+                    const Flt* k1i = k1[i].data();
+                    const Flt* k2i = k2[i].data();
+                    const Flt* k3i = k3[i].data();
+                    Flt* ti = this->tmp[i].data();
+                    const Flt c1 = h * (Flt)(2.0/9.0);
+                    const Flt c2 = h * (Flt)(1.0/3.0);
+                    const Flt c3 = h * (Flt)(4.0/9.0);
+                    int n = y[i].size();
+#pragma omp parallel for schedule(static)
+                    for (int j = 0; j < n; ++j) {
+                        ti[j] = yi[j] + c1 * k1i[j] + c2 * k2i[j] + c3 * k3i[j];
+                    }
+                }
+                rhs (this->tmp, k4);
+
+                // The error is the difference between the third and second order solutions
+                Flt err = 0.0;
+                for (unsigned int i = 0; i < nf; ++i) {
+                    const Flt* yi = y[i].data();
+                    const Flt* k1i = k1[i].data();
+                    const Flt* k2i = k2[i].data();
+                    const Flt* k3i = k3[i].data();
+                    const Flt* k4i = k4[i].data();
+                    const Flt* ti = this->tmp[i].data();
+                    const Flt e1 = h * (Flt)(-5.0/72.0);
+                    const Flt e2 = h * (Flt)(1.0/12.0);
+                    const Flt e3 = h * (Flt)(1.0/9.0);
+                    const Flt e4 = h * (Flt)(-1.0/8.0);
+                    const Flt at = this->tolerance (this->atol, i, 1e-6);
+                    const Flt rt = this->tolerance (this->rtol, i, 1e-4);
+                    int n = y[i].size();
+                    double sumsq = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:sumsq)
+                    for (int j = 0; j < n; ++j) {
+                        Flt e = e1 * k1i[j] + e2 * k2i[j] + e3 * k3i[j] + e4 * k4i[j];
+                        Flt sc = at + rt * std::max (std::abs (yi[j]), std::abs (ti[j]));
+                        double r = e / sc;
+                        sumsq += r * r;
+                    }
+                    Flt fielderr = n > 0 ? std::sqrt (sumsq / n) : 0.0;
+                    err = std::max (err, fielderr);
+                }
+
+                // The usual step size controller, for a method of order 3
+                Flt fac = err > 0.0 ? (Flt)0.9 * std::pow (err, (Flt)(-1.0/3.0)) : (Flt)5.0;
+                fac = std::min ((Flt)5.0, std::max ((Flt)0.2, fac));
+
+                if (err <= 1.0 || h <= this->dtmin) {
+                    if (err > 1.0) {
+                        throw runtime_error ("RDIntegrator::stepAdaptive: error tolerance can't be met at dtmin");
+                    }
+                    // Accept. k4 is the derivative at the new y, so it's the next step's k1.
+                    for (unsigned int i = 0; i < nf; ++i) {
+                        y[i].swap (this->tmp[i]);
+                    }
+                    k1.swap (k4);
+                    ++this->accepted;
+                    if (rejectedOnce) {
+                        fac = std::min ((Flt)1.0, fac);
+                    }
+                    dt = std::min (this->dtmax, std::max (this->dtmin, h * fac));
+                    return h;
+                }
+
+                ++this->rejected;
+                rejectedOnce = true;
+                dt = std::max (this->dtmin, h * fac);
+            }
+        }
+
+    private:
+        /*!
+         * The number of elements of a field to update: the length of the active list if
+         * there is one, otherwise of the field.
+         */
+        int count (const vector<Flt>& yi) const {
+            return this->active != nullptr ? (int)this->active->size() : (int)yi.size();
+        }
+
+        /*!
+         * The tolerance for field i from tol (see atol, rtol).
+         */
+        Flt tolerance (const vector<Flt>& tol, unsigned int i, Flt dflt) const {
+            if (tol.empty()) {
+                return dflt;
+            }
+            return i < tol.size() ? tol[i] : tol.back();
+        }
+
+        /*!
+         * out = y + k * h * c
+         */
+        void combine (vector<vector<Flt> >& out, const vector<vector<Flt> >& y,
+                      Flt h, const vector<vector<Flt> >& k, Flt c) {
+            for (unsigned int i = 0; i < y.size(); ++i) {
+                const Flt* yi = y[i].data();
+                const Flt* ki = k[i].data();
+                Flt* oi = out[i].data();
+                const Flt hc = h * c;
+                int n = y[i].size();
+#pragma omp parallel for schedule(static)
+                for (int j = 0; j < n; ++j) {
+                    oi[j] = yi[j] + ki[j] * hc;
+                }
+            }
+        }
+
+        /*!
+         * Size the stage buffers to match y. Does nothing if they already match.
+         */
+        void prepare (const vector<vector<Flt> >& y) {
+            bool match = (this->scheme == this->preparedScheme
+                          && this->lowMemoryRK4 == this->preparedLowMemory
+                          && this->tmp.size() == y.size());
+            for (unsigned int i = 0; match && i < y.size(); ++i) {
+                match = (this->tmp[i].size() == y[i].size());
+            }
+            if (match) {
+                return;
+            }
+            this->fsalValid = false;
+            this->tmpIsY = false;
+            this->preparedScheme = this->scheme;
+            this->preparedLowMemory = this->lowMemoryRK4;
+            bool rk4 = (this->scheme == RDScheme::RK4);
+            bool fourStages = (this->scheme == RDScheme::BS23 || (rk4 && !this->lowMemoryRK4));
+            this->resize (this->k, y, !fourStages);
+            this->resize (this->tmp, y, true);
+            this->resize (this->acc, y, rk4 && this->lowMemoryRK4);
+            for (unsigned int s = 0; s < 4; ++s) {
+                this->resize (this->ke[s], y, fourStages);
+            }
+        }
+
+        /*!
+         * Make b the same shape as y if need is true, otherwise empty it.
+         */
+        void resize (vector<vector<Flt> >& b, const vector<vector<Flt> >& y, bool need) {
+            b.resize (need ? y.size() : 0);
+            for (unsigned int i = 0; i < b.size(); ++i) {
+                b[i].assign (y[i].size(), 0.0);
+            }
+        }
+
+        /*!
+         * tmp = y + kb * f
+         */
+        void stage (const vector<vector<Flt> >& y, const vector<vector<Flt> >& kb, Flt f) {
+            for (unsigned int i = 0; i < y.size(); ++i) {
+                const Flt* yi = y[i].data();
+                const Flt* ki = kb[i].data();
+                Flt* ti = this->tmp[i].data();
+                const unsigned int* idx = this->active != nullptr ? this->active->data() : nullptr;
+                int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                for (int j = 0; j < n; ++j) {
+                    int h = idx ? idx[j] : j;
+                    ti[h] = yi[h] + ki[h] * f;
+                }
+            }
+        }
+
+        /*!
+         * y += k * f
+         */
+        void update (vector<vector<Flt> >& y, Flt f) {
+            for (unsigned int i = 0; i < y.size(); ++i) {
+                Flt* yi = y[i].data();
+                const Flt* ki = this->k[i].data();
+                const unsigned int* idx = this->active != nullptr ? this->active->data() : nullptr;
+                int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                for (int j = 0; j < n; ++j) {
+                    int h = idx ? idx[j] : j;
+                    yi[h] += ki[h] * f;
+                }
+            }
+        }
+
+        /*!
+         * acc += 2k and tmp = y + k * f, in one pass.
+         */
+        void accumulate (const vector<vector<Flt> >& y, Flt f) {
+            for (unsigned int i = 0; i < y.size(); ++i) {
+                const Flt* yi = y[i].data();
+                const Flt* ki = this->k[i].data();
+                Flt* ai = this->acc[i].data();
+                Flt* ti = this->tmp[i].data();
+                const unsigned int* idx = this->active != nullptr ? this->active->data() : nullptr;
+                int n = this->count (y[i]);
+#pragma omp parallel for schedule(static)
+                for (int j = 0; j < n; ++j) {
+                    int h = idx ? idx[j] : j;
+                    ai[h] += ki[h] + ki[h];
+                    ti[h] = yi[h] + ki[h] * f;
+                }
+            }
+        }
+
+        //! The current stage's derivative
+        vector<vector<Flt> > k;
+        //! The input to the next stage
+        vector<vector<Flt> > tmp;
+        //! The weighted sum of the RK4 stages computed so far (with lowMemoryRK4)
+        vector<vector<Flt> > acc;
+        //! The four stages of BS23 and of RK4
+        array<vector<vector<Flt> >, 4> ke;
+        //! True if ke[0] holds the derivative at the current y
+        bool fsalValid = false;
+        //! The scheme for which the buffers were last sized
+        RDScheme preparedScheme = RDScheme::RK4;
+        //! The value of lowMemoryRK4 for which the buffers were last sized
+        bool preparedLowMemory = false;
+        //! True if tmp equals y, as the last step with an active list leaves it
+        bool tmpIsY = false;
+    };
+
+} // namespace morph
+
+#endif // _RDINTEGRATOR_H_
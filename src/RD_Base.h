@@ -4,6 +4,15 @@
 #include "morph/tools.h"
 #include "morph/ReadCurves.h"
 #include "morph/HexGrid.h"
+#include "morph/HexKernels.h"
+#include "morph/RDIntegrator.h"
+#include "morph/HexDiffusion.h"
+#include "morph/HexActiveSet.h"
+#include "morph/FieldArena.h"
+#include "morph/RDCheckpoint.h"
+#include "morph/Philox.h"
+#include "morph/Instrument.h"
+#include "morph/MathAlgo.h"
 #include "morph/HdfData.h"
 #include <iostream>
 #include <sstream>
@@ -11,6 +20,7 @@
 #include <array>
 #include <map>
 #include <utility>
+#include <algorithm>
 #include <iomanip>
 #include <cmath>
 #include <hdf5.h>
@@ -107,11 +117,37 @@ namespace morph {
          */
         alignas(float) float hexspan = 4;
 
+        /*!
+         * How the HexGrid is held while it is built. Flat is quicker and lighter to build
+         * and gives the same grid as List.
+         */
+        morph::HexGridStorage hexstorage = morph::HexGridStorage::Flat;
+
+        /*!
+         * If true, the hexes are renumbered along a Hilbert curve once the HexGrid is built
+         * (see HexGrid::reorderHilbert) so that the neighbours in the stencil loops are close
+         * in memory. Use hg->toCanonical() to save fields in the original hex order.
+         */
+        bool hilbertOrder = false;
+
+        /*!
+         * If true, the HexGrid's ghost neighbour table (HexGrid::d_nbtab) is built in
+         * allocate(), the field allocators below add nghost ghost slots to the end of each
+         * field, and compute_laplace_ghost() can be used in place of compute_laplace().
+         */
+        bool ghostNeighbours = false;
+
         /*!
          * Holds the number of hexes in the populated HexGrid
          */
         alignas(Flt) unsigned int nhex = 0;
 
+        /*!
+         * The number of ghost slots after the nhex hex values in each field. 0 unless
+         * ghostNeighbours is true.
+         */
+        alignas(Flt) unsigned int nghost = 0;
+
         /*!
          * Over what length scale should some values fall off to zero
          * towards the boundary? Used in a couple of different locations.
@@ -170,6 +206,22 @@ namespace morph {
          * Below here, there's no need to worry about alignas keywords.
          */
 
+        /*!
+         * The model time reached; the sum of the steps taken by integrate(). With an
+         * adaptive integrator the steps vary, so use this rather than stepCount * dt.
+         */
+        double simTime = 0.0;
+
+        /*!
+         * The model time at which timeToSave() will next return true.
+         */
+        double nextSaveTime = 0.0;
+
+        /*!
+         * The reaction rates, then the right hand sides, in integrateIMEX.
+         */
+        vector<vector<Flt> > imexRate;
+
         /*!
          * Hold on to the ReadCurves object, so that the additional contours are available.
          */
@@ -178,7 +230,56 @@ namespace morph {
         /*!
          * The HexGrid "background" for the Reaction Diffusion system.
          */
-        HexGrid* hg;
+        HexGrid* hg = nullptr;
+
+        /*!
+         * True if hg was given by useHexGrid(), in which case it is shared with other
+         * models (see RD_Ensemble) and is neither built by allocate() nor deleted by this
+         * object.
+         */
+        bool sharedHexGrid = false;
+
+        /*!
+         * Use an existing HexGrid, rather than building one in allocate(). The grid is only
+         * read, so one grid may be used by many models at once; it must outlive them all.
+         * If ghostNeighbours is set, the grid must already have its ghost table
+         * (HexGrid::populate_d_ghosts). Call before allocate().
+         */
+        void useHexGrid (HexGrid* shared) {
+            this->hg = shared;
+            this->sharedHexGrid = true;
+        }
+
+        /*!
+         * The counter-based generator for noiseify_vector_variable (with a stream) and
+         * add_noise. Set rng.seed to choose the noise; the same seed gives the same noise
+         * with any number of threads.
+         */
+        morph::Philox rng;
+
+        /*!
+         * Writes the snapshots taken by checkpoint() on a background thread.
+         */
+        morph::RDCheckpoint<Flt> checkpointer;
+
+        /*!
+         * The file that checkpoint() writes. If empty, logpath/checkpoint.h5.
+         */
+        string checkpointPath = "";
+
+        /*!
+         * The HexGrid file that checkpoints refer to. If empty, the grid is written (once,
+         * by the checkpoint writer) to checkpoint_grid.h5 next to the checkpoint file. Set it
+         * when several models share a grid (useHexGrid), which checkpoint() won't save. It
+         * must be absolute, or in the same directory as the checkpoint file.
+         */
+        string checkpointGrid = "";
+
+        /*!
+         * With MORPH_INSTRUMENT defined, reportInstrument() prints the phase timings every
+         * instrumentEvery steps (never if 0).
+         */
+        unsigned int instrumentEvery = 0;
 
         /*!
          * The logpath for this model. Used when saving data out.
@@ -210,8 +311,10 @@ namespace morph {
         /*!
          * Destructor required to free up HexGrid memory
          */
-        ~RD_Base (void) {
-            delete (this->hg);
+        virtual ~RD_Base (void) {
+            if (!this->sharedHexGrid) {
+                delete (this->hg);
+            }
         }
 
         /*!
@@ -222,12 +325,12 @@ namespace morph {
         void resize_vector_vector (vector<vector<Flt> >& vv, unsigned int N) {
             vv.resize (N);
             for (unsigned int i=0; i<N; ++i) {
-                vv[i].resize (this->nhex, 0.0);
+                vv[i].resize (this->nhex + this->nghost, 0.0);
             }
         }
         void zero_vector_vector (vector<vector<Flt> >& vv, unsigned int N) {
             for (unsigned int i=0; i<N; ++i) {
-                vv[i].assign (this->nhex, 0.0);
+                vv[i].assign (this->nhex + this->nghost, 0.0);
             }
         }
         void resize_vector_vector (vector<vector<Flt> >& vv, unsigned int N, unsigned int M) {
@@ -252,7 +355,7 @@ namespace morph {
             for (unsigned int m=0; m<M; ++m) {
                 vvv[m].resize (N);
                 for (unsigned int i=0; i<N; ++i) {
-                    vvv[m][i].resize (this->nhex, 0.0);
+                    vvv[m][i].resize (this->nhex + this->nghost, 0.0);
                 }
             }
         }
@@ -266,14 +369,25 @@ namespace morph {
         //@}
 
         /*!
-         * Resize/zero a variable that'll be nhex elements long
+         * Size fa to hold N fields of nhex elements (plus nghost ghost slots), all zero, in
+         * a single allocation. An alternative to resize_vector_vector which keeps the whole
+         * state together, so that it can be copied with one memcpy and saved with one write
+         * (saveFieldArena). fa[i][h] works as it does for a vector<vector<Flt> >.
+         */
+        void resize_field_arena (morph::FieldArena<Flt>& fa, unsigned int N,
+                                 morph::FieldLayout layout = morph::FieldLayout::SoA) {
+            fa.resize (N, this->nhex + this->nghost, layout);
+        }
+
+        /*!
+         * Resize/zero a variable that'll be nhex elements long (plus nghost ghost slots)
          */
         //@{
         void resize_vector_variable (vector<Flt>& v) {
-            v.resize (this->nhex, 0.0);
+            v.resize (this->nhex + this->nghost, 0.0);
         }
         void zero_vector_variable (vector<Flt>& v) {
-            v.assign (this->nhex, 0.0);
+            v.assign (this->nhex + this->nghost, 0.0);
         }
         //@}
 
@@ -312,12 +426,12 @@ namespace morph {
          */
         //@{
         void resize_gradient_field (array<vector<Flt>, 2>& g) {
-            g[0].resize (this->nhex, 0.0);
-            g[1].resize (this->nhex, 0.0);
+            g[0].resize (this->nhex + this->nghost, 0.0);
+            g[1].resize (this->nhex + this->nghost, 0.0);
         }
         void zero_gradient_field (array<vector<Flt>, 2>& g) {
-            g[0].assign (this->nhex, 0.0);
-            g[1].assign (this->nhex, 0.0);
+            g[0].assign (this->nhex + this->nghost, 0.0);
+            g[1].assign (this->nhex + this->nghost, 0.0);
         }
         //@}
 
@@ -364,6 +478,24 @@ namespace morph {
         }
         //@}
 
+        /*!
+         * The FieldArena forms of resize_vector_array_vector and
+         * resize_vector_vector_array_vector: size fa to hold N (or M times N) vector fields,
+         * as 2N (or 2MN) fields of nhex elements (plus nghost ghost slots), all zero.
+         * fa.vectorField(n) (or fa.vectorField(j*N + n)) gives the x and y components of
+         * vector field n (or [j][n]), to pass to spacegrad2D. fa.zero() zeroes them all.
+         */
+        //@{
+        void resize_vector_array_arena (morph::FieldArena<Flt>& fa, unsigned int N,
+                                        morph::FieldLayout layout = morph::FieldLayout::SoA) {
+            fa.resize (2 * N, this->nhex + this->nghost, layout);
+        }
+        void resize_vector_vector_array_arena (morph::FieldArena<Flt>& fa, unsigned int N, unsigned int M,
+                                               morph::FieldLayout layout = morph::FieldLayout::SoA) {
+            fa.resize (2 * N * M, this->nhex + this->nghost, layout);
+        }
+        //@}
+
         /*!
          * Initialise a vector with noise, but with sigmoidal roll-off to
          * zero at the boundary.
@@ -385,20 +517,99 @@ namespace morph {
             }
         }
 
+        /*!
+         * As noiseify_vector_variable(v, offset, gain), but with the noise from rng, in
+         * stream, so that it runs in parallel and gives the same field for the same
+         * rng.seed whatever the number of threads. Use a different stream for each field.
+         */
+        void noiseify_vector_variable (vector<Flt>& v, Flt offset, Flt gain, uint32_t stream) {
+            this->rng.fillUniform (v.data(), this->nhex, 0, stream);
+            const vector<float>& dist = this->hg->d_distToBoundary;
+            int nn = this->nhex;
+#pragma omp parallel for schedule(static)
+            for (int h = 0; h < nn; ++h) {
+                v[h] = v[h] * gain + offset;
+                if (dist[h] > -0.5) {
+                    Flt bSig = 1.0 / ( 1.0 + exp (-100.0*(dist[h]-this->boundaryFalloffDist)) );
+                    v[h] = v[h] * bSig;
+                }
+            }
+        }
+
+        /*!
+         * noiseify_vector_variable for a field held in a FieldArena. Gives the same field
+         * as the vector forms.
+         */
+        //@{
+        void noiseify_vector_variable (morph::FieldView<Flt> v, Flt offset, Flt gain) {
+            for (auto h : this->hg->hexen) {
+                v[h.vi] = morph::Tools::randF<Flt>() * gain + offset;
+                if (h.distToBoundary > -0.5) {
+                    Flt bSig = 1.0 / ( 1.0 + exp (-100.0*(h.distToBoundary-this->boundaryFalloffDist)) );
+                    v[h.vi] = v[h.vi] * bSig;
+                }
+            }
+        }
+        void noiseify_vector_variable (morph::FieldView<Flt> v, Flt offset, Flt gain, uint32_t stream) {
+            const vector<float>& dist = this->hg->d_distToBoundary;
+            int nn = this->nhex;
+#pragma omp parallel for schedule(static)
+            for (int h = 0; h < nn; ++h) {
+                v[h] = this->rng.template uniform<Flt> (h, 0, stream) * gain + offset;
+                if (dist[h] > -0.5) {
+                    Flt bSig = 1.0 / ( 1.0 + exp (-100.0*(dist[h]-this->boundaryFalloffDist)) );
+                    v[h] = v[h] * bSig;
+                }
+            }
+        }
+        //@}
+
+        /*!
+         * Add normally distributed noise of standard deviation sigma to the hexes of v, drawn
+         * from rng in stream at the current stepCount, for the stochastic terms of a model.
+         * For an Euler-Maruyama step, sigma is the noise amplitude times sqrt(dt).
+         */
+        void add_noise (vector<Flt>& v, Flt sigma, uint32_t stream) {
+            int nn = this->nhex;
+            uint64_t step = this->stepCount;
+#pragma omp parallel for schedule(static)
+            for (int h = 0; h < nn; ++h) {
+                v[h] += sigma * this->rng.template normal<Flt> (h, step, stream);
+            }
+        }
+
         /*!
          * Perform memory allocations, vector resizes and so on.
          */
         virtual void allocate (void) {
-            // Create a HexGrid. 3 is the 'x span' which determines how
-            // many hexes are initially created. 0 is the z co-ordinate for the HexGrid.
-            this->hg = new HexGrid (this->hextohex_d, this->hexspan, 0, morph::HexDomainShape::Boundary);
-            DBG ("Initial hexagonal HexGrid has " << this->hg->num() << " hexes");
-            // Read the curves which make a boundary
-            this->r.init (this->svgpath);
-            // Set the boundary in the HexGrid
-            this->hg->setBoundary (this->r.getCorticalPath());
-            // Compute the distances from the boundary
-            this->hg->computeDistanceToBoundary();
+            if (this->hg == nullptr) {
+                // Create a HexGrid. 3 is the 'x span' which determines how
+                // many hexes are initially created. 0 is the z co-ordinate for the HexGrid.
+                this->hg = new HexGrid (this->hextohex_d, this->hexspan, 0,
+                                        morph::HexDomainShape::Boundary, this->hexstorage);
+                DBG ("Initial hexagonal HexGrid has " << this->hg->num() << " hexes");
+                // Read the curves which make a boundary
+                this->r.init (this->svgpath);
+                // Set the boundary in the HexGrid
+                this->hg->setBoundary (this->r.getCorticalPath());
+                // Compute the distances from the boundary
+                this->hg->computeDistanceToBoundary();
+                if (this->hilbertOrder == true) {
+                    this->hg->reorderHilbert();
+                }
+                if (this->ghostNeighbours == true) {
+                    this->hg->populate_d_ghosts();
+                }
+            } else if (this->ghostNeighbours == true && this->hg->d_nbtab.empty()) {
+                if (this->sharedHexGrid == true) {
+                    throw runtime_error ("RD_Base::allocate: the shared HexGrid has no ghost neighbour table");
+                }
+                // A grid loaded by restoreCheckpoint()
+                this->hg->populate_d_ghosts();
+            }
+            if (this->ghostNeighbours == true) {
+                this->nghost = this->hg->d_ghostsrc.size();
+            }
             // Vector size comes from number of Hexes in the HexGrid
             this->nhex = this->hg->num();
             DBG ("After setting boundary, HexGrid has " << this->nhex << " hexes");
@@ -467,6 +678,138 @@ namespace morph {
         }
         //@}
 
+        /*!
+         * The explicit integrator used by integrate(). Set integrator.scheme to choose
+         * Euler, RK2 or RK4 (the default).
+         */
+        morph::RDIntegrator<Flt> integrator;
+
+        /*!
+         * Advance the fields by one time step, using integrator, and add the step to
+         * simTime. If integrator.scheme is adaptive (BS23), dt is the step to try and is
+         * updated to the step size that the integrator proposes for the next step; otherwise
+         * the step is dt. rhs is called as
+         * rhs (y, dydt) for each stage and must write the time derivative of every field of
+         * y into dydt. For example, in a model holding its two fields in a member
+         * vector<vector<Flt> > ab:
+         *
+         *   this->integrate (this->ab, [this](vector<vector<Flt> >& y, vector<vector<Flt> >& dy) {
+         *       this->compute_dadt (y[0], y[1], dy[0]);
+         *       this->compute_dbdt (y[0], y[1], dy[1]);
+         *   });
+         *
+         * The stage buffers are held by integrator and reused from step to step.
+         */
+        template <typename RHS>
+        void integrate (vector<vector<Flt> >& fields, RHS rhs) {
+            MORPH_PHASE ("integrate", 2 * fields.size() * fields[0].size() * sizeof(Flt));
+            if (this->integrator.adaptive()) {
+                this->simTime += this->integrator.stepAdaptive (fields, this->dt, rhs);
+                this->set_dt (this->dt);
+            } else if (this->activeSet.enabled) {
+                this->activeSet.begin (fields, this->nhex);
+                this->integrator.active = this->activeSet.full() ? nullptr : &this->activeSet.indices();
+                this->integrator.step (fields, this->dt, rhs);
+                this->integrator.active = nullptr;
+                this->activeSet.end (*this->hg, fields, this->dt);
+                this->simTime += this->dt;
+            } else {
+                this->integrator.step (fields, this->dt, rhs);
+                this->simTime += this->dt;
+            }
+        }
+
+        /*!
+         * The narrow band of changing hexes. If activeSet.enabled is true, integrate()
+         * (with a fixed step scheme) steps only the hexes in the band, and compute_laplace
+         * and compute_laplace_ghost, called within the step, compute only those hexes.
+         * Reaction terms may still be computed for every hex (the values outside the band
+         * are ignored) or, to save that work too, for activeSet.indices() alone when
+         * activeSet.stepping() is true. activeSet.fraction() is the fraction of the hexes
+         * stepped in the last step.
+         */
+        morph::HexActiveSet<Flt> activeSet;
+
+        /*!
+         * The implicit diffusion solvers used by integrateIMEX, one per field.
+         */
+        vector<morph::HexDiffusion<Flt> > imexSolvers;
+
+        /*!
+         * Advance the fields by one implicit-explicit (IMEX) Euler step of dt: the reaction
+         * terms explicitly, then diffusion implicitly. reaction is called as reaction (y, r)
+         * and must write the reaction (non-diffusive) part of the time derivative of each
+         * field into r. Field i diffuses with coefficient D[i] (which may be 0). The diffusion
+         * term is solved as (I - dt D[i] L) y_new = y + dt r (see HexDiffusion), so dt is
+         * limited by the reaction terms only, not by d^2/D as it is for explicit stepping.
+         * The solvers are set up on the first step and again only if dt or D changes. Ghost
+         * slots, if any, are refilled on each field before reaction is called.
+         *
+         * This step is first order in time. Use the explicit integrate() if the diffusion
+         * limit on dt isn't the constraint.
+         */
+        template <typename RHS>
+        void integrateIMEX (vector<vector<Flt> >& fields, const vector<Flt>& D, RHS reaction) {
+            unsigned int nf = fields.size();
+            if (D.size() != nf) {
+                throw runtime_error ("RD_Base::integrateIMEX: need one diffusion coefficient per field");
+            }
+            Flt norm  = (Flt)2 / (Flt)(3.0 * this->d * this->d);
+            this->imexSolvers.resize (nf);
+            for (unsigned int i = 0; i < nf; ++i) {
+                Flt c = this->dt * D[i];
+                if (D[i] > 0 && this->imexSolvers[i].c != c) {
+                    this->imexSolvers[i].setup (this->hg, this->nhex, norm, c);
+                }
+            }
+            if (this->imexRate.size() != nf) {
+                this->resize_vector_vector (this->imexRate, nf);
+            }
+
+            if (this->nghost > 0) {
+                for (unsigned int i = 0; i < nf; ++i) {
+                    this->fill_ghosts (fields[i]);
+                }
+            }
+            {
+                MORPH_PHASE ("imex_reaction", 0);
+                reaction (fields, this->imexRate);
+            }
+            MORPH_PHASE ("imex_solve", 0);
+            for (unsigned int i = 0; i < nf; ++i) {
+                Flt* yi = fields[i].data();
+                // imexRate becomes the right hand side, y + dt r; y is the initial guess.
+                Flt* bi = this->imexRate[i].data();
+                int n = this->nhex;
+#pragma omp parallel for schedule(static)
+                for (int h = 0; h < n; ++h) {
+                    bi[h] = yi[h] + this->dt * bi[h];
+                }
+                if (D[i] > 0) {
+                    this->imexSolvers[i].solve (bi, yi);
+                } else {
+                    std::copy (bi, bi + n, yi);
+                }
+            }
+            this->simTime += this->dt;
+        }
+
+        /*!
+         * Returns true once simTime has reached each multiple of interval, so that saving
+         * can be scheduled in model time when dt varies. For example, in step():
+         *
+         *   if (this->timeToSave (0.01)) { this->save(); }
+         */
+        bool timeToSave (double interval) {
+            if (this->simTime < this->nextSaveTime) {
+                return false;
+            }
+            while (this->nextSaveTime <= this->simTime) {
+                this->nextSaveTime += interval;
+            }
+            return true;
+        }
+
     public:
 
         /*!
@@ -478,6 +821,229 @@ namespace morph {
          */
         virtual void save (void) { }
 
+        /*!
+         * Save the model time, the step count and the current dt to dat, along with the
+         * integrator's counts of accepted and rejected steps and, if activeSet is enabled,
+         * the active fraction of the last step and its mean. Call from save() so that each
+         * frame records when it was taken.
+         */
+        void saveTimeInfo (HdfData& dat) {
+            MORPH_PHASE ("save", 0);
+            dat.add_val ("/stepCount", this->stepCount);
+            dat.add_val ("/t", this->simTime);
+            dat.add_val ("/dt", this->dt);
+            dat.add_val ("/steps_accepted", this->integrator.accepted);
+            dat.add_val ("/steps_rejected", this->integrator.rejected);
+            if (this->activeSet.enabled) {
+                dat.add_val ("/active_fraction", this->activeSet.fraction());
+                dat.add_val ("/active_fraction_mean", this->activeSet.meanFraction());
+            }
+#ifdef MORPH_INSTRUMENT
+            morph::Instrument::get().save (dat);
+#endif
+        }
+
+        /*!
+         * If instrumentation is compiled in (see Instrument.h), write the table of phase
+         * timings to os every instrumentEvery steps; call it from the main loop, next to the
+         * stepCount message. Does nothing otherwise.
+         */
+        void reportInstrument (std::ostream& os = std::cout) {
+#ifdef MORPH_INSTRUMENT
+            if (this->instrumentEvery > 0 && this->stepCount % this->instrumentEvery == 0) {
+                os << "Phase timings at step " << this->stepCount << ":\n";
+                morph::Instrument::get().report (os);
+            }
+#endif
+        }
+
+        /*!
+         * Save all the fields in fa to path in dat, with a single write. The dataset is
+         * fa.size() by nhex+nghost for FieldLayout::SoA, or nhex+nghost by fa.size() for
+         * FieldLayout::Interleaved (that is, as the values lie in memory).
+         */
+        void saveFieldArena (HdfData& dat, const char* path, const morph::FieldArena<Flt>& fa) {
+            MORPH_PHASE ("save", fa.bytes());
+            if (fa.layout() == morph::FieldLayout::SoA) {
+                dat.add_ptrarray_vals (path, fa.data(), fa.size(), fa.fieldSize(), fa.fieldStride());
+            } else {
+                dat.add_ptrarray_vals (path, fa.data(), fa.fieldSize(), fa.size(), fa.size());
+            }
+        }
+
+        /*!
+         * Include a field in checkpoints, under name. Register each variable of the model's
+         * state, typically at the end of init(); registering a name again replaces the
+         * earlier registration. The field is referred to, not copied, so must outlive the
+         * model's checkpointing. A vector of vectors is saved as name/0, name/1 and so on.
+         */
+        //@{
+        void checkpointField (const string& name, vector<Flt>& f) {
+            this->registerCheckpoint (name, &f, nullptr, nullptr);
+        }
+        void checkpointField (const string& name, vector<vector<Flt> >& ff) {
+            this->registerCheckpoint (name, nullptr, &ff, nullptr);
+        }
+        void checkpointField (const string& name, morph::FieldArena<Flt>& fa) {
+            this->registerCheckpoint (name, nullptr, nullptr, &fa);
+        }
+        //@}
+
+        /*!
+         * Take a checkpoint: copy the registered fields, dt, stepCount, simTime,
+         * nextSaveTime and rng.seed, then return, leaving checkpointer to write the copy
+         * to checkpointPath while stepping continues. Only if the previous checkpoint is
+         * still waiting to be written does this wait. Restart from the file with
+         * restoreCheckpoint().
+         */
+        void checkpoint (void) {
+            string path = this->checkpointPath.empty() ? this->logpath + "/checkpoint.h5" : this->checkpointPath;
+            string dir = RD_Base<Flt>::dirOf (path);
+            bool writeGrid = false;
+            if (this->checkpointGrid.empty()) {
+                if (this->sharedHexGrid == true) {
+                    throw runtime_error ("RD_Base::checkpoint: set checkpointGrid for a shared HexGrid");
+                }
+                this->checkpointGrid = dir + "/checkpoint_grid.h5";
+                writeGrid = true;
+            }
+
+            MORPH_PHASE ("checkpoint", 0);
+            morph::RDCheckpointState<Flt>& s = this->checkpointer.acquire();
+            s.fieldNames.clear();
+            s.arenaNames.clear();
+            unsigned int nf = 0;
+            unsigned int na = 0;
+            for (const CheckpointEntry& e : this->checkpointEntries) {
+                if (e.fa != nullptr) {
+                    if (s.arenas.size() <= na) { s.arenas.resize (na + 1); }
+                    s.arenas[na++] = *e.fa;
+                    s.arenaNames.push_back (e.name);
+                    continue;
+                }
+                unsigned int count = e.v != nullptr ? 1 : e.vv->size();
+                for (unsigned int i = 0; i < count; ++i) {
+                    const vector<Flt>& f = e.v != nullptr ? *e.v : (*e.vv)[i];
+                    if (s.fields.size() <= nf) { s.fields.resize (nf + 1); }
+                    s.fields[nf++].assign (f.begin(), f.end());
+                    s.fieldNames.push_back (e.v != nullptr ? e.name : e.name + "/" + std::to_string (i));
+                }
+            }
+            s.fields.resize (nf);
+            s.arenas.resize (na);
+            s.gridfile = this->checkpointGrid.compare (0, dir.size() + 1, dir + "/") == 0
+                ? this->checkpointGrid.substr (dir.size() + 1) : this->checkpointGrid;
+            s.grid = writeGrid ? this->hg : nullptr;
+            s.gridpath = this->checkpointGrid;
+            s.dt = this->dt;
+            s.stepCount = this->stepCount;
+            s.simTime = this->simTime;
+            s.nextSaveTime = this->nextSaveTime;
+            s.rngSeed = this->rng.seed;
+            this->checkpointer.submit (path);
+        }
+
+        //! Wait until every checkpoint taken has been written
+        void checkpointWait (void) {
+            this->checkpointer.wait();
+        }
+
+        /*!
+         * Start the model from the checkpoint at path, in place of allocate() and init().
+         * The HexGrid is loaded from the checkpoint's grid file (unless one was given by
+         * useHexGrid()), rather than being built from svgpath. Then allocate() and init()
+         * are called, after which the registered fields are read from the checkpoint, with
+         * dt, stepCount, simTime, nextSaveTime and rng.seed. The integrator is restarted.
+         */
+        void restoreCheckpoint (const string& path) {
+            this->checkpointer.wait();
+            string gridfile;
+            {
+                HdfData cp (path, READ_DATA);
+                cp.read_string ("/gridfile", gridfile);
+            }
+            if (!gridfile.empty() && gridfile[0] != '/') {
+                gridfile = RD_Base<Flt>::dirOf (path) + "/" + gridfile;
+            }
+            if (this->hg == nullptr) {
+                this->hg = new HexGrid (gridfile);
+            }
+            this->checkpointGrid = gridfile;
+            this->allocate();
+            this->init();
+
+            HdfData cp (path, READ_DATA);
+            Flt dt_ = this->dt;
+            cp.read_val ("/dt", dt_);
+            this->set_dt (dt_);
+            cp.read_val ("/stepCount", this->stepCount);
+            cp.read_val ("/t", this->simTime);
+            cp.read_val ("/nextSaveTime", this->nextSaveTime);
+            unsigned long long int seed = 0;
+            cp.read_val ("/rng_seed", seed);
+            this->rng.seed = seed;
+
+            vector<Flt> tmp;
+            for (const CheckpointEntry& e : this->checkpointEntries) {
+                if (e.fa != nullptr) {
+                    morph::FieldArena<Flt>& fa = *e.fa;
+                    string p = "/arenas/" + e.name;
+                    if (fa.layout() == morph::FieldLayout::SoA) {
+                        cp.read_ptrarray_vals (p.c_str(), fa.data(), fa.size(), fa.fieldSize(), fa.fieldStride());
+                    } else {
+                        cp.read_ptrarray_vals (p.c_str(), fa.data(), fa.fieldSize(), fa.size(), fa.size());
+                    }
+                    continue;
+                }
+                unsigned int count = e.v != nullptr ? 1 : e.vv->size();
+                for (unsigned int i = 0; i < count; ++i) {
+                    vector<Flt>& f = e.v != nullptr ? *e.v : (*e.vv)[i];
+                    string p = "/fields/" + (e.v != nullptr ? e.name : e.name + "/" + std::to_string (i));
+                    cp.read_contained_vals (p.c_str(), tmp);
+                    if (tmp.size() != f.size()) {
+                        throw runtime_error ("RD_Base::restoreCheckpoint: " + p + " has the wrong size");
+                    }
+                    f.swap (tmp);
+                }
+            }
+            this->integrator.restart();
+            this->activeSet.reset();
+        }
+
+    protected:
+        //! A field registered with checkpointField(); one of v, vv and fa is non-null
+        struct CheckpointEntry
+        {
+            string name;
+            vector<Flt>* v;
+            vector<vector<Flt> >* vv;
+            morph::FieldArena<Flt>* fa;
+        };
+
+        //! The registered fields, in the order of registration
+        vector<CheckpointEntry> checkpointEntries;
+
+        void registerCheckpoint (const string& name, vector<Flt>* v,
+                                 vector<vector<Flt> >* vv, morph::FieldArena<Flt>* fa) {
+            CheckpointEntry e = { name, v, vv, fa };
+            for (CheckpointEntry& c : this->checkpointEntries) {
+                if (c.name == name) {
+                    c = e;
+                    return;
+                }
+            }
+            this->checkpointEntries.push_back (e);
+        }
+
+        //! The directory part of path ("." if there is none)
+        static string dirOf (const string& path) {
+            string::size_type slash = path.find_last_of ('/');
+            if (slash == string::npos) { return "."; }
+            if (slash == 0) { return "/"; }
+            return path.substr (0, slash);
+        }
+
+    public:
         /*!
          * Save position information
          */
@@ -592,19 +1158,31 @@ namespace morph {
          */
         void normalise (vector<Flt>& f) {
 
-            Flt maxf = -1e7;
-            Flt minf = +1e7;
-
             // Determines min and max
-            for (auto val : f) {
-                if (val>maxf) { maxf = val; }
-                if (val<minf) { minf = val; }
+            pair<Flt, Flt> mm = morph::MathAlgo<Flt>::maxmin (f);
+            Flt maxf = mm.first;
+            Flt minf = mm.second;
+            Flt scalef = 1.0 /(maxf - minf);
+
+            int n = f.size();
+#pragma omp parallel for schedule(static)
+            for (int fi = 0; fi < n; ++fi) {
+                f[fi] = fmin (fmax (((f[fi]) - minf) * scalef, 0.0), 1.0);
             }
+        }
+
+        /*!
+         * Normalise a field held in a FieldArena.
+         */
+        void normalise (morph::FieldView<Flt> f) {
+            auto mm = std::minmax_element (f.begin(), f.end());
+            Flt maxf = *mm.second;
+            Flt minf = *mm.first;
             Flt scalef = 1.0 /(maxf - minf);
 
-            vector<vector<Flt> > norm_a;
-            this->resize_vector_vector (norm_a);
-            for (unsigned int fi = 0; fi < f.size(); ++fi) {
+            int n = f.size();
+#pragma omp parallel for schedule(static)
+            for (int fi = 0; fi < n; ++fi) {
                 f[fi] = fmin (fmax (((f[fi]) - minf) * scalef, 0.0), 1.0);
             }
         }
@@ -618,92 +1196,119 @@ namespace morph {
          * 2D spatial integration of the function f. Result placed in gradf.
          *
          * For each Hex, work out the gradient in x and y directions
-         * using whatever neighbours can contribute to an estimate.
+         * using whatever neighbours can contribute to an estimate. Runs the vectorised
+         * kernel in HexKernels if the CPU supports it.
          */
         void spacegrad2D (vector<Flt>& f, array<vector<Flt>, 2>& gradf) {
+            MORPH_PHASE ("spacegrad", this->nhex * (3 * sizeof(Flt) + 6 * sizeof(int)));
+            morph::HexKernels::spacegrad2D (*this->hg, f.data(), gradf[0].data(), gradf[1].data(), this->nhex,
+                                            this->oneoverd, this->oneover2d, this->oneoverv,
+                                            this->oneover2v, this->oneover4v);
+        }
 
-            // Note - East is positive x; North is positive y.
-#pragma omp parallel for schedule(static)
-            for (unsigned int hi=0; hi<this->nhex; ++hi) {
-
-                // Find x gradient
-                if (HAS_NE(hi) && HAS_NW(hi)) {
-                    gradf[0][hi] = (f[NE(hi)] - f[NW(hi)]) * oneover2d;
-                } else if (HAS_NE(hi)) {
-                    gradf[0][hi] = (f[NE(hi)] - f[hi]) * oneoverd;
-                } else if (HAS_NW(hi)) {
-                    gradf[0][hi] = (f[hi] - f[NW(hi)]) * oneoverd;
-                } else {
-                    // zero gradient in x direction as no neighbours in
-                    // those directions? Or possibly use the average of
-                    // the gradient between the nw,ne and sw,se neighbours
-                    gradf[0][hi] = 0.0;
-                }
-
-                // Find y gradient
-                if (HAS_NNW(hi) && HAS_NNE(hi) && HAS_NSW(hi) && HAS_NSE(hi)) {
-                    // Full complement. Compute the mean of the nse->nne and nsw->nnw gradients
-                    gradf[1][hi] = ( (f[NNE(hi)] - f[NSE(hi)]) + (f[NNW(hi)] - f[NSW(hi)]) ) * oneover4v;
-                } else if (HAS_NNW(hi) && HAS_NNE(hi)) {
-                    gradf[1][hi] = ( (f[NNE(hi)] + f[NNW(hi)]) * 0.5 - f[hi]) * oneoverv;
-                } else if (HAS_NSW(hi) && HAS_NSE(hi)) {
-                    gradf[1][hi] = (f[hi] - (f[NSE(hi)] + f[NSW(hi)]) * 0.5) * oneoverv;
-                } else if (HAS_NNW(hi) && HAS_NSW(hi)) {
-                    gradf[1][hi] = (f[NNW(hi)] - f[NSW(hi)]) * oneover2v;
-                } else if (HAS_NNE(hi) && HAS_NSE(hi)) {
-                    gradf[1][hi] = (f[NNE(hi)] - f[NSE(hi)]) * oneover2v;
-                } else {
-                    // Leave grady at 0
-                    gradf[1][hi] = 0.0;
-                }
+        /*!
+         * spacegrad2D for fields held in FieldArenas; gradf is usually fa.vectorField(n)
+         * of an arena sized by resize_vector_array_arena. Runs as the vector form if all
+         * three views are contiguous (FieldLayout::SoA).
+         */
+        void spacegrad2D (const morph::FieldView<Flt>& f, array<morph::FieldView<Flt>, 2> gradf) {
+            MORPH_PHASE ("spacegrad", this->nhex * (3 * sizeof(Flt) + 6 * sizeof(int)));
+            if (f.contiguous() && gradf[0].contiguous() && gradf[1].contiguous()) {
+                morph::HexKernels::spacegrad2D (*this->hg, f.data(), gradf[0].data(), gradf[1].data(), this->nhex,
+                                                this->oneoverd, this->oneover2d, this->oneoverv,
+                                                this->oneover2v, this->oneover4v);
+                return;
             }
+            morph::HexKernels::spacegrad2D_scalar<Flt> (*this->hg, f, gradf[0], gradf[1], this->nhex,
+                                                        this->oneoverd, this->oneover2d, this->oneoverv,
+                                                        this->oneover2v, this->oneover4v);
         }
 
         /*!
-         * Compute laplacian of scalar field F, with result placed in lapF.
+         * Compute laplacian of scalar field F, with result placed in lapF. Runs the
+         * vectorised kernel in HexKernels if the CPU supports it.
          */
         virtual void compute_laplace (const vector<Flt>& F, vector<Flt>& lapF) {
-
+            MORPH_PHASE ("laplace", this->nhex * (2 * sizeof(Flt) + 6 * sizeof(int)));
             Flt norm  = (Flt)2 / (Flt)(3.0 * this->d * this->d);
+            if (this->activeSet.stepping()) {
+                const vector<unsigned int>& idx = this->activeSet.indices();
+                morph::HexKernels::laplace_indexed (*this->hg, F.data(), lapF.data(), idx.data(), idx.size(), norm);
+                return;
+            }
+            morph::HexKernels::laplace (*this->hg, F.data(), lapF.data(), this->nhex, norm);
+        }
 
+        /*!
+         * compute_laplace for fields held in FieldArenas, as compute_laplace_field. A
+         * subclass that overrides compute_laplace needs "using RD_Base<Flt>::compute_laplace;"
+         * to call this.
+         */
+        void compute_laplace (const morph::FieldView<Flt>& F, morph::FieldView<Flt> lapF) {
+            this->compute_laplace_field (F, lapF);
+        }
+
+        /*!
+         * As compute_laplace, for a field held in a FieldArena. Runs the vectorised kernel
+         * if F and lapF are contiguous (FieldLayout::SoA).
+         */
+        void compute_laplace_field (const morph::FieldView<Flt>& F, morph::FieldView<Flt> lapF) {
+            MORPH_PHASE ("laplace", this->nhex * (2 * sizeof(Flt) + 6 * sizeof(int)));
+            Flt norm  = (Flt)2 / (Flt)(3.0 * this->d * this->d);
+            if (F.contiguous() && lapF.contiguous()) {
+                morph::HexKernels::laplace (*this->hg, F.data(), lapF.data(), this->nhex, norm);
+                return;
+            }
 #pragma omp parallel for schedule(static)
             for (unsigned int hi=0; hi<this->nhex; ++hi) {
+                Flt thesum = -6 * F[hi];
+                thesum += HAS_NE(hi) ? F[NE(hi)] : F[hi];
+                thesum += HAS_NNE(hi) ? F[NNE(hi)] : F[hi];
+                thesum += HAS_NNW(hi) ? F[NNW(hi)] : F[hi];
+                thesum += HAS_NW(hi) ? F[NW(hi)] : F[hi];
+                thesum += HAS_NSW(hi) ? F[NSW(hi)] : F[hi];
+                thesum += HAS_NSE(hi) ? F[NSE(hi)] : F[hi];
+                lapF[hi] = norm * thesum;
+            }
+        }
 
-                // 1. The D Del^2 term
+        /*!
+         * Set the ghost slots of the field f for a no-flux boundary; each takes the value of
+         * the hex that it is a ghost neighbour of. Call this after f changes and before
+         * compute_laplace_ghost (f, ...).
+         */
+        void fill_ghosts (vector<Flt>& f) {
+            MORPH_PHASE ("ghosts", this->nghost * (2 * sizeof(Flt) + sizeof(int)));
+            const int* src = this->hg->d_ghostsrc.data();
+            for (unsigned int g = 0; g < this->nghost; ++g) {
+                f[this->nhex + g] = f[src[g]];
+            }
+        }
 
-                // Compute the sum around the neighbours
-                Flt thesum = -6 * F[hi];
-                if (HAS_NE(hi)) {
-                    thesum += F[NE(hi)];
-                } else {
-                    thesum += F[hi]; // A ghost neighbour-east with same value as Hex_0
-                }
-                if (HAS_NNE(hi)) {
-                    thesum += F[NNE(hi)];
-                } else {
-                    thesum += F[hi];
-                }
-                if (HAS_NNW(hi)) {
-                    thesum += F[NNW(hi)];
-                } else {
-                    thesum += F[hi];
-                }
-                if (HAS_NW(hi)) {
-                    thesum += F[NW(hi)];
-                } else {
-                    thesum += F[hi];
-                }
-                if (HAS_NSW(hi)) {
-                    thesum += F[NSW(hi)];
-                } else {
-                    thesum += F[hi];
-                }
-                if (HAS_NSE(hi)) {
-                    thesum += F[NSE(hi)];
-                } else {
-                    thesum += F[hi];
-                }
+        /*!
+         * As compute_laplace, but reads neighbours from the packed ghost table
+         * HexGrid::d_nbtab, so that the loop has no branches. F must have nhex + nghost
+         * elements with its ghost slots set by fill_ghosts(). Requires ghostNeighbours.
+         */
+        virtual void compute_laplace_ghost (const vector<Flt>& F, vector<Flt>& lapF) {
+            MORPH_PHASE ("laplace", this->nhex * (2 * sizeof(Flt) + 6 * sizeof(int)));
 
+            Flt norm  = (Flt)2 / (Flt)(3.0 * this->d * this->d);
+            const int* nb = this->hg->d_nbtab.data();
+            const unsigned int* idx = this->activeSet.stepping() ? this->activeSet.indices().data() : nullptr;
+            int m = idx ? (int)this->activeSet.indices().size() : (int)this->nhex;
+
+#pragma omp parallel for schedule(static)
+            for (int j=0; j<m; ++j) {
+                unsigned int hi = idx ? idx[j] : j;
+                const int* n = nb + 6*hi;
+                Flt thesum = -6 * F[hi];
+                thesum += F[n[HEX_NEIGHBOUR_POS_E]];
+                thesum += F[n[HEX_NEIGHBOUR_POS_NE]];
+                thesum += F[n[HEX_NEIGHBOUR_POS_NW]];
+                thesum += F[n[HEX_NEIGHBOUR_POS_W]];
+                thesum += F[n[HEX_NEIGHBOUR_POS_SW]];
+                thesum += F[n[HEX_NEIGHBOUR_POS_SE]];
                 lapF[hi] = norm * thesum;
             }
         }
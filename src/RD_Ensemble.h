@@ -0,0 +1,231 @@
+/*
+ * Runs many copies of a reaction-diffusion model, all sharing one HexGrid, in parallel.
+ */
+
+#ifndef _RD_ENSEMBLE_H_
+#define _RD_ENSEMBLE_H_
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+using std::vector;
+using std::string;
+using std::stringstream;
+using std::runtime_error;
+
+namespace morph {
+
+    /*!
+     * An ensemble of M instances of the model class Model (a class derived from
+     * RD_Base), as in a parameter sweep. The HexGrid is built once, by allocate(), and
+     * shared read-only by every member through RD_Base::useHexGrid(), so that the SVG is
+     * parsed and the grid is built once rather than M times. run() then steps the members
+     * concurrently on nthreads threads, each of which takes the next member that has not
+     * been run and steps it for all the steps before taking another. One member per
+     * thread at a time makes better use of the cores than one model's OpenMP loops do on
+     * a small grid, so when there is more than one thread, any OpenMP loops in the members
+     * are run single threaded.
+     *
+     * Each member logs to its own directory, logpath/member_NNN, so that its save() writes
+     * its own HDF5 files. The HDF5 library is not thread safe, so the members' save()
+     * calls are made one at a time. A member's step() must not use shared, mutable state
+     * such as rand(); seed a random number generator per member in the setup function
+     * passed to allocate().
+     */
+    template <class Model>
+    class RD_Ensemble
+    {
+    public:
+        /*!
+         * The parameters of the shared HexGrid, as in RD_Base. They are copied to each
+         * member.
+         */
+        //@{
+        float hextohex_d = 0.01;
+        float hexspan = 4;
+        morph::HexGridStorage hexstorage = morph::HexGridStorage::Flat;
+        bool hilbertOrder = false;
+        bool ghostNeighbours = false;
+        string svgpath = "./trial.svg";
+        //@}
+
+        /*!
+         * The directory holding the members' log directories.
+         */
+        string logpath = "logs";
+
+        /*!
+         * The number of threads for run(). 0 means one per hardware thread.
+         */
+        unsigned int nthreads = 0;
+
+        /*!
+         * The shared HexGrid, built by allocate().
+         */
+        HexGrid* hg = nullptr;
+
+        /*!
+         * The members, in the order of the index passed to the setup function.
+         */
+        vector<Model*> members;
+
+        /*!
+         * The wall time of the last run() and its throughput in member-steps per second
+         * (the number of members times the number of steps, per second).
+         */
+        //@{
+        double runSeconds = 0.0;
+        double memberStepsPerSecond = 0.0;
+        //@}
+
+        RD_Ensemble (void) {}
+
+        ~RD_Ensemble (void) {
+            this->clear();
+        }
+
+        /*!
+         * Build the HexGrid, then create M members. For each member i, setup(Model&, i) is
+         * called before the member's allocate() and init(), to set the member's parameters.
+         */
+        template <typename Setup>
+        void allocate (unsigned int M, Setup setup) {
+            this->clear();
+
+            this->hg = new HexGrid (this->hextohex_d, this->hexspan, 0,
+                                    morph::HexDomainShape::Boundary, this->hexstorage);
+            ReadCurves r (this->svgpath);
+            this->hg->setBoundary (r.getCorticalPath());
+            this->hg->computeDistanceToBoundary();
+            if (this->hilbertOrder == true) {
+                this->hg->reorderHilbert();
+            }
+            if (this->ghostNeighbours == true) {
+                this->hg->populate_d_ghosts();
+            }
+
+            morph::Tools::createDir (this->logpath);
+            for (unsigned int i = 0; i < M; ++i) {
+                Model* m = new Model();
+                this->members.push_back (m);
+                m->hextohex_d = this->hextohex_d;
+                m->hexspan = this->hexspan;
+                m->hexstorage = this->hexstorage;
+                m->hilbertOrder = this->hilbertOrder;
+                m->ghostNeighbours = this->ghostNeighbours;
+                m->svgpath = this->svgpath;
+                stringstream mpath;
+                mpath << this->logpath << "/member_" << std::setw(3) << std::setfill('0') << i;
+                m->setLogpath (mpath.str());
+                m->useHexGrid (this->hg);
+                setup (*m, i);
+                m->allocate();
+                m->init();
+            }
+        }
+
+        /*!
+         * Step every member nsteps times. If saveEvery is non-zero, each member's save() is
+         * called after every saveEvery of its steps. Exceptions thrown by a member are
+         * rethrown here once all the threads have finished.
+         */
+        void run (unsigned int nsteps, unsigned int saveEvery = 0) {
+            unsigned int M = this->members.size();
+            unsigned int nt = this->nthreads;
+            if (nt == 0) {
+                nt = std::thread::hardware_concurrency();
+            }
+            if (nt == 0) {
+                nt = 1;
+            }
+            if (nt > M) {
+                nt = M;
+            }
+
+            std::atomic<unsigned int> next (0);
+            std::mutex saveMutex;
+            vector<std::exception_ptr> errors (M);
+
+            auto worker = [&](bool pooled) {
+#ifdef _OPENMP
+                if (pooled) {
+                    omp_set_num_threads (1);
+                }
+#endif
+                unsigned int i;
+                while ((i = next++) < M) {
+                    try {
+                        Model* m = this->members[i];
+                        for (unsigned int s = 1; s <= nsteps; ++s) {
+                            m->step();
+                            if (saveEvery > 0 && s % saveEvery == 0) {
+                                std::lock_guard<std::mutex> lock (saveMutex);
+                                m->save();
+                            }
+                        }
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+
+            auto t0 = std::chrono::steady_clock::now();
+            if (nt <= 1) {
+                worker (false);
+            } else {
+                vector<std::thread> pool;
+                for (unsigned int t = 0; t < nt; ++t) {
+                    pool.emplace_back (worker, true);
+                }
+                for (std::thread& t : pool) {
+                    t.join();
+                }
+            }
+            auto t1 = std::chrono::steady_clock::now();
+
+            this->runSeconds = std::chrono::duration<double>(t1 - t0).count();
+            this->memberStepsPerSecond = this->runSeconds > 0.0
+                ? (double)M * nsteps / this->runSeconds : 0.0;
+
+            for (unsigned int i = 0; i < M; ++i) {
+                if (errors[i]) {
+                    std::rethrow_exception (errors[i]);
+                }
+            }
+        }
+
+        //! The number of members
+        unsigned int size (void) const { return this->members.size(); }
+
+        //! Member i
+        Model& operator[] (unsigned int i) { return *this->members[i]; }
+
+    private:
+        //! Delete the members, then the grid that they share
+        void clear (void) {
+            for (Model* m : this->members) {
+                delete m;
+            }
+            this->members.clear();
+            delete this->hg;
+            this->hg = nullptr;
+        }
+    };
+
+} // namespace morph
+
+#endif // _RD_ENSEMBLE_H_
@@ -12,6 +12,7 @@
 
 #include "morph/display.h"
 #include "morph/HexGrid.h"
+#include "morph/Instrument.h"
 #include <iostream>
 #include <vector>
 #include <array>
@@ -111,6 +112,7 @@ namespace morph {
                            HexGrid* hg,
                            vector<vector<Flt> >& f,
                            Flt mina = +1e7, Flt maxa = -1e7, Flt overallOffset = 0.0) {
+            MORPH_PHASE ("plot", 0);
 
             disp.resetDisplay (this->fix, this->eye, this->rot);
 
@@ -178,6 +180,7 @@ namespace morph {
                                    vector<vector<Flt> >& f,
                                    Flt mina = +1e7, Flt maxa = -1e7,
                                    Flt hOffset = 0.0, Flt vOffset = 0.0, Flt spacescale = 1.0) {
+            MORPH_PHASE ("plot", 0);
 
             unsigned int N = f.size();
             unsigned int nhex = hg->num();
@@ -498,6 +501,7 @@ namespace morph {
          */
         void savePngs (const string& logpath, const string& name,
                        unsigned int frameN, Gdisplay& disp) {
+            MORPH_PHASE ("plot_png", 0);
             stringstream ff1;
             ff1 << logpath << "/" << name<< "_";
             ff1 << std::setw(5) << std::setfill('0') << frameN;
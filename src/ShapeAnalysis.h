@@ -10,6 +10,7 @@
 #include <stdexcept>
 #include "Hex.h"
 #include "HexGrid.h"
+#include "MathAlgo.h"
 #include "DirichDom.h"
 #include "DirichVtx.h"
 #include "MorphDbg.h"
@@ -48,6 +49,28 @@ namespace morph {
     {
     public:
 
+        /*!
+         * The max and min of the scalar fields f over the hexes of hg for which
+         * Hex::onBoundary() is false - those with all six neighbours, which is tested on
+         * hg->d_flags. Hexes marked HEX_IS_BOUNDARY that have six neighbours are included,
+         * as they were when get_contours and get_contour_map tested onBoundary(). If there
+         * are no such hexes, returns (-1e7, 1e7).
+         */
+        static pair<Flt, Flt> inner_maxmin (HexGrid* hg, vector<vector<Flt> >& f) {
+            Flt maxf = -1e7;
+            Flt minf = +1e7;
+            const vector<unsigned int>& flags = hg->d_flags;
+            auto inner = [&flags](size_t h) {
+                return h < flags.size() && (flags[h] & HEX_HAS_NEIGHB_ALL) == HEX_HAS_NEIGHB_ALL;
+            };
+            for (unsigned int i = 0; i < f.size(); ++i) {
+                pair<Flt, Flt> mm = MathAlgo<Flt>::maxmin_if (f[i], inner);
+                if (mm.first > maxf) { maxf = mm.first; }
+                if (mm.second < minf) { minf = mm.second; }
+            }
+            return make_pair (maxf, minf);
+        }
+
         /*!
          * Obtain the contours (as a vector of list<Hex>) in the scalar fields f, where threshold is
          * crossed.
@@ -66,16 +89,9 @@ namespace morph {
                 rtn.push_back (lh);
             }
 
-            Flt maxf = -1e7;
-            Flt minf = +1e7;
-            for (auto h : hg->hexen) {
-                if (h.onBoundary() == false) {
-                    for (unsigned int i = 0; i<N; ++i) {
-                        if (f[i][h.vi] > maxf) { maxf = f[i][h.vi]; }
-                        if (f[i][h.vi] < minf) { minf = f[i][h.vi]; }
-                    }
-                }
-            }
+            pair<Flt, Flt> mm = ShapeAnalysis<Flt>::inner_maxmin (hg, f);
+            Flt maxf = mm.first;
+            Flt minf = mm.second;
             Flt scalef = 1.0 / (maxf-minf);
 
             // Re-normalize
@@ -129,16 +145,9 @@ namespace morph {
 
             vector<Flt> rtn (nhex, 0.0);
 
-            Flt maxf = -1e7;
-            Flt minf = +1e7;
-            for (auto h : hg->hexen) {
-                if (h.onBoundary() == false) {
-                    for (unsigned int i = 0; i<N; ++i) {
-                        if (f[i][h.vi] > maxf) { maxf = f[i][h.vi]; }
-                        if (f[i][h.vi] < minf) { minf = f[i][h.vi]; }
-                    }
-                }
-            }
+            pair<Flt, Flt> mm = ShapeAnalysis<Flt>::inner_maxmin (hg, f);
+            Flt maxf = mm.first;
+            Flt minf = mm.second;
             Flt scalef = 1.0 / (maxf-minf);
 
             // Re-normalize
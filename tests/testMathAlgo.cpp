@@ -1,5 +1,13 @@
 #include "MathAlgo.h"
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "ShapeAnalysis.h"
+#include "tools.h"
 #include <iostream>
+#include <cmath>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 
 using namespace morph;
 using namespace std;
@@ -90,5 +98,129 @@ int main()
         rtn--;
     }
 
+    // The parallel reductions on a field bigger than one block, compared with sums in
+    // double precision, and repeated with other thread counts
+    unsigned int nbig = 1000003;
+    vector<float> big (nbig);
+    double dsum = 0.0;
+    for (unsigned int i = 0; i < nbig; ++i) {
+        big[i] = 100.0f + std::sin (0.001f * i) + 0.25f * std::cos (0.37f * i);
+        dsum += big[i];
+    }
+    double dmean = dsum / nbig;
+    double dvar = 0.0;
+    for (unsigned int i = 0; i < nbig; ++i) { dvar += (big[i] - dmean) * (big[i] - dmean); }
+    dvar /= (nbig - 1);
+    big[777777] = 200.0f;
+    big[888888] = 200.0f; // A tie; argmax must give the first
+    big[12345] = -5.0f;
+    dsum += 2.0 * 200.0 - (100.0 + std::sin (0.001f * 777777) + 0.25 * std::cos (0.37f * 777777));
+    dsum -= (100.0 + std::sin (0.001f * 888888) + 0.25 * std::cos (0.37f * 888888));
+    dsum += -5.0 - (100.0 + std::sin (0.001f * 12345) + 0.25 * std::cos (0.37f * 12345));
+
+    float s1 = MathAlgo<float>::sum (big);
+    float m1 = 0.0f, v1 = 0.0f;
+    vector<float> noextremes = big;
+    noextremes[777777] = noextremes[777776];
+    noextremes[888888] = noextremes[888887];
+    noextremes[12345] = noextremes[12344];
+    MathAlgo<float>::mean_var (noextremes, m1, v1);
+    if (std::abs (s1 - dsum) / dsum > 1e-6) {
+        cout << "Parallel sum " << s1 << " differs from " << dsum << endl;
+        rtn--;
+    }
+    if (std::abs (m1 - dmean) > 1e-4 || std::abs (v1 - dvar) / dvar > 1e-3) {
+        cout << "Parallel mean/var " << m1 << "/" << v1 << " differ from " << dmean << "/" << dvar << endl;
+        rtn--;
+    }
+    pair<float, float> mmbig = MathAlgo<float>::maxmin (big);
+    if (mmbig.first != 200.0f || mmbig.second != -5.0f) {
+        cout << "Parallel maxmin wrong" << endl;
+        rtn--;
+    }
+    if (MathAlgo<float>::argmax (big) != 777777 || MathAlgo<float>::argmin (big) != 12345) {
+        cout << "argmax/argmin wrong" << endl;
+        rtn--;
+    }
+    pair<float, float> mmif = MathAlgo<float>::maxmin_if (big, [](size_t i) { return i < 500000; });
+    if (mmif.first >= 200.0f || mmif.second != -5.0f) {
+        cout << "maxmin_if wrong" << endl;
+        rtn--;
+    }
+    vector<unsigned int> hist = MathAlgo<float>::histogram (big, 98.0f, 102.0f, 8);
+    unsigned int htotal = 0;
+    for (auto c : hist) { htotal += c; }
+    if (htotal != nbig || hist[0] != 1 || hist[7] != 2) {
+        cout << "Histogram wrong: total " << htotal << ", ends " << hist[0] << " " << hist[7] << endl;
+        rtn--;
+    }
+
+#ifdef _OPENMP
+    int maxthreads = omp_get_max_threads();
+    for (int nt = 1; nt <= 5; nt += 2) {
+        omp_set_num_threads (nt);
+        float mt = 0.0f, vt = 0.0f;
+        MathAlgo<float>::mean_var (noextremes, mt, vt);
+        if (MathAlgo<float>::sum (big) != s1 || mt != m1 || vt != v1
+            || MathAlgo<float>::histogram (big, 98.0f, 102.0f, 8) != hist) {
+            cout << "Reductions differ on " << nt << " threads" << endl;
+            rtn--;
+        }
+    }
+    omp_set_num_threads (maxthreads);
+#endif
+
+    // ShapeAnalysis::inner_maxmin, which uses maxmin_if over HexGrid::d_flags, gives the
+    // same range as a loop over the hexes that aren't onBoundary(). On trial.svg, some hexes
+    // marked HEX_IS_BOUNDARY have all six neighbours, so aren't onBoundary(); they're given
+    // the largest values counted, and the hexes that are onBoundary() values outside them.
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+        HexGrid hg(0.01, 3, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        vector<vector<float> > fields (2, vector<float>(hg.num(), 0.0f));
+        float oldmax = -1e7;
+        float oldmin = +1e7;
+        unsigned int surrounded = 0;
+        for (auto h : hg.hexen) {
+            fields[0][h.vi] = h.x;
+            fields[1][h.vi] = h.y;
+            if (h.onBoundary() == true) {
+                fields[0][h.vi] = 20.0f;
+                fields[1][h.vi] = -20.0f;
+            } else if (h.boundaryHex() == true) {
+                fields[0][h.vi] = 10.0f;
+                fields[1][h.vi] = -10.0f;
+                ++surrounded;
+            }
+        }
+        for (auto h : hg.hexen) {
+            if (h.onBoundary() == false) {
+                for (unsigned int i = 0; i < 2; ++i) {
+                    if (fields[i][h.vi] > oldmax) { oldmax = fields[i][h.vi]; }
+                    if (fields[i][h.vi] < oldmin) { oldmin = fields[i][h.vi]; }
+                }
+            }
+        }
+        pair<float, float> newmm = ShapeAnalysis<float>::inner_maxmin (&hg, fields);
+        if (newmm.first != oldmax || newmm.second != oldmin) {
+            cout << "inner_maxmin gives (" << newmm.first << "," << newmm.second
+                 << ") not (" << oldmax << "," << oldmin << ")" << endl;
+            rtn--;
+        }
+        if (surrounded == 0) {
+            cout << "Expected some HEX_IS_BOUNDARY hexes with six neighbours" << endl;
+            rtn--;
+        }
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+        rtn--;
+    }
+
     return rtn;
 }
@@ -0,0 +1,282 @@
+/*
+ * Test RDCheckpoint, which writes snapshots of model state to HDF5 on a background thread,
+ * along with the parts of HexGrid and HdfData that restoring from a checkpoint relies on:
+ * a reordered HexGrid surviving save() and load(), the HexGrid written by the writer
+ * thread without being changed, and 2D reads with read_ptrarray_vals. Then checkpoints
+ * and restores an RD_Base model.
+ */
+
+#include "RDCheckpoint.h"
+#include "RD_Base.h"
+#include "FieldArena.h"
+#include "HexGrid.h"
+#include "HdfData.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+using namespace morph;
+using namespace std;
+
+// A model whose one field counts its steps
+class CountModel : public RD_Base<double>
+{
+public:
+    vector<double> u;
+    void allocate (void) {
+        RD_Base<double>::allocate();
+        this->resize_vector_variable (this->u);
+        this->checkpointField ("u", this->u);
+    }
+    void init (void) {
+        for (unsigned int h = 0; h < this->nhex; ++h) { this->u[h] = this->hg->d_x[h]; }
+    }
+    void step (void) {
+        for (unsigned int h = 0; h < this->nhex; ++h) { this->u[h] += 1.0; }
+        ++this->stepCount;
+    }
+};
+
+// True if the Hexes saved in two HexGrid files are the same
+bool sameHexen (const string& f1, const string& f2)
+{
+    HexGrid g1 (f1);
+    HexGrid g2 (f2);
+    if (g1.num() != g2.num() || g1.d_x != g2.d_x || g1.d_ne != g2.d_ne || g1.d_flags != g2.d_flags) {
+        return false;
+    }
+    auto h2 = g2.hexen.begin();
+    for (const Hex& h1 : g1.hexen) {
+        if (h1.vi != h2->vi || h1.di != h2->di || h1.ri != h2->ri || h1.gi != h2->gi
+            || h1.x != h2->x || h1.y != h2->y || h1.getFlags() != h2->getFlags()) {
+            return false;
+        }
+        ++h2;
+    }
+    return true;
+}
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+        HexGrid hg(0.02, 3, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        hg.computeDistanceToBoundary();
+        hg.reorderHilbert();
+        unsigned int n = hg.num();
+
+        // A reordered grid comes back from save() and load() in the same order
+        hg.save ("testcheckpoint_grid.h5");
+        HexGrid hg2 ("testcheckpoint_grid.h5");
+        if (hg2.num() != n || hg2.d_x != hg.d_x || hg2.d_ne != hg.d_ne || hg2.d_nse != hg.d_nse
+            || hg2.d_flags != hg.d_flags || hg2.d_canonical != hg.d_canonical
+            || hg2.d_distToBoundary != hg.d_distToBoundary) {
+            cerr << "The HexGrid loaded differs from the one saved" << endl;
+            rtn = -1;
+        }
+
+        // Write several checkpoints, changing the state after each is submitted
+        vector<vector<double> > fields (2, vector<double>(n, 0.0));
+        FieldArena<double> soa (3, n, FieldLayout::SoA);
+        FieldArena<double> inter (2, n, FieldLayout::Interleaved);
+        RDCheckpoint<double> cp;
+        const unsigned int ncp = 5;
+        for (unsigned int k = 0; k < ncp; ++k) {
+            for (unsigned int h = 0; h < n; ++h) {
+                fields[0][h] = k + 0.001 * h;
+                fields[1][h] = -(double)k * h;
+                for (unsigned int i = 0; i < 3; ++i) { soa[i][h] = 100.0 * i + k + h; }
+                for (unsigned int i = 0; i < 2; ++i) { inter[i][h] = 10.0 * i - k * 0.5 * h; }
+            }
+            RDCheckpointState<double>& s = cp.acquire();
+            s.fieldNames = { "a", "b" };
+            s.fields = fields;
+            s.arenaNames = { "soa", "inter" };
+            s.arenas = { soa, inter };
+            s.gridfile = "testcheckpoint_grid.h5";
+            s.dt = 0.01 * (k + 1);
+            s.stepCount = 100 * k;
+            s.simTime = 0.5 * k;
+            s.nextSaveTime = 0.5 * k + 0.25;
+            s.rngSeed = 0xfeedbeefULL + k;
+            cp.submit ("testcheckpoint_" + to_string(k) + ".h5");
+            fields[0].assign (n, -1.0);
+            soa.zero();
+        }
+        cp.wait();
+        if (cp.written() != ncp || cp.busy()) {
+            cerr << "Expected " << ncp << " checkpoints written, got " << cp.written() << endl;
+            rtn = -1;
+        }
+
+        for (unsigned int k = 0; k < ncp && rtn == 0; ++k) {
+            string fname = "testcheckpoint_" + to_string(k) + ".h5";
+            if (ifstream (fname + ".tmp").good()) {
+                cerr << "Temporary file left behind for " << fname << endl;
+                rtn = -1;
+            }
+            HdfData d (fname, true);
+            string gridfile;
+            double dt = 0.0;
+            unsigned int stepCount = 0;
+            double t = 0.0;
+            double nst = 0.0;
+            unsigned long long int seed = 0;
+            d.read_string ("/gridfile", gridfile);
+            d.read_val ("/dt", dt);
+            d.read_val ("/stepCount", stepCount);
+            d.read_val ("/t", t);
+            d.read_val ("/nextSaveTime", nst);
+            d.read_val ("/rng_seed", seed);
+            if (gridfile != "testcheckpoint_grid.h5" || dt != 0.01 * (k + 1) || stepCount != 100 * k
+                || t != 0.5 * k || nst != 0.5 * k + 0.25 || seed != 0xfeedbeefULL + k) {
+                cerr << "Wrong scalars in " << fname << endl;
+                rtn = -1;
+            }
+            vector<double> a;
+            vector<double> b;
+            d.read_contained_vals ("/fields/a", a);
+            d.read_contained_vals ("/fields/b", b);
+            FieldArena<double> soa2 (3, n, FieldLayout::SoA);
+            FieldArena<double> inter2 (2, n, FieldLayout::Interleaved);
+            d.read_ptrarray_vals ("/arenas/soa", soa2.data(), 3, n, soa2.fieldStride());
+            d.read_ptrarray_vals ("/arenas/inter", inter2.data(), n, 2, 2);
+            for (unsigned int h = 0; h < n && rtn == 0; ++h) {
+                bool ok = a.size() == n && b.size() == n
+                    && a[h] == k + 0.001 * h && b[h] == -(double)k * h;
+                for (unsigned int i = 0; i < 3; ++i) { ok = ok && soa2[i][h] == 100.0 * i + k + h; }
+                for (unsigned int i = 0; i < 2; ++i) { ok = ok && inter2[i][h] == 10.0 * i - k * 0.5 * h; }
+                if (!ok) {
+                    cerr << "Wrong field values in " << fname << " at hex " << h << endl;
+                    rtn = -1;
+                }
+            }
+            // A read of the wrong shape is refused
+            bool threw = false;
+            try {
+                d.read_ptrarray_vals ("/arenas/soa", soa2.data(), 2, n, soa2.fieldStride());
+            } catch (const runtime_error& e) {
+                threw = true;
+            }
+            if (!threw || !d.exists ("/arenas/soa") || d.exists ("/arenas/nothing") || d.exists ("/nogroup/x")) {
+                cerr << "read_ptrarray_vals accepted the wrong shape, or exists() is wrong" << endl;
+                rtn = -1;
+            }
+        }
+
+        // A failed write is reported by wait(), and the writer carries on afterwards
+        RDCheckpointState<double>& s = cp.acquire();
+        s.fieldNames = { "a" };
+        s.fields = { fields[0] };
+        s.arenaNames.clear();
+        s.arenas.clear();
+        cp.submit ("no_such_directory/testcheckpoint.h5");
+        bool threw = false;
+        try {
+            cp.wait();
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        cp.acquire();
+        cp.submit ("testcheckpoint_last.h5");
+        cp.wait();
+        if (!threw || cp.written() != ncp + 1) {
+            cerr << "Write failure not reported, or the writer stopped after it" << endl;
+            rtn = -1;
+        }
+
+        // An HdfData held open on this thread doesn't hold up the writer
+        {
+            HdfData held ("testcheckpoint_held.h5");
+            for (unsigned int k = 0; k < 2; ++k) {
+                cp.acquire();
+                cp.submit ("testcheckpoint_held_" + to_string(k) + ".h5");
+            }
+            cp.wait();
+            held.add_val ("/written", cp.written());
+        }
+        if (cp.written() != ncp + 3) {
+            cerr << "Checkpoints weren't written while an HdfData was open" << endl;
+            rtn = -1;
+        }
+
+        // The writer writes a grid given with the state first, without changing the grid
+        {
+            const Hex* front = &hg.hexen.front();
+            vector<unsigned int> vis;
+            for (const Hex& h : hg.hexen) { vis.push_back (h.vi); }
+            RDCheckpointState<double>& gs = cp.acquire();
+            gs.grid = &hg;
+            gs.gridpath = "testcheckpoint_writtengrid.h5";
+            cp.submit ("testcheckpoint_withgrid.h5");
+            cp.wait();
+            gs.grid = nullptr;
+            vector<unsigned int> vis2;
+            for (const Hex& h : hg.hexen) { vis2.push_back (h.vi); }
+            if (&hg.hexen.front() != front || vis2 != vis) {
+                cerr << "Writing the grid changed its Hexes" << endl;
+                rtn = -1;
+            }
+            if (!sameHexen ("testcheckpoint_grid.h5", "testcheckpoint_writtengrid.h5")) {
+                cerr << "The grid written by the writer differs from the one saved" << endl;
+                rtn = -1;
+            }
+        }
+
+        // HexGrid::write of a grid held flat gives the file that save() gives
+        {
+            HexGrid hgf (0.02, 3, 0, HexDomainShape::Boundary);
+            hgf.setBoundary (r.getCorticalPath());
+            hgf.write ("testcheckpoint_flat_w.h5");
+            hgf.save ("testcheckpoint_flat_s.h5");
+            if (!sameHexen ("testcheckpoint_flat_w.h5", "testcheckpoint_flat_s.h5")) {
+                cerr << "HexGrid::write and save give different files" << endl;
+                rtn = -1;
+            }
+        }
+
+        // An RD_Base model: the first checkpoint has the grid written alongside it, and the
+        // model restored from the checkpoint carries on as the original does
+        {
+            CountModel m;
+            m.svgpath = curvepath;
+            m.checkpointPath = "testcheckpoint_model.h5";
+            m.allocate();
+            m.init();
+            m.step();
+            m.checkpoint();
+            m.step();
+            m.checkpoint();
+            m.checkpointWait();
+            m.step();
+            if (m.checkpointGrid != "./checkpoint_grid.h5" || !Tools::fileExists (m.checkpointGrid)) {
+                cerr << "The model's grid wasn't written to " << m.checkpointGrid << endl;
+                rtn = -1;
+            }
+            CountModel m2;
+            m2.restoreCheckpoint ("testcheckpoint_model.h5");
+            m2.step();
+            if (m2.stepCount != m.stepCount || m2.u != m.u || m2.hg->d_x != m.hg->d_x) {
+                cerr << "The restored model differs from the original" << endl;
+                rtn = -1;
+            }
+            Tools::unlinkFile (m.checkpointGrid);
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,277 @@
+/*
+ * Test FieldArena in both layouts: element access through the views and their iterators,
+ * alignment, copying and writing the whole arena to HDF5 in one call. Checks that
+ * RD_Base's FieldView overloads give the same fields as its vector forms. Reports the
+ * time to snapshot a FieldArena against a vector of vectors of the same size.
+ */
+
+#include "FieldArena.h"
+#include "RD_Base.h"
+#include "HdfData.h"
+#include "tools.h"
+#include <hdf5.h>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int testLayout (FieldLayout layout)
+{
+    int rtn = 0;
+    unsigned int nf = 7;
+    unsigned int n = 1001;
+    FieldArena<float> fa (nf, n, layout);
+
+    if (reinterpret_cast<uintptr_t>(fa.data()) % 64 != 0) {
+        cerr << "Arena is not aligned to 64 bytes" << endl;
+        rtn = -1;
+    }
+    if (layout == FieldLayout::SoA) {
+        for (unsigned int i = 0; i < nf; ++i) {
+            if (reinterpret_cast<uintptr_t>(fa[i].data()) % 64 != 0) {
+                cerr << "SoA field " << i << " doesn't start on a cache line" << endl;
+                rtn = -1;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < nf; ++i) {
+        for (unsigned int h = 0; h < n; ++h) {
+            fa[i][h] = i * 10000.0f + h;
+        }
+    }
+    // The views must not overlap
+    for (unsigned int i = 0; i < nf; ++i) {
+        for (unsigned int h = 0; h < n; ++h) {
+            if (fa[i][h] != i * 10000.0f + h) {
+                cerr << "Wrong value at field " << i << " element " << h << endl;
+                return -1;
+            }
+        }
+    }
+
+    // The iterators visit the elements of a view in order, in either layout
+    {
+        unsigned int h = 0;
+        for (float v : fa[2]) {
+            if (v != 20000.0f + h) {
+                cerr << "Range-for gives the wrong value at element " << h << endl;
+                return -1;
+            }
+            ++h;
+        }
+        if (h != n || fa[2].end() - fa[2].begin() != (long)n) {
+            cerr << "The iterators span " << h << " elements" << endl;
+            rtn = -1;
+        }
+        const FieldArena<float>& cfa = fa;
+        if (*std::max_element (cfa[4].begin(), cfa[4].end()) != 40000.0f + n - 1
+            || std::accumulate (fa[1].begin(), fa[1].end(), 0.0) != 10000.0 * n + (n - 1) * n / 2.0) {
+            cerr << "Standard algorithms give the wrong results over a view" << endl;
+            rtn = -1;
+        }
+        // Writing through an iterator touches only its own field
+        std::fill (fa[5].begin() + 10, fa[5].begin() + 20, -2.0f);
+        if (fa[5][9] != 50009.0f || fa[5][10] != -2.0f || fa[5][19] != -2.0f
+            || fa[5][20] != 50020.0f || fa[4][15] != 40015.0f || fa[6][15] != 60015.0f) {
+            cerr << "std::fill through the iterators wrote the wrong elements" << endl;
+            rtn = -1;
+        }
+        for (unsigned int h = 10; h < 20; ++h) { fa[5][h] = 50000.0f + h; }
+
+        // vectorField gives two successive fields as the x and y of one vector field
+        array<FieldView<float>, 2> vf = fa.vectorField (1);
+        if (vf[0][7] != 20007.0f || vf[1][7] != 30007.0f) {
+            cerr << "vectorField(1) isn't fields 2 and 3" << endl;
+            rtn = -1;
+        }
+    }
+
+    // A copy is a snapshot
+    FieldArena<float> snap = fa;
+    fa[3][5] = -1.0f;
+    if (snap[3][5] != 30005.0f || snap.size() != nf || snap.fieldSize() != n) {
+        cerr << "Copy doesn't hold the values at the time it was made" << endl;
+        rtn = -1;
+    }
+    fa = snap;
+    if (fa[3][5] != 30005.0f) {
+        cerr << "Assignment failed" << endl;
+        rtn = -1;
+    }
+
+    // One write of the whole arena, read back with the HDF5 API
+    {
+        HdfData data("testfieldarena.h5");
+        if (layout == FieldLayout::SoA) {
+            data.add_ptrarray_vals ("/fields", fa.data(), nf, n, fa.fieldStride());
+        } else {
+            data.add_ptrarray_vals ("/fields", fa.data(), n, nf, nf);
+        }
+    }
+    hid_t file_id = H5Fopen ("testfieldarena.h5", H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset_id = H5Dopen2 (file_id, "/fields", H5P_DEFAULT);
+    hid_t space_id = H5Dget_space (dataset_id);
+    hsize_t dims[2] = { 0, 0 };
+    H5Sget_simple_extent_dims (space_id, dims, NULL);
+    vector<float> readback (dims[0] * dims[1]);
+    H5Dread (dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, readback.data());
+    H5Sclose (space_id);
+    H5Dclose (dataset_id);
+    H5Fclose (file_id);
+    bool soa = (layout == FieldLayout::SoA);
+    if (dims[0] != (soa ? nf : n) || dims[1] != (soa ? n : nf)) {
+        cerr << "Dataset has the wrong shape" << endl;
+        rtn = -1;
+    } else {
+        for (unsigned int i = 0; i < nf; ++i) {
+            for (unsigned int h = 0; h < n; ++h) {
+                float v = soa ? readback[i*n + h] : readback[h*nf + i];
+                if (v != fa[i][h]) {
+                    cerr << "HDF5 value differs at field " << i << " element " << h << endl;
+                    return -1;
+                }
+            }
+        }
+    }
+    return rtn;
+}
+
+// A model with nothing to integrate, to reach RD_Base's field helpers
+class FieldModel : public RD_Base<double>
+{
+public:
+    void init (void) {}
+    void step (void) {}
+};
+
+/*!
+ * RD_Base's FieldView overloads against its vector forms, with the fields in a FieldArena
+ * in the given layout.
+ */
+int testRDBase (FieldModel& m, FieldLayout layout)
+{
+    int rtn = 0;
+    unsigned int n = m.nhex;
+
+    vector<double> f;
+    vector<double> lapf;
+    m.resize_vector_variable (f);
+    m.resize_vector_variable (lapf);
+    array<vector<double>, 2> gradf;
+    m.resize_gradient_field (gradf);
+
+    FieldArena<double> sc (2, m.nhex + m.nghost, layout);
+    FieldArena<double> grads;
+    m.resize_vector_array_arena (grads, 2, layout);
+    FieldArena<double> grads2;
+    m.resize_vector_vector_array_arena (grads2, 2, 3, layout);
+    if (grads.size() != 4 || grads2.size() != 12 || grads2.fieldSize() != n + m.nghost) {
+        cerr << "The vector-field arenas are the wrong size" << endl;
+        rtn = -1;
+    }
+
+    for (unsigned int h = 0; h < n; ++h) {
+        f[h] = std::sin (10.0 * m.hg->d_x[h]) * std::cos (7.0 * m.hg->d_y[h]);
+        sc[0][h] = f[h];
+    }
+
+    m.compute_laplace (f, lapf);
+    m.compute_laplace (sc[0], sc[1]);
+    m.spacegrad2D (f, gradf);
+    m.spacegrad2D (sc[0], grads.vectorField (1));
+    m.spacegrad2D (sc[0], grads2.vectorField (1*2 + 0));
+    for (unsigned int h = 0; h < n; ++h) {
+        if (sc[1][h] != lapf[h]) {
+            cerr << "compute_laplace(FieldView) differs at hex " << h << endl;
+            return -1;
+        }
+        if (grads[2][h] != gradf[0][h] || grads[3][h] != gradf[1][h]
+            || grads2[4][h] != gradf[0][h] || grads2[5][h] != gradf[1][h]) {
+            cerr << "spacegrad2D(FieldView) differs at hex " << h << endl;
+            return -1;
+        }
+        if (grads[0][h] != 0.0 || grads[1][h] != 0.0) {
+            cerr << "spacegrad2D(FieldView) wrote to the wrong vector field" << endl;
+            return -1;
+        }
+    }
+
+    m.normalise (f);
+    m.normalise (sc[0]);
+    for (unsigned int h = 0; h < n; ++h) {
+        if (sc[0][h] != f[h]) {
+            cerr << "normalise(FieldView) differs at hex " << h << endl;
+            return -1;
+        }
+    }
+
+    srand (42);
+    m.noiseify_vector_variable (f, 0.5, 0.1);
+    srand (42);
+    m.noiseify_vector_variable (sc[0], 0.5, 0.1);
+    m.noiseify_vector_variable (lapf, 0.5, 0.1, 3);
+    m.noiseify_vector_variable (sc[1], 0.5, 0.1, 3);
+    for (unsigned int h = 0; h < n; ++h) {
+        if (sc[0][h] != f[h] || sc[1][h] != lapf[h]) {
+            cerr << "noiseify_vector_variable(FieldView) differs at hex " << h << endl;
+            return -1;
+        }
+    }
+    return rtn;
+}
+
+int main()
+{
+    int rtn = 0;
+    if (testLayout (FieldLayout::SoA) != 0) { rtn = -1; }
+    if (testLayout (FieldLayout::Interleaved) != 0) { rtn = -1; }
+
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        FieldModel m;
+        m.svgpath = curvepath;
+        m.allocate();
+        if (testRDBase (m, FieldLayout::SoA) != 0) { rtn = -1; }
+        if (testRDBase (m, FieldLayout::Interleaved) != 0) { rtn = -1; }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // Snapshot cost: 50 fields of 100000 values
+    unsigned int nf = 50;
+    unsigned int n = 100000;
+    FieldArena<double> fa (nf, n);
+    vector<vector<double> > vv (nf, vector<double>(n, 0.0));
+    unsigned int reps = 20;
+    steady_clock::time_point t0 = steady_clock::now();
+    for (unsigned int r = 0; r < reps; ++r) {
+        FieldArena<double> snap = fa;
+        fa[r % nf][0] = snap[0][0] + 1.0;
+    }
+    steady_clock::time_point t1 = steady_clock::now();
+    for (unsigned int r = 0; r < reps; ++r) {
+        vector<vector<double> > snap = vv;
+        vv[r % nf][0] = snap[0][0] + 1.0;
+    }
+    steady_clock::time_point t2 = steady_clock::now();
+    cout << "Snapshot of " << nf << " fields of " << n << ": FieldArena "
+         << duration_cast<microseconds>(t1-t0).count()/reps << " us; vector of vectors "
+         << duration_cast<microseconds>(t2-t1).count()/reps << " us" << endl;
+
+    return rtn;
+}
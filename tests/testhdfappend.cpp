@@ -0,0 +1,211 @@
+/*
+ * Test HdfData::append_vals, which appends frames to one chunked, extendible 2D dataset
+ * that it holds open between appends, and compare its throughput and file size with
+ * writing a dataset per frame (the /c_0_t1000 style).
+ */
+
+#include "HdfData.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+using morph::HdfData;
+using morph::HdfChunking;
+
+// A smooth, slowly changing field, like an RD pattern
+template <typename T>
+void frame (vector<T>& f, unsigned int t)
+{
+    for (unsigned int h = 0; h < f.size(); ++h) {
+        f[h] = (T)(0.5 + 0.5 * sin (0.01 * h + 0.05 * t) * cos (0.003 * h));
+    }
+}
+
+long long int fileSize (const string& fname)
+{
+    ifstream f (fname, ios::binary | ios::ate);
+    return f.good() ? (long long int)f.tellg() : -1;
+}
+
+// Read the whole 2D dataset and check it against frame()
+template <typename T>
+bool check (HdfData& d, const char* path, unsigned int nframes, unsigned int n)
+{
+    if (d.num_rows (path) != nframes) {
+        cerr << path << " has " << d.num_rows (path) << " rows, not " << nframes << endl;
+        return false;
+    }
+    vector<T> all (nframes * n);
+    d.read_ptrarray_vals (path, all.data(), nframes, n, n);
+    vector<T> f (n);
+    for (unsigned int t = 0; t < nframes; ++t) {
+        frame (f, t);
+        for (unsigned int h = 0; h < n; ++h) {
+            if (all[t * n + h] != f[h]) {
+                cerr << path << " differs at frame " << t << ", element " << h << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int n = 10000;
+    vector<double> f (n);
+    vector<float> ff (n);
+
+    try {
+        // Append to a new file, then reopen it and append more
+        {
+            HdfData d ("testhdfappend.h5");
+            HdfChunking small;
+            small.rows = 4;
+            small.cols = 1000;
+            for (unsigned int t = 0; t < 10; ++t) {
+                frame (f, t);
+                frame (ff, t);
+                d.append_vals ("/c_0", f, small);
+                d.append_vals ("/group/cf", ff);
+            }
+            // Both datasets are held open between appends, until clear_cache()
+            if (d.cached_datasets() != 2) {
+                cerr << d.cached_datasets() << " datasets held open after appending, not 2" << endl;
+                rtn = -1;
+            }
+            d.clear_cache();
+            if (d.cached_datasets() != 0 || d.num_rows ("/c_0") != 10) {
+                cerr << "clear_cache() didn't close the appended datasets" << endl;
+                rtn = -1;
+            }
+        }
+        {
+            HdfData d ("testhdfappend.h5", true);
+            for (unsigned int t = 10; t < 25; ++t) {
+                frame (f, t);
+                frame (ff, t);
+                d.append_ptrarray_vals ("/c_0", f.data(), n);
+                d.append_ptrarray_vals ("/group/cf", ff.data(), n);
+            }
+            // A row of the wrong length is refused
+            bool threw = false;
+            try {
+                vector<double> shortrow (n - 1, 0.0);
+                d.append_vals ("/c_0", shortrow);
+            } catch (const runtime_error& e) {
+                threw = true;
+            }
+            if (!threw) {
+                cerr << "A row of the wrong length was appended" << endl;
+                rtn = -1;
+            }
+        }
+        {
+            HdfData d ("testhdfappend.h5", true);
+            if (!check<double> (d, "/c_0", 25, n) || !check<float> (d, "/group/cf", 25, n)) {
+                rtn = -1;
+            }
+        }
+
+        // Compressed
+        {
+            HdfData d ("testhdfappend_z.h5");
+            HdfChunking z;
+            z.deflate = 4;
+            z.shuffle = true;
+            for (unsigned int t = 0; t < 25; ++t) {
+                frame (ff, t);
+                d.append_vals ("/cf", ff, z);
+            }
+        }
+        {
+            HdfData d ("testhdfappend_z.h5", true);
+            if (!check<float> (d, "/cf", 25, n)) {
+                rtn = -1;
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // The benchmark: nframes frames of n floats, three ways
+    const unsigned int nframes = 400;
+    const double mb = (double)nframes * n * sizeof(float) / (1024.0 * 1024.0);
+
+    auto t0 = steady_clock::now();
+    {
+        HdfData d ("testhdfappend_perpath.h5");
+        for (unsigned int t = 0; t < nframes; ++t) {
+            frame (ff, t);
+            string path = "/c_0_t" + to_string(t);
+            d.add_contained_vals (path.c_str(), ff);
+        }
+    }
+    auto t1 = steady_clock::now();
+    {
+        HdfData d ("testhdfappend_append.h5");
+        for (unsigned int t = 0; t < nframes; ++t) {
+            frame (ff, t);
+            d.append_vals ("/c_0", ff);
+        }
+    }
+    auto t2 = steady_clock::now();
+    {
+        HdfData d ("testhdfappend_deflate.h5");
+        HdfChunking z;
+        z.deflate = 1;
+        z.shuffle = true;
+        for (unsigned int t = 0; t < nframes; ++t) {
+            frame (ff, t);
+            d.append_vals ("/c_0", ff, z);
+        }
+    }
+    auto t3 = steady_clock::now();
+
+    // Read every frame back from each
+    vector<float> all (nframes * n);
+    auto t4 = steady_clock::now();
+    {
+        HdfData d ("testhdfappend_perpath.h5", true);
+        for (unsigned int t = 0; t < nframes; ++t) {
+            vector<float> v;
+            string path = "/c_0_t" + to_string(t);
+            d.read_contained_vals (path.c_str(), v);
+        }
+    }
+    auto t5 = steady_clock::now();
+    {
+        HdfData d ("testhdfappend_append.h5", true);
+        d.read_ptrarray_vals ("/c_0", all.data(), nframes, n, n);
+    }
+    auto t6 = steady_clock::now();
+
+    double sp = duration_cast<microseconds>(t1 - t0).count() * 1e-6;
+    double sa = duration_cast<microseconds>(t2 - t1).count() * 1e-6;
+    double sz = duration_cast<microseconds>(t3 - t2).count() * 1e-6;
+    double rp = duration_cast<microseconds>(t5 - t4).count() * 1e-6;
+    double ra = duration_cast<microseconds>(t6 - t5).count() * 1e-6;
+    long long int bp = fileSize ("testhdfappend_perpath.h5");
+    long long int ba = fileSize ("testhdfappend_append.h5");
+    long long int bz = fileSize ("testhdfappend_deflate.h5");
+    cout << nframes << " frames of " << n << " floats (" << mb << " MB):\n"
+         << "  dataset per frame: write " << mb / sp << " MB/s, read " << mb / rp << " MB/s, " << bp << " bytes\n"
+         << "  append_vals:       write " << mb / sa << " MB/s, read " << mb / ra << " MB/s, " << ba << " bytes\n"
+         << "  append_vals, deflate 1 + shuffle: write " << mb / sz << " MB/s, " << bz << " bytes" << endl;
+
+    // add_contained_vals stores floats as doubles; append_vals keeps them as floats
+    if (ba >= bp || bz >= ba) {
+        cerr << "The appended files should be smaller than the per-frame one" << endl;
+        rtn = -1;
+    }
+
+    return rtn;
+}
@@ -0,0 +1,154 @@
+/*
+ * Test HdfDataAsync: writes queued to an I/O thread arrive in the file in full once the
+ * object is destroyed, the queue stays within its bound, errors come back to the caller,
+ * and the saves overlap with computation.
+ */
+
+#include "HdfDataAsync.h"
+#include "HdfData.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+using morph::HdfData;
+using morph::HdfDataAsync;
+
+// Some work standing in for the simulation steps between saves
+double compute (vector<double>& f, unsigned int t)
+{
+    double sum = 0.0;
+    for (unsigned int k = 0; k < 20; ++k) {
+        for (unsigned int h = 0; h < f.size(); ++h) {
+            f[h] = 0.5 + 0.5 * sin (0.01 * h + 0.05 * t + 1e-3 * k);
+            sum += f[h];
+        }
+    }
+    return sum;
+}
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int n = 20000;
+    const unsigned int nframes = 50;
+    vector<double> f (n);
+    // A small bound, so that the writer must keep up with the queue
+    const size_t bound = 4 * n * sizeof(double);
+    size_t peak = 0;
+
+    try {
+        {
+            HdfDataAsync data ("testhdfasync.h5", false, bound);
+            for (unsigned int t = 0; t < nframes; ++t) {
+                compute (f, t);
+                string path = "/f_t" + to_string(t);
+                data.add_contained_vals (path.c_str(), f);
+                vector<float> g (f.begin(), f.end());
+                data.append_vals ("/g", std::move (g));
+                data.add_val ((path + "_t").c_str(), 0.1 * t);
+                if (!g.empty()) {
+                    cerr << "append_vals copied a vector that was passed with std::move" << endl;
+                    rtn = -1;
+                }
+            }
+            data.add_string ("/name", string("testhdfasync"));
+            vector<double> arr (3 * 8, 0.0);
+            for (unsigned int i = 0; i < arr.size(); ++i) { arr[i] = i; }
+            data.add_ptrarray_vals ("/arr", arr.data(), 3, 5, 8);
+            arr.assign (arr.size(), -1.0); // The queued write has its own copy
+            peak = data.peak();
+        } // Everything is written and the file closed here
+
+        if (peak > bound + n * sizeof(double)) {
+            cerr << "The queue grew to " << peak << " bytes, beyond its bound of " << bound << endl;
+            rtn = -1;
+        }
+
+        HdfData d ("testhdfasync.h5", true);
+        vector<double> r;
+        for (unsigned int t = 0; t < nframes && rtn == 0; ++t) {
+            compute (f, t);
+            string path = "/f_t" + to_string(t);
+            d.read_contained_vals (path.c_str(), r);
+            double tt = 0.0;
+            d.read_val ((path + "_t").c_str(), tt);
+            if (r != f || tt != 0.1 * t) {
+                cerr << "Frame " << t << " is wrong" << endl;
+                rtn = -1;
+            }
+        }
+        if (d.num_rows ("/g") != nframes) {
+            cerr << "Expected " << nframes << " rows in /g" << endl;
+            rtn = -1;
+        }
+        string name;
+        d.read_string ("/name", name);
+        vector<double> arr (3 * 5);
+        d.read_ptrarray_vals ("/arr", arr.data(), 3, 5, 5);
+        if (name != "testhdfasync" || arr[0] != 0 || arr[4] != 4 || arr[5] != 8 || arr[14] != 20) {
+            cerr << "Wrong string or 2D array" << endl;
+            rtn = -1;
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // A failed write is reported by flush(), and a file that can't be opened by the constructor
+    {
+        bool threw = false;
+        HdfDataAsync data ("testhdfasync2.h5");
+        data.add_val ("/x", 1.0);
+        data.add_val ("/x", 2.0); // exists already
+        try {
+            data.flush();
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw) {
+            cerr << "flush() didn't report the failed write" << endl;
+            rtn = -1;
+        }
+        threw = false;
+        try {
+            HdfDataAsync bad ("no_such_directory/testhdfasync.h5");
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw) {
+            cerr << "Opening a file in a missing directory didn't throw" << endl;
+            rtn = -1;
+        }
+    }
+
+    // Compare the wall time of computing and saving with HdfData and with HdfDataAsync
+    double sum = 0.0;
+    auto t0 = steady_clock::now();
+    {
+        HdfData data ("testhdfasync_sync.h5");
+        for (unsigned int t = 0; t < nframes; ++t) {
+            sum += compute (f, t);
+            string path = "/f_t" + to_string(t);
+            data.add_contained_vals (path.c_str(), f);
+        }
+    }
+    auto t1 = steady_clock::now();
+    {
+        HdfDataAsync data ("testhdfasync_async.h5");
+        for (unsigned int t = 0; t < nframes; ++t) {
+            sum += compute (f, t);
+            string path = "/f_t" + to_string(t);
+            data.add_contained_vals (path.c_str(), f);
+        }
+    }
+    auto t2 = steady_clock::now();
+    cout << nframes << " frames of " << n << " doubles, computing and saving: HdfData "
+         << duration_cast<milliseconds>(t1 - t0).count() << " ms, HdfDataAsync "
+         << duration_cast<milliseconds>(t2 - t1).count() << " ms (" << sum << ")" << endl;
+
+    return rtn;
+}
@@ -0,0 +1,142 @@
+/*
+ * Test HdfData::begin and commit: saves repeated into the same file layout rewrite the
+ * datasets held open from the first save, a dataset of a different shape is refused, and
+ * writing outside a begin()/commit() scope behaves as before. Compares the cost of a small
+ * save repeated in place with writing it to a new file each time.
+ */
+
+#include "HdfData.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+using morph::HdfData;
+
+// A small save, like RD_Base::saveHexPositions, with values that depend on the step k
+void save (HdfData& d, unsigned int k, vector<double>& c, vector<float>& x)
+{
+    for (unsigned int h = 0; h < c.size(); ++h) { c[h] = k + 0.001 * h; }
+    for (unsigned int h = 0; h < x.size(); ++h) { x[h] = k * 0.5f + h; }
+    d.add_contained_vals ("/c", c);
+    d.add_contained_vals ("/pos/x", x);
+    d.add_val ("/pos/k", k);
+    d.add_val ("/t", 0.1 * k);
+    for (unsigned int i = 0; i < 20; ++i) {
+        string path = "/params/p" + to_string(i);
+        d.add_val (path.c_str(), (double)(k * 100 + i));
+    }
+}
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int n = 1000;
+    const unsigned int nsaves = 200;
+    vector<double> c (n);
+    vector<float> x (n);
+
+    try {
+        {
+            HdfData d ("testhdfcache.h5");
+            for (unsigned int k = 0; k < nsaves; ++k) {
+                d.begin();
+                save (d, k, c, x);
+                d.append_vals ("/trace", x);
+                d.commit();
+            }
+            if (d.cached_datasets() != 25) {
+                cerr << "Expected 25 datasets held open, not " << d.cached_datasets() << endl;
+                rtn = -1;
+            }
+
+            // Nested scopes; an unmatched commit() throws
+            d.begin();
+            d.begin();
+            d.add_val ("/t", 1.5);
+            d.commit();
+            d.commit();
+            unsigned int threw = 0;
+            try { d.commit(); } catch (const runtime_error& e) { ++threw; }
+
+            // A dataset of a different shape or type is refused
+            d.begin();
+            vector<double> shortc (n - 1, 0.0);
+            try { d.add_contained_vals ("/c", shortc); } catch (const runtime_error& e) { ++threw; }
+            try { d.add_val ("/pos/k", 1.0); } catch (const runtime_error& e) { ++threw; }
+            d.commit();
+
+            // Outside a scope, writing to an existing path still fails
+            try { d.add_val ("/t", 2.0); } catch (const runtime_error& e) { ++threw; }
+            if (threw != 4) {
+                cerr << "Expected 4 errors, got " << threw << endl;
+                rtn = -1;
+            }
+            d.clear_cache();
+            if (d.cached_datasets() != 0) {
+                cerr << "clear_cache() left datasets open" << endl;
+                rtn = -1;
+            }
+        }
+
+        // The file holds the last save, and a transaction on a reopened file rewrites in place
+        {
+            HdfData d ("testhdfcache.h5", true);
+            vector<double> rc;
+            vector<float> rx;
+            unsigned int k = 0;
+            double t = 0.0;
+            double p7 = 0.0;
+            d.read_contained_vals ("/c", rc);
+            d.read_contained_vals ("/pos/x", rx);
+            d.read_val ("/pos/k", k);
+            d.read_val ("/t", t);
+            d.read_val ("/params/p7", p7);
+            if (rc != c || rx != x || k != nsaves - 1 || t != 1.5 || p7 != (nsaves - 1) * 100 + 7
+                || d.num_rows ("/trace") != nsaves) {
+                cerr << "Wrong values after the repeated saves" << endl;
+                rtn = -1;
+            }
+            d.begin();
+            save (d, 1000, c, x);
+            d.commit();
+        }
+        {
+            HdfData d ("testhdfcache.h5", true);
+            vector<double> rc;
+            double p19 = 0.0;
+            d.read_contained_vals ("/c", rc);
+            d.read_val ("/params/p19", p19);
+            if (rc != c || p19 != 100019.0) {
+                cerr << "Wrong values after rewriting the reopened file" << endl;
+                rtn = -1;
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // The time per save: into a new file each time, and repeated in place
+    auto t0 = steady_clock::now();
+    for (unsigned int k = 0; k < nsaves; ++k) {
+        HdfData d ("testhdfcache_new.h5");
+        save (d, k, c, x);
+    }
+    auto t1 = steady_clock::now();
+    {
+        HdfData d ("testhdfcache_inplace.h5");
+        for (unsigned int k = 0; k < nsaves; ++k) {
+            d.begin();
+            save (d, k, c, x);
+            d.commit();
+        }
+    }
+    auto t2 = steady_clock::now();
+    cout << "Per save of 24 datasets: new file " << duration_cast<microseconds>(t1 - t0).count() / nsaves
+         << " us, in place " << duration_cast<microseconds>(t2 - t1).count() / nsaves << " us" << endl;
+
+    return rtn;
+}
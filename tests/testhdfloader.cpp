@@ -0,0 +1,168 @@
+/*
+ * Test HdfLoader, which reads a set of datasets from every HDF5 file in a directory tree
+ * on a pool of threads, into a 2D array or through a callback, opening the files read
+ * only. Compares the throughput on one thread and on several.
+ */
+
+#include "HdfLoader.h"
+#include "HdfData.h"
+#include "tools.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <sys/stat.h>
+
+using namespace std;
+using morph::HdfData;
+using morph::HdfView;
+using morph::HdfLoader;
+using morph::Tools;
+
+const unsigned int nc = 5000;
+const unsigned int nn = 1000;
+
+double cval (unsigned int k, unsigned int h) { return k * 1e4 + h; }
+double nval (unsigned int k, unsigned int h) { return k + 0.5 * h; }
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int nfiles = 120;
+    const string logs = "testhdfloader_logs";
+
+    try {
+        // A sweep's logs, in two subdirectories, with a file that isn't HDF5 among them
+        vector<double> c (nc);
+        vector<float> n (nn);
+        for (unsigned int k = 0; k < nfiles; ++k) {
+            string dir = logs + (k % 2 ? "/odd" : "/even");
+            Tools::createDir (dir);
+            for (unsigned int h = 0; h < nc; ++h) { c[h] = cval (k, h); }
+            for (unsigned int h = 0; h < nn; ++h) { n[h] = nval (k, h); }
+            // Zero padded, so that sorted order is numeric order within a directory
+            string num = to_string (1000 + k).substr (1);
+            HdfData d (dir + "/run_" + num + ".h5");
+            d.add_contained_vals ("/c", c);
+            d.add_contained_vals ("/n", n);
+            d.add_val ("/k", k);
+        }
+        ofstream (logs + "/even/notes.txt") << "Not an HDF5 file" << endl;
+
+        HdfLoader<double> loader (logs, ".h5");
+        loader.datasets = { "/c", "/n" };
+        if (loader.files.size() != nfiles || loader.rowLength() != nc + nn) {
+            cerr << "Found " << loader.files.size() << " files, with rows of " << loader.rowLength() << endl;
+            return -1;
+        }
+        // The file each row should come from: evens first, then odds
+        vector<unsigned int> kOf (nfiles);
+        for (unsigned int i = 0; i < nfiles; ++i) {
+            kOf[i] = i < nfiles / 2 ? 2 * i : 2 * (i - nfiles / 2) + 1;
+        }
+
+        // Into a 2D array, with a rowstride longer than the rows, on 1 and 4 threads
+        const size_t stride = nc + nn + 16;
+        for (unsigned int nt : { 1u, 4u }) {
+            loader.nthreads = nt;
+            vector<double> all (nfiles * stride, -1.0);
+            loader.load (all.data(), stride);
+            for (unsigned int i = 0; i < nfiles && rtn == 0; ++i) {
+                const double* row = all.data() + i * stride;
+                if (row[0] != cval (kOf[i], 0) || row[nc - 1] != cval (kOf[i], nc - 1)
+                    || row[nc] != nval (kOf[i], 0) || row[nc + nn - 1] != nval (kOf[i], nn - 1)
+                    || row[nc + nn] != -1.0) {
+                    cerr << "Row " << i << " is wrong on " << nt << " threads" << endl;
+                    rtn = -1;
+                }
+            }
+            if (loader.loadedValues != nfiles * (nc + nn)) {
+                cerr << "Loaded " << loader.loadedValues << " values" << endl;
+                rtn = -1;
+            }
+        }
+
+        // Through a callback, summing each file's /c
+        vector<double> sums (nfiles, 0.0);
+        unsigned int calls = 0;
+        std::mutex m;
+        loader.nthreads = 3;
+        loader.load ([&](size_t i, const string& file, const vector<HdfView<double> >& v) {
+                double s = 0.0;
+                for (double x : v[0]) { s += x; }
+                sums[i] = s;
+                std::lock_guard<std::mutex> lock (m);
+                ++calls;
+            });
+        for (unsigned int i = 0; i < nfiles && rtn == 0; ++i) {
+            double expect = nc * kOf[i] * 1e4 + 0.5 * nc * (nc - 1);
+            if (sums[i] != expect) {
+                cerr << "Callback sum for file " << i << " is " << sums[i] << ", not " << expect << endl;
+                rtn = -1;
+            }
+        }
+        if (calls != nfiles) {
+            cerr << "The callback was called " << calls << " times" << endl;
+            rtn = -1;
+        }
+
+        // The files are opened read only, so a tree without write permission loads, as
+        // does a file that is already open read only (which HDF5 won't reopen for writing)
+        {
+            for (const string& f : loader.files) { chmod (f.c_str(), 0444); }
+            HdfData held (loader.files[0], true, true);
+            loader.nthreads = 2;
+            vector<double> all (nfiles * stride, -1.0);
+            bool loaded = true;
+            try {
+                loader.load (all.data(), stride);
+            } catch (const runtime_error& e) {
+                loaded = false;
+            }
+            for (const string& f : loader.files) { chmod (f.c_str(), 0644); }
+            if (!loaded || all[0] != cval (kOf[0], 0) || all[(nfiles - 1) * stride] != cval (kOf[nfiles - 1], 0)) {
+                cerr << "Read-only files failed to load" << endl;
+                rtn = -1;
+            }
+        }
+
+        // A file without the datasets fails, after the others have loaded
+        vector<string> some = { loader.files[0], "testhdfloader_bad.h5", loader.files[1] };
+        {
+            HdfData d (some[1]);
+            d.add_val ("/k", 0u);
+        }
+        HdfLoader<double> partial (some);
+        partial.datasets = { "/c", "/n" };
+        partial.nthreads = 2;
+        vector<double> rows (3 * stride, -1.0);
+        bool threw = false;
+        try {
+            partial.load (rows.data(), stride);
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw || rows[0] != cval (kOf[0], 0) || rows[2 * stride] != cval (kOf[1], 0)) {
+            cerr << "A bad file wasn't reported, or stopped the others loading" << endl;
+            rtn = -1;
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // Throughput, reading float rows, on 1 thread and on one per hardware thread
+    HdfLoader<float> floader (logs, ".h5");
+    floader.datasets = { "/c", "/n" };
+    vector<float> frows (floader.files.size() * (nc + nn));
+    for (unsigned int nt : { 1u, 0u }) {
+        floader.nthreads = nt;
+        floader.load (frows.data(), nc + nn);
+        cout << floader.files.size() << " files on " << (nt ? to_string(nt) : string("all")) << " thread(s): "
+             << floader.loadSeconds * 1000.0 << " ms, "
+             << floader.loadedValues / floader.loadSeconds / 1e6 << " M values/s" << endl;
+    }
+
+    return rtn;
+}
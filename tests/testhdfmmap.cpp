@@ -0,0 +1,176 @@
+/*
+ * Test HdfData::map_vals, which gives read-only views of datasets: contiguous, unfiltered
+ * datasets of the type viewed are memory mapped, anything else is read. Compares the cold
+ * and warm start-up time of getting at a field by reading and by mapping.
+ */
+
+#include "HdfData.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+using morph::HdfData;
+using morph::HdfView;
+using morph::HdfChunking;
+
+// Ask the kernel to drop fname from the page cache, so that the next access is cold
+void evict (const string& fname)
+{
+    int fd = open (fname.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync (fd);
+        posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+        close (fd);
+    }
+}
+
+template <typename A, typename B>
+bool same (const A& a, const B& b)
+{
+    if (a.size() != b.size()) { return false; }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i] != b[i]) { return false; }
+    }
+    return true;
+}
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int n = 10000;
+    vector<double> a (n);
+    vector<float> f (n);
+    vector<int> vi (n);
+    vector<long long int> ll (n);
+    for (unsigned int i = 0; i < n; ++i) {
+        a[i] = 0.25 * i;
+        f[i] = 0.5f * i;
+        vi[i] = -(int)i;
+        ll[i] = 1000000000000LL + i;
+    }
+
+    try {
+        HdfView<double> outlives;
+        HdfView<float> copied;
+        {
+            HdfData d ("testhdfmmap.h5");
+            d.add_contained_vals ("/a", a);
+            d.add_contained_vals ("/group/f", f);
+            d.add_contained_vals ("/vi", vi);
+            d.add_contained_vals ("/ll", ll);
+
+            // Views of a file being written see what has been written so far
+            HdfView<double> va;
+            d.map_vals ("/a", va);
+            d.add_contained_vals ("/b", a);
+            HdfView<double> vb;
+            d.map_vals ("/b", vb);
+            if (!va.mapped() || !vb.mapped() || !same (va, a) || !same (vb, a)) {
+                cerr << "Views made while writing are wrong" << endl;
+                rtn = -1;
+            }
+            outlives = va;
+
+            // Chunked, and chunked and compressed
+            HdfChunking z;
+            z.deflate = 1;
+            for (unsigned int t = 0; t < 5; ++t) {
+                d.append_vals ("/trace", f);
+                d.append_vals ("/ztrace", a, z);
+            }
+        }
+
+        {
+            HdfData d ("testhdfmmap.h5", true);
+            // Mapped: stored as the type viewed, contiguous and unfiltered
+            HdfView<double> vf;
+            HdfView<long long int> vvi;
+            HdfView<long long int> vll;
+            d.map_vals ("/group/f", vf);
+            d.map_vals ("/vi", vvi);
+            d.map_vals ("/ll", vll);
+            if (!vf.mapped() || !vvi.mapped() || !vll.mapped()
+                || !same (vf, f) || !same (vvi, vi) || !same (vll, ll)
+                || vf.shape().size() != 1 || vf.shape()[0] != n) {
+                cerr << "Mapped views are wrong" << endl;
+                rtn = -1;
+            }
+            // Read: stored as another type, chunked or compressed
+            HdfView<float> ff;
+            HdfView<int> ii;
+            HdfView<float> trace;
+            HdfView<double> ztrace;
+            d.map_vals ("/group/f", ff);
+            d.map_vals ("/vi", ii);
+            d.map_vals ("/trace", trace);
+            d.map_vals ("/ztrace", ztrace);
+            if (ff.mapped() || ii.mapped() || trace.mapped() || ztrace.mapped()
+                || !same (ff, f) || !same (ii, vi)) {
+                cerr << "Views that should have been read are wrong" << endl;
+                rtn = -1;
+            }
+            if (trace.shape().size() != 2 || trace.shape()[0] != 5 || trace.shape()[1] != n
+                || trace[4 * n + 7] != f[7] || ztrace.size() != 5 * n || ztrace[3 * n + 9] != a[9]) {
+                cerr << "Views of 2D datasets are wrong" << endl;
+                rtn = -1;
+            }
+            copied = ff;
+        }
+
+        // Views stay valid after their HdfData has gone
+        if (!same (outlives, a) || !same (copied, f)) {
+            cerr << "Views didn't outlive their HdfData" << endl;
+            rtn = -1;
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+
+    // Start-up benchmark: open a file of nfields fields and get at one, cold and warm
+    const unsigned int nfields = 8;
+    const unsigned int big = 1000000;
+    {
+        HdfData d ("testhdfmmap_big.h5");
+        vector<double> field (big);
+        for (unsigned int k = 0; k < nfields; ++k) {
+            for (unsigned int i = 0; i < big; ++i) { field[i] = k + 1e-6 * i; }
+            string path = "/c_" + to_string(k);
+            d.add_contained_vals (path.c_str(), field);
+        }
+    }
+    double sum = 0.0;
+    // Get field 3 by read_contained_vals or map_vals, then sum all of it or every 1000th value
+    auto startup = [&sum](bool map, unsigned int step) {
+        auto t0 = steady_clock::now();
+        HdfData d ("testhdfmmap_big.h5", true);
+        if (map) {
+            HdfView<double> v;
+            d.map_vals ("/c_3", v);
+            for (size_t i = 0; i < v.size(); i += step) { sum += v[i]; }
+        } else {
+            vector<double> v;
+            d.read_contained_vals ("/c_3", v);
+            for (size_t i = 0; i < v.size(); i += step) { sum += v[i]; }
+        }
+        return duration_cast<microseconds>(steady_clock::now() - t0).count();
+    };
+    cout << "Start-up with one field of " << big << " doubles (us)   cold   warm" << endl;
+    for (unsigned int step : { 1u, 1000u }) {
+        for (bool map : { false, true }) {
+            evict ("testhdfmmap_big.h5");
+            long long int cold = startup (map, step);
+            long long int warm = startup (map, step);
+            cout << (map ? "  map_vals, " : "  read_contained_vals, ")
+                 << (step == 1 ? "every value" : "every 1000th value") << ": " << cold << "  " << warm << endl;
+        }
+    }
+    cout << "(" << sum << ")" << endl;
+
+    return rtn;
+}
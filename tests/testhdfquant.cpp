@@ -0,0 +1,135 @@
+/*
+ * Test the quantising HdfData::add_contained_vals, which stores float and double fields
+ * with BitRound or ScaleOffset quantisation, shuffled and deflated, and dequantises them
+ * on reading. Reports the compression ratio and the largest error for each.
+ */
+
+#include "HdfData.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using morph::HdfData;
+using morph::HdfQuantisation;
+using morph::HdfSlab;
+using morph::HdfView;
+
+long long int fileSize (const string& fname)
+{
+    ifstream f (fname, ios::binary | ios::ate);
+    return f.good() ? (long long int)f.tellg() : -1;
+}
+
+// A smooth pattern, like an RD field, with a little noise, and one NaN
+template <typename Flt>
+vector<Flt> field (unsigned int n)
+{
+    vector<Flt> f (n);
+    unsigned int seed = 1;
+    for (unsigned int h = 0; h < n; ++h) {
+        seed = seed * 1664525u + 1013904223u;
+        f[h] = (Flt)(2.0 + 1.5 * sin (0.002 * h) * cos (0.0007 * h) + 1e-4 * (seed >> 8) / (double)(1 << 24));
+    }
+    f[n / 3] = numeric_limits<Flt>::quiet_NaN();
+    return f;
+}
+
+// Store f quantised as q, read it back, check the error against its bound and report
+template <typename Flt>
+bool check (const vector<Flt>& f, const HdfQuantisation& q, const string& name)
+{
+    bool ok = true;
+    string fname = "testhdfquant_" + name + ".h5";
+    {
+        HdfData d (fname);
+        d.add_contained_vals ("/f", f, q);
+    }
+    vector<Flt> r;
+    vector<Flt> part (100);
+    HdfView<Flt> view;
+    {
+        HdfData d (fname, true);
+        d.read_contained_vals ("/f", r);
+        d.read_slab ("/f", HdfSlab::range (1000, 100), part.data(), part.size());
+        d.map_vals ("/f", view);
+    }
+    double lo = 1e300;
+    double hi = -1e300;
+    for (Flt v : f) {
+        if (!std::isnan (v)) { lo = min (lo, (double)v); hi = max (hi, (double)v); }
+    }
+    const bool so = q.method == HdfQuantisation::Method::ScaleOffset;
+    const double sobound = (hi - lo) / ((1 << q.bits) - 2) / 2.0;
+    double maxerr = 0.0;
+    for (size_t i = 0; i < f.size() && ok; ++i) {
+        if (std::isnan (f[i])) {
+            ok = std::isnan (r[i]) && std::isnan (view[i]);
+            continue;
+        }
+        double err = fabs ((double)r[i] - (double)f[i]);
+        maxerr = max (maxerr, err);
+        // Allow for the rounding of a dequantised float, too
+        double bound = so ? sobound + fabs (f[i]) * numeric_limits<Flt>::epsilon()
+                          : fabs (f[i]) * ldexp (1.0, -(int)q.bits - 1);
+        ok = err <= bound && view[i] == r[i];
+    }
+    for (unsigned int i = 0; i < part.size() && ok; ++i) { ok = part[i] == r[1000 + i]; }
+    if (!ok || r.size() != f.size()) {
+        cerr << name << ": values read back exceed the error bound, or differ between reads" << endl;
+        ok = false;
+    }
+    double ratio = (double)(f.size() * sizeof(Flt)) / fileSize (fname);
+    cout << "  " << name << ": compression ratio " << ratio << ", max error " << maxerr
+         << (so ? " (absolute)" : "") << endl;
+    return ok;
+}
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int n = 1000000;
+    vector<float> f = field<float> (n);
+    vector<double> dd = field<double> (n);
+
+    try {
+        HdfQuantisation q;
+        cout << n << " values, stored with:" << endl;
+        for (unsigned int bits : { 12u, 16u }) {
+            q.method = HdfQuantisation::Method::BitRound;
+            q.bits = bits;
+            if (!check (f, q, "float_bitround" + to_string(bits))) { rtn = -1; }
+            if (!check (dd, q, "double_bitround" + to_string(bits))) { rtn = -1; }
+            q.method = HdfQuantisation::Method::ScaleOffset;
+            if (!check (f, q, "float_scaleoffset" + to_string(bits))) { rtn = -1; }
+            if (!check (dd, q, "double_scaleoffset" + to_string(bits))) { rtn = -1; }
+        }
+        // Unquantised, for comparison (add_contained_vals stores floats as doubles)
+        {
+            HdfData d ("testhdfquant_raw.h5");
+            d.add_contained_vals ("/f", f);
+        }
+        cout << "  unquantised: compression ratio " << (double)(n * sizeof(float)) / fileSize ("testhdfquant_raw.h5") << endl;
+
+        // Bits out of range are refused
+        unsigned int threw = 0;
+        HdfData d ("testhdfquant_bad.h5");
+        q.method = HdfQuantisation::Method::ScaleOffset;
+        q.bits = 17;
+        try { d.add_contained_vals ("/a", f, q); } catch (const runtime_error& e) { ++threw; }
+        q.method = HdfQuantisation::Method::BitRound;
+        q.bits = 24;
+        try { d.add_contained_vals ("/b", f, q); } catch (const runtime_error& e) { ++threw; }
+        if (threw != 2) {
+            cerr << "Quantisation to too many bits was accepted" << endl;
+            rtn = -1;
+        }
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,157 @@
+/*
+ * Test HdfData::read_slab, which reads a hyperslab (offset, count, stride) of a dataset
+ * into the caller's buffer: frames and element time series of an append_vals dataset,
+ * strided ranges of 1D data, coordinates and blocks of a cv::Mat.
+ */
+
+#include "HdfData.h"
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+using morph::HdfData;
+using morph::HdfSlab;
+
+float val (unsigned int t, unsigned int h) { return t * 10000.0f + h; }
+
+int main()
+{
+    int rtn = 0;
+    const unsigned int nframes = 200;
+    const unsigned int n = 20000;
+
+    try {
+        cv::Mat m (10, 8, CV_32FC3);
+        cv::Mat g (6, 5, CV_8UC1);
+        {
+            HdfData d ("testhdfslab.h5");
+            vector<float> f (n);
+            for (unsigned int t = 0; t < nframes; ++t) {
+                for (unsigned int h = 0; h < n; ++h) { f[h] = val (t, h); }
+                d.append_vals ("/c", f);
+            }
+            vector<double> v (100);
+            vector<int> vi (100);
+            for (unsigned int i = 0; i < 100; ++i) { v[i] = 0.5 * i; vi[i] = -(int)i; }
+            d.add_contained_vals ("/v", v);
+            d.add_contained_vals ("/vi", vi);
+            vector<array<float, 3>> coords (20);
+            for (unsigned int i = 0; i < 20; ++i) { coords[i] = {{ (float)i, i + 0.25f, i + 0.5f }}; }
+            d.add_contained_vals ("/coords", coords);
+            for (int r = 0; r < m.rows; ++r) {
+                for (int c = 0; c < m.cols; ++c) {
+                    m.at<cv::Vec3f>(r, c) = cv::Vec3f (r, c, r * 100 + c);
+                }
+            }
+            for (int r = 0; r < g.rows; ++r) {
+                for (int c = 0; c < g.cols; ++c) { g.at<unsigned char>(r, c) = r * 10 + c; }
+            }
+            d.add_contained_vals ("/m", m);
+            d.add_contained_vals ("/g", g);
+        }
+
+        HdfData d ("testhdfslab.h5", true);
+
+        // One frame, into a buffer that is reused
+        vector<float> buf (n);
+        float* before = buf.data();
+        for (unsigned int t : { 0u, 57u, nframes - 1 }) {
+            size_t got = d.read_slab ("/c", HdfSlab::rows (t), buf.data(), buf.size());
+            if (got != n || buf.data() != before || buf[0] != val (t, 0) || buf[n - 1] != val (t, n - 1)) {
+                cerr << "Frame " << t << " read wrongly" << endl;
+                rtn = -1;
+            }
+        }
+        // One element's time series
+        vector<float> ts (nframes);
+        if (d.slab_size ("/c", HdfSlab::column (1234)) != nframes
+            || d.read_slab ("/c", HdfSlab::column (1234), ts.data(), ts.size()) != nframes
+            || ts[0] != val (0, 1234) || ts[199] != val (199, 1234)) {
+            cerr << "Column read wrongly" << endl;
+            rtn = -1;
+        }
+        // A strided block: frames 10, 13, 16, 19 and hexes 100, 105, ..., 145
+        vector<float> blk (40);
+        d.read_slab ("/c", HdfSlab::block (10, 4, 100, 10, 3, 5), blk.data(), blk.size());
+        for (unsigned int i = 0; i < 4; ++i) {
+            for (unsigned int j = 0; j < 10; ++j) {
+                if (blk[i * 10 + j] != val (10 + 3 * i, 100 + 5 * j)) {
+                    cerr << "Block element " << i << "," << j << " is wrong" << endl;
+                    rtn = -1;
+                }
+            }
+        }
+        // Too little room, or a slab outside the dataset, throws
+        unsigned int threw = 0;
+        try { d.read_slab ("/c", HdfSlab::rows (0, 2), buf.data(), buf.size()); } catch (const runtime_error& e) { ++threw; }
+        try { d.read_slab ("/c", HdfSlab::rows (nframes), buf.data(), buf.size()); } catch (const runtime_error& e) { ++threw; }
+        try { d.read_slab ("/c", HdfSlab::range (0, 10), buf.data(), buf.size()); } catch (const runtime_error& e) { ++threw; }
+        if (threw != 3) {
+            cerr << "Bad selections were accepted" << endl;
+            rtn = -1;
+        }
+
+        // Strided ranges of 1D data; a count of 0 reads to the end
+        vector<double> v (50);
+        vector<int> vi (50);
+        size_t got = d.read_slab ("/v", HdfSlab::range (3, 0, 4), v.data(), v.size());
+        d.read_slab ("/vi", HdfSlab::range (90), vi.data(), vi.size());
+        if (got != 25 || v[0] != 1.5 || v[24] != 0.5 * 99 || vi[0] != -90 || vi[9] != -99) {
+            cerr << "1D ranges read wrongly" << endl;
+            rtn = -1;
+        }
+
+        // Coordinates 1, 4, 7, 10
+        array<float, 3> cs[4];
+        got = d.read_slab ("/coords", HdfSlab::range (1, 4, 3), cs, 4);
+        if (got != 4 || cs[0][0] != 1.0f || cs[3][0] != 10.0f || cs[3][2] != 10.5f || cs[2][1] != 7.25f) {
+            cerr << "Coordinates read wrongly" << endl;
+            rtn = -1;
+        }
+
+        // Part of a cv::Mat: rows 2 to 5 and columns 1, 3 and 5; the Mat is reused
+        cv::Mat part;
+        d.read_slab ("/m", HdfSlab::block (2, 4, 1, 3, 1, 2), part);
+        unsigned char* pdata = part.data;
+        d.read_slab ("/m", HdfSlab::block (2, 4, 1, 3, 1, 2), part);
+        if (part.rows != 4 || part.cols != 3 || part.type() != CV_32FC3 || part.data != pdata) {
+            cerr << "The cv::Mat slab has the wrong shape, or wasn't reused" << endl;
+            rtn = -1;
+        } else {
+            for (int r = 0; r < 4; ++r) {
+                for (int c = 0; c < 3; ++c) {
+                    if (part.at<cv::Vec3f>(r, c) != m.at<cv::Vec3f>(2 + r, 1 + 2 * c)) {
+                        cerr << "cv::Mat slab element " << r << "," << c << " is wrong" << endl;
+                        rtn = -1;
+                    }
+                }
+            }
+        }
+        cv::Mat gpart;
+        d.read_slab ("/g", HdfSlab::block (1, 0, 2, 2), gpart);
+        if (gpart.rows != 5 || gpart.cols != 2 || gpart.at<unsigned char>(4, 1) != 53) {
+            cerr << "Single channel cv::Mat slab is wrong" << endl;
+            rtn = -1;
+        }
+
+        // The time to read one frame with read_slab, and with the whole dataset
+        vector<float> all (nframes * n);
+        auto t0 = steady_clock::now();
+        d.read_slab ("/c", HdfSlab::rows (100), buf.data(), buf.size());
+        auto t1 = steady_clock::now();
+        d.read_ptrarray_vals ("/c", all.data(), nframes, n, n);
+        auto t2 = steady_clock::now();
+        cout << "One frame of " << nframes << ": read_slab " << duration_cast<microseconds>(t1 - t0).count()
+             << " us, whole dataset " << duration_cast<microseconds>(t2 - t1).count() << " us" << endl;
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,153 @@
+/*
+ * Test HexActiveSet with RDIntegrator on a travelling front (a bistable reaction, as in a
+ * growth front), stepping as RD_Base::integrate does with activeSet.enabled. The result
+ * must stay close to that of stepping every hex, while only a band of hexes around the
+ * front is stepped.
+ * Reports the mean active fraction and the time per step of each.
+ */
+
+#include "HexGrid.h"
+#include "HexKernels.h"
+#include "HexActiveSet.h"
+#include "RDIntegrator.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+        HexGrid hg(0.004, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        unsigned int n = hg.num();
+
+        double d = hg.getd();
+        double norm = 2.0 / (3.0 * d * d);
+        const double D = 5e-4;
+        const double rate = 14.0;
+        const double dt = 0.01;
+        const unsigned int nsteps = 300;
+
+        // u = 1 in a small disc, 0 elsewhere
+        vector<vector<double> > u0 (1, vector<double>(n, 0.0));
+        for (unsigned int h = 0; h < n; ++h) {
+            if (hg.d_x[h]*hg.d_x[h] + hg.d_y[h]*hg.d_y[h] < 0.04*0.04) {
+                u0[0][h] = 1.0;
+            }
+        }
+
+        HexActiveSet<double> as;
+        vector<double> lap (n, 0.0);
+        auto rhs = [&](vector<vector<double> >& y, vector<vector<double> >& dy) {
+            if (as.stepping()) {
+                const vector<unsigned int>& idx = as.indices();
+                HexKernels::laplace_indexed (hg, y[0].data(), lap.data(), idx.data(), idx.size(), norm);
+                for (unsigned int h : idx) {
+                    dy[0][h] = D * lap[h] + rate * y[0][h] * (1.0 - y[0][h]) * (y[0][h] - 0.25);
+                }
+            } else {
+                HexKernels::laplace (hg, y[0].data(), lap.data(), n, norm);
+                for (unsigned int h = 0; h < n; ++h) {
+                    dy[0][h] = D * lap[h] + rate * y[0][h] * (1.0 - y[0][h]) * (y[0][h] - 0.25);
+                }
+            }
+        };
+
+        // Every hex, every step
+        vector<vector<double> > ufull = u0;
+        RDIntegrator<double> integ;
+        integ.scheme = RDScheme::RK4;
+        auto t0 = steady_clock::now();
+        for (unsigned int s = 0; s < nsteps; ++s) {
+            integ.step (ufull, dt, rhs);
+        }
+        auto t1 = steady_clock::now();
+
+        // The narrow band
+        vector<vector<double> > uband = u0;
+        RDIntegrator<double> integb;
+        integb.scheme = RDScheme::RK4;
+        as.enabled = true;
+        as.threshold = 1e-4;
+        as.halo = 2;
+        as.fullSweepEvery = 100;
+        double minfrac = 1.0;
+        unsigned int fullsweeps = 0;
+        auto t2 = steady_clock::now();
+        for (unsigned int s = 0; s < nsteps; ++s) {
+            as.begin (uband, n);
+            if (as.full()) { ++fullsweeps; }
+            integb.active = as.full() ? nullptr : &as.indices();
+            integb.step (uband, dt, rhs);
+            integb.active = nullptr;
+            as.end (hg, uband, dt);
+            minfrac = std::min (minfrac, as.fraction());
+        }
+        auto t3 = steady_clock::now();
+
+        double maxdiff = 0.0;
+        double covered = 0.0;
+        for (unsigned int h = 0; h < n; ++h) {
+            maxdiff = std::max (maxdiff, std::abs (uband[0][h] - ufull[0][h]));
+            covered += ufull[0][h] > 0.5 ? 1.0 : 0.0;
+        }
+        double tfull = duration_cast<microseconds>(t1 - t0).count() / (double)nsteps;
+        double tband = duration_cast<microseconds>(t3 - t2).count() / (double)nsteps;
+        cout << n << " hexes; front covers " << covered / n << " of the domain. Mean active fraction "
+             << as.meanFraction() << " (min " << minfrac << "), max difference from full stepping "
+             << maxdiff << ". " << tfull << " us/step full, " << tband << " us/step narrow band" << endl;
+
+        if (maxdiff > 1e-4) {
+            cerr << "Narrow band stepping differs from full stepping by " << maxdiff << endl;
+            rtn = -1;
+        }
+        if (as.meanFraction() > 0.3 || minfrac >= 0.1) {
+            cerr << "The band isn't narrow: mean fraction " << as.meanFraction() << endl;
+            rtn = -1;
+        }
+        if (fullsweeps != 3) {
+            cerr << "Expected 3 full sweeps, got " << fullsweeps << endl;
+            rtn = -1;
+        }
+        // The front must have moved well beyond the initial disc
+        if (covered < 4.0 * 3.14159 * 0.04 * 0.04 / hg.getHexArea()) {
+            cerr << "The front hasn't spread (covers " << covered << " hexes)" << endl;
+            rtn = -1;
+        }
+
+        // stepAdaptive doesn't take an active list
+        bool threw = false;
+        integb.scheme = RDScheme::BS23;
+        integb.active = &as.indices();
+        double dta = dt;
+        try {
+            integb.stepAdaptive (uband, dta, rhs);
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw) {
+            cerr << "stepAdaptive accepted an active list" << endl;
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,74 @@
+/*
+ * Test the wavefront computeDistanceToBoundary against the brute force reference,
+ * computeDistanceToBoundaryBruteForce.
+ */
+
+#include "HexGrid.h"
+#include "tools.h"
+#include "ReadCurves.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        HexGrid hg(0.01, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        cout << "Number of hexes in grid:" << hg.num() << endl;
+
+        steady_clock::time_point t0 = steady_clock::now();
+        hg.computeDistanceToBoundaryBruteForce();
+        steady_clock::time_point t1 = steady_clock::now();
+        vector<float> reference;
+        for (auto h : hg.hexen) {
+            reference.push_back (h.distToBoundary);
+        }
+
+        hg.computeDistanceToBoundary();
+        steady_clock::time_point t2 = steady_clock::now();
+
+        cout << "Brute force: " << duration_cast<milliseconds>(t1-t0).count() << " ms; wavefront: "
+             << duration_cast<milliseconds>(t2-t1).count() << " ms" << endl;
+
+        float maxerr = 0.0f;
+        unsigned int nwrong = 0;
+        auto ri = reference.begin();
+        for (auto h : hg.hexen) {
+            float err = abs(h.distToBoundary - *ri);
+            if (err > maxerr) { maxerr = err; }
+            if (err > 1e-6) { ++nwrong; }
+            if (h.distToBoundary != hg.d_distToBoundary[h.di]) {
+                cerr << "d_distToBoundary not updated" << endl;
+                rtn = -1;
+            }
+            ++ri;
+        }
+        cout << "Max abs error: " << maxerr << " (" << nwrong << " hexes differ from reference)" << endl;
+
+        // Where the wavefront picks a near-but-not-nearest boundary hex, the error should
+        // be a fraction of the hex to hex distance.
+        if (maxerr > 0.3f * hg.getd()) {
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception reading trial.svg: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,129 @@
+/*
+ * Test HexDiffusion, the implicit diffusion solve used by RD_Base::integrateIMEX. Checks
+ * that its solutions satisfy (I - c L) x = b, with L computed by HexKernels::laplace, and
+ * that implicit steps far beyond the explicit stability limit stay stable and track an
+ * explicit solution with a small step.
+ */
+
+#include "HexGrid.h"
+#include "HexKernels.h"
+#include "HexDiffusion.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+        HexGrid hg(0.005, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        unsigned int n = hg.num();
+
+        double d = hg.getd();
+        double norm = 2.0 / (3.0 * d * d);
+        double D = 0.1;
+        // Explicit Euler diffusion is stable for dt < 1/(6 D norm)
+        double dtexplicit = 1.0 / (6.0 * D * norm);
+        cout << n << " hexes; explicit dt limit " << dtexplicit << endl;
+
+        vector<double> b (n), x (n, 0.0), lap (n);
+        for (unsigned int i = 0; i < n; ++i) {
+            b[i] = sin (10.0 * hg.d_x[i]) * cos (7.0 * hg.d_y[i]) + 0.1 * Tools::randF<double>();
+        }
+
+        // Residual check over a range of c (as dt D)
+        double cs[3] = { 10.0 * dtexplicit * D, 100.0 * dtexplicit * D, 1000.0 * dtexplicit * D };
+        for (unsigned int ci = 0; ci < 3; ++ci) {
+            HexDiffusion<double> solver;
+            steady_clock::time_point t0 = steady_clock::now();
+            solver.setup (&hg, n, norm, cs[ci]);
+            steady_clock::time_point t1 = steady_clock::now();
+            x.assign (n, 0.0);
+            solver.solve (b.data(), x.data());
+            steady_clock::time_point t2 = steady_clock::now();
+            HexKernels::laplace (hg, x.data(), lap.data(), n, norm);
+            double maxres = 0.0;
+            for (unsigned int i = 0; i < n; ++i) {
+                maxres = std::max (maxres, fabs (x[i] - cs[ci] * lap[i] - b[i]));
+            }
+            cout << "dt = " << (cs[ci] / (D * dtexplicit)) << " x explicit limit: setup "
+                 << duration_cast<microseconds>(t1-t0).count() << " us, solve "
+                 << duration_cast<microseconds>(t2-t1).count() << " us in "
+                 << solver.lastIterations << " iterations; max residual " << maxres << endl;
+            if (maxres > 1e-5) {
+                cerr << "Solution doesn't satisfy the equation" << endl;
+                rtn = -1;
+            }
+        }
+
+        // Diffuse to time T with implicit steps of 50 times the explicit limit, and with
+        // explicit steps at half the limit.
+        double T = 100.0 * dtexplicit;
+        vector<double> ximp = b, xexp = b, rhs (n);
+        HexDiffusion<double> solver;
+        double dtimp = 50.0 * dtexplicit;
+        unsigned int nimp = (unsigned int)std::round (T / dtimp);
+        solver.setup (&hg, n, norm, dtimp * D);
+        for (unsigned int s = 0; s < nimp; ++s) {
+            rhs = ximp;
+            solver.solve (rhs.data(), ximp.data());
+        }
+        double dtexp = 0.5 * dtexplicit;
+        unsigned int nexp = (unsigned int)std::round (T / dtexp);
+        for (unsigned int s = 0; s < nexp; ++s) {
+            HexKernels::laplace (hg, xexp.data(), lap.data(), n, norm);
+            for (unsigned int i = 0; i < n; ++i) {
+                xexp[i] += dtexp * D * lap[i];
+            }
+        }
+        double maxdiff = 0.0, maxval = 0.0;
+        for (unsigned int i = 0; i < n; ++i) {
+            maxdiff = std::max (maxdiff, fabs (ximp[i] - xexp[i]));
+            maxval = std::max (maxval, fabs (xexp[i]));
+        }
+        cout << "After " << nimp << " implicit steps vs " << nexp << " explicit steps: max difference " << maxdiff
+             << " (max value " << maxval << ")" << endl;
+        // Backward Euler is first order, so with 100 times fewer steps expect a difference
+        // of a few percent, but no instability.
+        if (!(maxdiff < 0.05 * maxval)) {
+            cerr << "Implicit steps diverged from the explicit solution" << endl;
+            rtn = -1;
+        }
+
+        // The float solver
+        HexDiffusion<float> fsolver;
+        vector<float> fb (b.begin(), b.end()), fx (n, 0.0f), flap (n);
+        fsolver.setup (&hg, n, (float)norm, (float)cs[1]);
+        fsolver.solve (fb.data(), fx.data());
+        HexKernels::laplace (hg, fx.data(), flap.data(), n, (float)norm);
+        double fmaxres = 0.0;
+        for (unsigned int i = 0; i < n; ++i) {
+            fmaxres = std::max (fmaxres, (double)fabs (fx[i] - (float)cs[1] * flap[i] - fb[i]));
+        }
+        cout << "float solve: " << fsolver.lastIterations << " iterations; max residual " << fmaxres << endl;
+        if (fmaxres > 1e-3) {
+            cerr << "float solution doesn't satisfy the equation" << endl;
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,73 @@
+/*
+ * Test HexGrid::findHexAt, the constant time lookup from a Cartesian position to the Hex
+ * containing it, against a search over every Hex.
+ */
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <cfloat>
+#include <cmath>
+
+using namespace morph;
+using namespace std;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        HexGrid hg(0.02, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+
+        // Random points across (and a little beyond) the grid
+        unsigned int nfound = 0;
+        for (unsigned int i = 0; i < 2000; ++i) {
+            pair<float, float> pos = make_pair (Tools::randF<float>() * 2.0f - 1.0f,
+                                                Tools::randF<float>() * 2.0f - 1.0f);
+
+            list<Hex>::iterator nearest = hg.hexen.end();
+            float dist = FLT_MAX;
+            for (list<Hex>::iterator hi = hg.hexen.begin(); hi != hg.hexen.end(); ++hi) {
+                float dl = hi->distanceFrom (pos);
+                if (dl < dist) {
+                    dist = dl;
+                    nearest = hi;
+                }
+            }
+
+            list<Hex>::iterator found = hg.findHexAt (pos);
+            if (found == hg.hexen.end()) {
+                // Then pos must not be inside any hex of the grid
+                if (dist < hg.getSR()) {
+                    cerr << "findHexAt missed a Hex at " << pos.first << "," << pos.second << endl;
+                    rtn = -1;
+                }
+            } else {
+                ++nfound;
+                // Allow for ties, where pos lies on the edge between two hexes
+                if (found != nearest && abs(found->distanceFrom (pos) - dist) > 1e-5) {
+                    cerr << "findHexAt gave the wrong Hex for " << pos.first << "," << pos.second << endl;
+                    rtn = -1;
+                }
+            }
+        }
+        cout << nfound << " of 2000 random points lay on the grid" << endl;
+        if (nfound == 0) {
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
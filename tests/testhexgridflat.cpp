@@ -0,0 +1,101 @@
+/*
+ * Compare a HexGrid built in HexGridStorage::Flat mode with one built in the default
+ * HexGridStorage::List mode. The two must give identical d_ vectors and identical hexen. Also
+ * reports construction time and the approximate memory held by the full, pre-boundary grid in
+ * each mode.
+ */
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        float hexd = 0.01f;
+        float hexspan = 7.0f;
+
+        steady_clock::time_point t0 = steady_clock::now();
+        HexGrid hgl(hexd, hexspan, 0, HexDomainShape::Boundary, HexGridStorage::List);
+        unsigned int nfull = hgl.num();
+        steady_clock::time_point t1 = steady_clock::now();
+        hgl.setBoundary (r.getCorticalPath());
+        steady_clock::time_point t2 = steady_clock::now();
+
+        HexGrid hgf(hexd, hexspan, 0, HexDomainShape::Boundary, HexGridStorage::Flat);
+        unsigned int nfullf = hgf.num();
+        steady_clock::time_point t3 = steady_clock::now();
+        hgf.setBoundary (r.getCorticalPath());
+        steady_clock::time_point t4 = steady_clock::now();
+
+        // A list node holds a Hex plus its two link pointers
+        size_t listbytes = nfull * (sizeof(Hex) + 2 * sizeof(void*));
+        size_t flatbytes = nfullf * sizeof(FlatHex);
+
+        cout << "Full grid: " << nfull << " hexes (list) " << nfullf << " hexes (flat)" << endl;
+        cout << "List: init " << duration_cast<milliseconds>(t1-t0).count() << " ms, setBoundary "
+             << duration_cast<milliseconds>(t2-t1).count() << " ms, ~" << listbytes/1024 << " KB" << endl;
+        cout << "Flat: init " << duration_cast<milliseconds>(t3-t2).count() << " ms, setBoundary "
+             << duration_cast<milliseconds>(t4-t3).count() << " ms, ~" << flatbytes/1024 << " KB" << endl;
+
+        if (nfull != nfullf) { rtn = -1; }
+        if (hgl.num() != hgf.num()) {
+            cerr << "Grid sizes differ: " << hgl.num() << " vs " << hgf.num() << endl;
+            rtn = -1;
+        }
+        if (hgl.d_x != hgf.d_x || hgl.d_y != hgf.d_y
+            || hgl.d_ri != hgf.d_ri || hgl.d_gi != hgf.d_gi || hgl.d_bi != hgf.d_bi
+            || hgl.d_flags != hgf.d_flags || hgl.d_distToBoundary != hgf.d_distToBoundary) {
+            cerr << "d_ vectors differ" << endl;
+            rtn = -1;
+        }
+        if (hgl.d_ne != hgf.d_ne || hgl.d_nne != hgf.d_nne || hgl.d_nnw != hgf.d_nnw
+            || hgl.d_nw != hgf.d_nw || hgl.d_nsw != hgf.d_nsw || hgl.d_nse != hgf.d_nse) {
+            cerr << "d_ neighbour vectors differ" << endl;
+            rtn = -1;
+        }
+        if (hgl.bhexen.size() != hgf.bhexen.size()) {
+            cerr << "Boundaries differ" << endl;
+            rtn = -1;
+        }
+
+        // hexen must match too, including the neighbour relations
+        auto hl = hgl.hexen.begin();
+        auto hf = hgf.hexen.begin();
+        while (rtn == 0 && hl != hgl.hexen.end() && hf != hgf.hexen.end()) {
+            if (hl->vi != hf->vi || hl->di != hf->di || hl->ri != hf->ri || hl->gi != hf->gi
+                || hl->getFlags() != hf->getFlags()) {
+                rtn = -1;
+            }
+            for (unsigned short j = 0; j < 6; ++j) {
+                if (hl->has_neighbour(j) && hl->get_neighbour(j)->vi != hf->get_neighbour(j)->vi) {
+                    rtn = -1;
+                }
+            }
+            ++hl; ++hf;
+        }
+        if (rtn != 0) {
+            cerr << "hexen differ" << endl;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,113 @@
+/*
+ * Test the ghost-slot neighbour table, HexGrid::d_nbtab. Checks it against d_ne and
+ * friends, then checks that a branch-free Laplacian (as RD_Base::compute_laplace_ghost)
+ * reading from it matches the branching Laplacian of RD_Base::compute_laplace, and reports
+ * the throughput of each.
+ */
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        HexGrid hg(0.003, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        hg.populate_d_ghosts();
+
+        unsigned int n = hg.num();
+        unsigned int ng = hg.d_ghostsrc.size();
+        cout << n << " hexes and " << ng << " ghost slots" << endl;
+
+        // Check the table
+        const vector<int>* nbs[6] = { &hg.d_ne, &hg.d_nne, &hg.d_nnw, &hg.d_nw, &hg.d_nsw, &hg.d_nse };
+        for (unsigned int hi = 0; hi < n; ++hi) {
+            for (unsigned int j = 0; j < 6; ++j) {
+                int t = hg.d_nbtab[6*hi+j];
+                int expected = (*nbs[j])[hi];
+                if (expected >= 0 && t != expected) {
+                    rtn = -1;
+                } else if (expected < 0 && (t < (int)n || t >= (int)(n+ng) || hg.d_ghostsrc[t-n] != (int)hi)) {
+                    rtn = -1;
+                }
+            }
+        }
+        if (rtn != 0) {
+            cerr << "d_nbtab is inconsistent with d_ne etc." << endl;
+        }
+
+        vector<double> F (n + ng);
+        for (unsigned int i = 0; i < n; ++i) {
+            F[i] = sin (10.0 * hg.d_x[i]) * cos (7.0 * hg.d_y[i]);
+        }
+        // Ghost fill for a no-flux boundary
+        for (unsigned int g = 0; g < ng; ++g) {
+            F[n+g] = F[hg.d_ghostsrc[g]];
+        }
+
+        double norm  = 2.0 / (3.0 * hg.getd() * hg.getd());
+        vector<double> lap1 (n), lap2 (n);
+        unsigned int reps = 200;
+
+        steady_clock::time_point t0 = steady_clock::now();
+        for (unsigned int rep = 0; rep < reps; ++rep) {
+            for (unsigned int hi = 0; hi < n; ++hi) {
+                double thesum = -6 * F[hi];
+                thesum += hg.d_ne[hi] == -1 ? F[hi] : F[hg.d_ne[hi]];
+                thesum += hg.d_nne[hi] == -1 ? F[hi] : F[hg.d_nne[hi]];
+                thesum += hg.d_nnw[hi] == -1 ? F[hi] : F[hg.d_nnw[hi]];
+                thesum += hg.d_nw[hi] == -1 ? F[hi] : F[hg.d_nw[hi]];
+                thesum += hg.d_nsw[hi] == -1 ? F[hi] : F[hg.d_nsw[hi]];
+                thesum += hg.d_nse[hi] == -1 ? F[hi] : F[hg.d_nse[hi]];
+                lap1[hi] = norm * thesum;
+            }
+        }
+        steady_clock::time_point t1 = steady_clock::now();
+        for (unsigned int rep = 0; rep < reps; ++rep) {
+            const int* nb = hg.d_nbtab.data();
+            for (unsigned int hi = 0; hi < n; ++hi) {
+                const int* nh = nb + 6*hi;
+                double thesum = -6 * F[hi];
+                thesum += F[nh[0]];
+                thesum += F[nh[1]];
+                thesum += F[nh[2]];
+                thesum += F[nh[3]];
+                thesum += F[nh[4]];
+                thesum += F[nh[5]];
+                lap2[hi] = norm * thesum;
+            }
+        }
+        steady_clock::time_point t2 = steady_clock::now();
+
+        cout << "Branching: " << duration_cast<microseconds>(t1-t0).count()/reps << " us/call; "
+             << "ghost table: " << duration_cast<microseconds>(t2-t1).count()/reps << " us/call" << endl;
+
+        if (lap1 != lap2) {
+            cerr << "Branch-free Laplacian differs" << endl;
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,77 @@
+/*
+ * Round-trip a large HexGrid through HexGrid::save and HexGrid::load, checking that every
+ * Hex and neighbour relation comes back intact and reporting how long each step takes.
+ */
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        steady_clock::time_point t0 = steady_clock::now();
+        HexGrid hg(0.01, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        steady_clock::time_point t1 = steady_clock::now();
+        hg.save ("./testhexgridload.h5");
+        steady_clock::time_point t2 = steady_clock::now();
+        HexGrid hg2 ("./testhexgridload.h5");
+        steady_clock::time_point t3 = steady_clock::now();
+
+        cout << hg.num() << " hexes. Build: " << duration_cast<milliseconds>(t1-t0).count()
+             << " ms; save: " << duration_cast<milliseconds>(t2-t1).count()
+             << " ms; load: " << duration_cast<milliseconds>(t3-t2).count() << " ms" << endl;
+
+        if (hg.num() != hg2.num()) {
+            cerr << "Wrong number of hexes after load" << endl;
+            rtn = -1;
+        }
+
+        auto h1 = hg.hexen.begin();
+        auto h2 = hg2.hexen.begin();
+        while (rtn == 0 && h1 != hg.hexen.end() && h2 != hg2.hexen.end()) {
+            if (h1->vi != h2->vi || h1->ri != h2->ri || h1->gi != h2->gi
+                || h1->getFlags() != h2->getFlags()) {
+                cerr << "Hex " << h1->vi << " differs after load" << endl;
+                rtn = -1;
+            }
+            for (unsigned short j = 0; j < 6; ++j) {
+                if (h1->has_neighbour(j) != h2->has_neighbour(j)) {
+                    rtn = -1;
+                } else if (h1->has_neighbour(j)
+                           && (h1->get_neighbour(j)->vi != h2->get_neighbour(j)->vi
+                               || h1->get_neighbour(j)->ri != h2->get_neighbour(j)->ri
+                               || h1->get_neighbour(j)->gi != h2->get_neighbour(j)->gi)) {
+                    cerr << "Neighbour " << j << " of Hex " << h1->vi << " differs after load" << endl;
+                    rtn = -1;
+                }
+            }
+            ++h1; ++h2;
+        }
+
+        remove ("./testhexgridload.h5");
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
@@ -0,0 +1,152 @@
+/*
+ * Test HexGrid::reorderHilbert. Runs the Laplacian and gradient stencils of
+ * RD_Base::compute_laplace and RD_Base::spacegrad2D over a grid in its original order and
+ * again after reordering. Checks that the results agree once mapped back to canonical order
+ * and reports the throughput of each.
+ */
+
+#include "HexGrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+// As RD_Base::compute_laplace
+void compute_laplace (const HexGrid& hg, const vector<double>& F, vector<double>& lapF)
+{
+    double norm  = 2.0 / (3.0 * hg.getd() * hg.getd());
+    for (unsigned int hi = 0; hi < F.size(); ++hi) {
+        double thesum = -6 * F[hi];
+        thesum += hg.d_ne[hi] == -1 ? F[hi] : F[hg.d_ne[hi]];
+        thesum += hg.d_nne[hi] == -1 ? F[hi] : F[hg.d_nne[hi]];
+        thesum += hg.d_nnw[hi] == -1 ? F[hi] : F[hg.d_nnw[hi]];
+        thesum += hg.d_nw[hi] == -1 ? F[hi] : F[hg.d_nw[hi]];
+        thesum += hg.d_nsw[hi] == -1 ? F[hi] : F[hg.d_nsw[hi]];
+        thesum += hg.d_nse[hi] == -1 ? F[hi] : F[hg.d_nse[hi]];
+        lapF[hi] = norm * thesum;
+    }
+}
+
+// As RD_Base::spacegrad2D (for the full neighbour complement; otherwise one-sided)
+void spacegrad2D (const HexGrid& hg, const vector<double>& f, array<vector<double>, 2>& gradf)
+{
+    double oneoverd = 1.0 / hg.getd();
+    double oneover2d = 0.5 * oneoverd;
+    double oneoverv = 1.0 / hg.getv();
+    double oneover4v = 0.25 * oneoverv;
+    for (unsigned int hi = 0; hi < f.size(); ++hi) {
+        int ne = hg.d_ne[hi], nw = hg.d_nw[hi];
+        if (ne >= 0 && nw >= 0) {
+            gradf[0][hi] = (f[ne] - f[nw]) * oneover2d;
+        } else if (ne >= 0) {
+            gradf[0][hi] = (f[ne] - f[hi]) * oneoverd;
+        } else if (nw >= 0) {
+            gradf[0][hi] = (f[hi] - f[nw]) * oneoverd;
+        } else {
+            gradf[0][hi] = 0.0;
+        }
+        int nne = hg.d_nne[hi], nnw = hg.d_nnw[hi], nse = hg.d_nse[hi], nsw = hg.d_nsw[hi];
+        if (nne >= 0 && nnw >= 0 && nse >= 0 && nsw >= 0) {
+            gradf[1][hi] = ((f[nne] - f[nse]) + (f[nnw] - f[nsw])) * oneover4v;
+        } else if (nne >= 0 && nnw >= 0) {
+            gradf[1][hi] = ((f[nne] + f[nnw]) * 0.5 - f[hi]) * oneoverv;
+        } else if (nse >= 0 && nsw >= 0) {
+            gradf[1][hi] = (f[hi] - (f[nse] + f[nsw]) * 0.5) * oneoverv;
+        } else {
+            gradf[1][hi] = 0.0;
+        }
+    }
+}
+
+// Time reps calls of the two stencils, returning hexes per microsecond.
+double benchmark (const HexGrid& hg, vector<double>& F, vector<double>& lapF,
+                  array<vector<double>, 2>& gradF, unsigned int reps)
+{
+    steady_clock::time_point t0 = steady_clock::now();
+    for (unsigned int r = 0; r < reps; ++r) {
+        compute_laplace (hg, F, lapF);
+        spacegrad2D (hg, F, gradF);
+    }
+    steady_clock::time_point t1 = steady_clock::now();
+    double us = (double)duration_cast<microseconds>(t1-t0).count();
+    return (double)F.size() * reps / us;
+}
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        HexGrid hg1(0.003, 7, 0, HexDomainShape::Boundary);
+        hg1.setBoundary (r.getCorticalPath());
+        HexGrid hg2(0.003, 7, 0, HexDomainShape::Boundary);
+        hg2.setBoundary (r.getCorticalPath());
+        hg2.reorderHilbert();
+
+        unsigned int n = hg1.num();
+        cout << "Number of hexes in grid:" << n << endl;
+
+        // A field that varies over the grid, in each grid's own order
+        vector<double> F1 (n), F2 (n);
+        for (unsigned int i = 0; i < n; ++i) {
+            F1[i] = sin (10.0 * hg1.d_x[i]) * cos (7.0 * hg1.d_y[i]);
+            F2[i] = sin (10.0 * hg2.d_x[i]) * cos (7.0 * hg2.d_y[i]);
+        }
+        vector<double> lap1 (n), lap2 (n);
+        array<vector<double>, 2> grad1 = {{ vector<double>(n), vector<double>(n) }};
+        array<vector<double>, 2> grad2 = {{ vector<double>(n), vector<double>(n) }};
+
+        unsigned int reps = 200;
+        double tp1 = benchmark (hg1, F1, lap1, grad1, reps);
+        double tp2 = benchmark (hg2, F2, lap2, grad2, reps);
+        cout << "Original order: " << tp1 << " hexes/us; Hilbert order: " << tp2 << " hexes/us" << endl;
+
+        // Results must agree once put back in canonical order
+        vector<double> lap2c, gx2c, gy2c;
+        hg2.toCanonical (lap2, lap2c);
+        hg2.toCanonical (grad2[0], gx2c);
+        hg2.toCanonical (grad2[1], gy2c);
+        if (lap2c != lap1 || gx2c != grad1[0] || gy2c != grad1[1]) {
+            cerr << "Stencil results differ after reordering" << endl;
+            rtn = -1;
+        }
+
+        // And the reordered Hexes must still be consistent with the d_ vectors
+        for (auto h : hg2.hexen) {
+            if (h.vi != h.di || h.ri != hg2.d_ri[h.di] || h.gi != hg2.d_gi[h.di]
+                || (h.has_ne() && h.ne->di != (unsigned int)hg2.d_ne[h.di])) {
+                cerr << "Hex " << h.vi << " is inconsistent with the d_ vectors" << endl;
+                rtn = -1;
+                break;
+            }
+        }
+
+        // fromCanonical inverts toCanonical
+        vector<double> F2back;
+        vector<double> F2c;
+        hg2.toCanonical (F2, F2c);
+        hg2.fromCanonical (F2c, F2back);
+        if (F2back != F2) {
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
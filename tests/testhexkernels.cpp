@@ -0,0 +1,127 @@
+/*
+ * Test the HexKernels Laplacian and gradient. The AVX2 path (which falls back to scalar if
+ * the CPU lacks AVX2) is checked against the scalar path at three grid sizes, and the
+ * throughput of each is reported.
+ */
+
+#include "HexGrid.h"
+#include "HexKernels.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+// Flops per hex. Laplacian: 6 adds, 1 multiply by -6 and 1 by norm.
+static const double lapflops = 8.0;
+// Gradient: a subtract and multiply for x, and up to 3 adds/subtracts and a multiply for y.
+static const double gradflops = 6.0;
+
+template <typename Flt>
+int testKernels (const HexGrid& hg, unsigned int reps)
+{
+    int rtn = 0;
+    unsigned int n = hg.num();
+    vector<Flt> F (n);
+    for (unsigned int i = 0; i < n; ++i) {
+        F[i] = sin (10.0 * hg.d_x[i]) * cos (7.0 * hg.d_y[i]);
+    }
+
+    Flt d = hg.getd();
+    Flt v = hg.getv();
+    Flt norm  = (Flt)2 / (Flt)(3.0 * d * d);
+    Flt oneoverd = 1.0/d;
+    Flt oneover2d = 1.0/(d+d);
+    Flt oneoverv = 1.0/v;
+    Flt oneover2v = 1.0/(v+v);
+    Flt oneover4v = 1.0/(v+v+v+v);
+
+    vector<Flt> lap1 (n), lap2 (n), gx1 (n), gy1 (n), gx2 (n), gy2 (n);
+    KernelPath paths[2] = { KernelPath::Scalar, KernelPath::AVX2 };
+    double lapus[2], gradus[2];
+    for (unsigned int pi = 0; pi < 2; ++pi) {
+        vector<Flt>& lap = pi == 0 ? lap1 : lap2;
+        vector<Flt>& gx = pi == 0 ? gx1 : gx2;
+        vector<Flt>& gy = pi == 0 ? gy1 : gy2;
+        steady_clock::time_point t0 = steady_clock::now();
+        for (unsigned int rep = 0; rep < reps; ++rep) {
+            HexKernels::laplace (hg, F.data(), lap.data(), n, norm, paths[pi]);
+        }
+        steady_clock::time_point t1 = steady_clock::now();
+        for (unsigned int rep = 0; rep < reps; ++rep) {
+            HexKernels::spacegrad2D (hg, F.data(), gx.data(), gy.data(), n, oneoverd, oneover2d,
+                                     oneoverv, oneover2v, oneover4v, paths[pi]);
+        }
+        steady_clock::time_point t2 = steady_clock::now();
+        lapus[pi] = duration_cast<nanoseconds>(t1-t0).count() / (1000.0 * reps);
+        gradus[pi] = duration_cast<nanoseconds>(t2-t1).count() / (1000.0 * reps);
+    }
+
+    cout << "  " << (sizeof(Flt) == 4 ? "float " : "double") << " laplace: scalar "
+         << (lapflops * n / (lapus[0] * 1000.0)) << " GFLOP/s, avx2 "
+         << (lapflops * n / (lapus[1] * 1000.0)) << " GFLOP/s; spacegrad2D: scalar "
+         << (gradflops * n / (gradus[0] * 1000.0)) << " GFLOP/s, avx2 "
+         << (gradflops * n / (gradus[1] * 1000.0)) << " GFLOP/s" << endl;
+
+    // The Laplacians and x gradients must be bitwise identical.
+    if (lap1 != lap2) {
+        cerr << "Laplacian differs between paths" << endl;
+        rtn = -1;
+    }
+    if (gx1 != gx2) {
+        cerr << "x gradient differs between paths" << endl;
+        rtn = -1;
+    }
+    // So must the double y gradient. The float y gradient may differ by rounding on
+    // hexes which lack neighbours (see HexKernels).
+    Flt gymax = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        gymax = std::max (gymax, (Flt)fabs (gy1[i]));
+    }
+    Flt tol = sizeof(Flt) == 4 ? 8 * numeric_limits<Flt>::epsilon() * gymax : 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        if (fabs (gy1[i] - gy2[i]) > tol) {
+            cerr << "y gradient differs between paths at hex " << i << ": "
+                 << gy1[i] << " vs " << gy2[i] << endl;
+            rtn = -1;
+            break;
+        }
+    }
+    return rtn;
+}
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        cout << "AVX2 " << (HexKernels::haveAVX2() ? "is" : "is not") << " available" << endl;
+
+        float ds[3] = { 0.01f, 0.005f, 0.0025f };
+        for (unsigned int di = 0; di < 3; ++di) {
+            HexGrid hg(ds[di], 7, 0, HexDomainShape::Boundary);
+            hg.setBoundary (r.getCorticalPath());
+            cout << "d=" << ds[di] << ", " << hg.num() << " hexes:" << endl;
+            unsigned int reps = 2000000 / hg.num() + 10;
+            if (testKernels<float> (hg, reps) != 0) { rtn = -1; }
+            if (testKernels<double> (hg, reps) != 0) { rtn = -1; }
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
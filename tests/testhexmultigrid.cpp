@@ -0,0 +1,129 @@
+/*
+ * Test HexMultigrid on three grid sizes. Checks that its solutions satisfy
+ * (alpha - beta L) u = f, with L computed by HexKernels::laplace, and that its convergence
+ * rate doesn't degrade as the grid is refined. Reports its wall time against the naive
+ * approach of iterating the Laplacian (Jacobi iteration) to the same tolerance.
+ */
+
+#include "HexGrid.h"
+#include "HexKernels.h"
+#include "HexMultigrid.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+
+        double alpha = 1.0;
+        double beta = 0.05;
+        float ds[3] = { 0.01f, 0.005f, 0.0025f };
+        unsigned int cycles0 = 0;
+        for (unsigned int di = 0; di < 3; ++di) {
+            HexGrid hg(ds[di], 7, 0, HexDomainShape::Boundary);
+            hg.setBoundary (r.getCorticalPath());
+            unsigned int n = hg.num();
+
+            vector<double> f (n), u (n, 0.0), lap (n);
+            for (unsigned int i = 0; i < n; ++i) {
+                f[i] = (hg.d_x[i] > 0.0 ? 1.0 : 0.0) + sin (20.0 * hg.d_y[i]);
+            }
+
+            steady_clock::time_point t0 = steady_clock::now();
+            HexMultigrid<double> mg (hg, alpha, beta);
+            steady_clock::time_point t1 = steady_clock::now();
+            unsigned int cycles = mg.solve (f.data(), u.data());
+            steady_clock::time_point t2 = steady_clock::now();
+
+            double rate = pow (mg.residuals.back(), 1.0 / cycles);
+            cout << n << " hexes, " << mg.numLevels() << " levels (coarsest "
+                 << mg.levelSize (mg.numLevels()-1) << "): setup "
+                 << duration_cast<microseconds>(t1-t0).count() << " us; " << cycles
+                 << " V-cycles in " << duration_cast<microseconds>(t2-t1).count()
+                 << " us; convergence factor " << rate << " per cycle" << endl;
+
+            // Check against the Laplacian used by RD_Base
+            double norm = 2.0 / (3.0 * hg.getd() * hg.getd());
+            HexKernels::laplace (hg, u.data(), lap.data(), n, norm);
+            double maxres = 0.0, maxf = 0.0;
+            for (unsigned int i = 0; i < n; ++i) {
+                maxres = std::max (maxres, fabs (alpha * u[i] - beta * lap[i] - f[i]));
+                maxf = std::max (maxf, fabs (f[i]));
+            }
+            if (maxres > 1e-5 * maxf) {
+                cerr << "Multigrid solution doesn't satisfy the equation (max residual " << maxres << ")" << endl;
+                rtn = -1;
+            }
+            if (rate > 0.3) {
+                cerr << "Multigrid converges too slowly" << endl;
+                rtn = -1;
+            }
+            if (di == 0) {
+                cycles0 = cycles;
+            } else if (cycles > cycles0 + 3) {
+                cerr << "Multigrid cycle count grows with grid size" << endl;
+                rtn = -1;
+            }
+
+            // The naive iteration, u = (f + beta norm sum(neighbours)) / diag, to the same
+            // tolerance or until it has run 20 times as long as the multigrid solve.
+            vector<double> uj (n, 0.0), unew (n);
+            double fnorm = 0.0;
+            for (unsigned int i = 0; i < n; ++i) { fnorm += f[i] * f[i]; }
+            fnorm = sqrt (fnorm);
+            double bn = beta * norm;
+            double res = 1.0;
+            unsigned int its = 0;
+            double mgus = duration_cast<microseconds>(t2-t0).count();
+            steady_clock::time_point t3 = steady_clock::now();
+            while (res > mg.tol) {
+                HexKernels::laplace (hg, uj.data(), lap.data(), n, norm);
+                double rr = 0.0;
+                for (unsigned int i = 0; i < n; ++i) {
+                    double ri = f[i] - (alpha * uj[i] - beta * lap[i]);
+                    rr += ri * ri;
+                    unsigned int k = 0;
+                    if (hg.d_ne[i] >= 0) { ++k; }
+                    if (hg.d_nne[i] >= 0) { ++k; }
+                    if (hg.d_nnw[i] >= 0) { ++k; }
+                    if (hg.d_nw[i] >= 0) { ++k; }
+                    if (hg.d_nsw[i] >= 0) { ++k; }
+                    if (hg.d_nse[i] >= 0) { ++k; }
+                    unew[i] = uj[i] + ri / (alpha + bn * k);
+                }
+                uj.swap (unew);
+                res = sqrt (rr) / fnorm;
+                ++its;
+                if ((its & 63) == 0
+                    && duration_cast<microseconds>(steady_clock::now()-t3).count() > 20.0 * mgus) {
+                    break;
+                }
+            }
+            steady_clock::time_point t4 = steady_clock::now();
+            cout << "  Jacobi iteration: " << its << " iterations in "
+                 << duration_cast<microseconds>(t4-t3).count() << " us reached residual "
+                 << res << (res > mg.tol ? " (stopped early)" : "") << endl;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}
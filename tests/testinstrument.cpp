@@ -0,0 +1,116 @@
+/*
+ * Test the per-phase instrumentation of Instrument.h: timing and counting of scopes,
+ * nesting, counts from several threads, and the summaries written to stdout and to HDF5.
+ */
+
+#define MORPH_INSTRUMENT 1
+#include "Instrument.h"
+#include "HdfData.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+using namespace morph;
+using namespace std;
+
+void busy (unsigned int us)
+{
+    auto t0 = chrono::steady_clock::now();
+    while (chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0).count() < us) {}
+}
+
+void inner (void)
+{
+    MORPH_PHASE ("test_inner", 100);
+    busy (200);
+}
+
+void outer (void)
+{
+    MORPH_PHASE ("test_outer", 1000);
+    busy (300);
+    inner();
+}
+
+int main()
+{
+    int rtn = 0;
+    Instrument& ins = Instrument::get();
+
+    for (unsigned int i = 0; i < 10; ++i) {
+        outer();
+    }
+    PhaseStats* po = ins.phase ("test_outer");
+    PhaseStats* pi = ins.phase ("test_inner");
+    if (po->calls != 10 || pi->calls != 10) {
+        cerr << "Expected 10 calls of each phase, got " << po->calls << " and " << pi->calls << endl;
+        rtn = -1;
+    }
+    if (po->bytes != 10000 || pi->bytes != 1000) {
+        cerr << "Wrong byte counts " << po->bytes << " and " << pi->bytes << endl;
+        rtn = -1;
+    }
+    // The outer phase includes the inner, and each is at least as long as its busy wait
+    if (pi->nanoseconds < 10 * 200000ULL || po->nanoseconds < pi->nanoseconds + 10 * 300000ULL) {
+        cerr << "Phase times too short: outer " << po->nanoseconds << " inner " << pi->nanoseconds << endl;
+        rtn = -1;
+    }
+
+    // Counts from several threads all arrive
+    vector<thread> pool;
+    for (unsigned int t = 0; t < 4; ++t) {
+        pool.emplace_back ([]() {
+            for (unsigned int i = 0; i < 10000; ++i) {
+                MORPH_COUNT ("test_count", 8);
+            }
+        });
+    }
+    for (thread& t : pool) { t.join(); }
+    PhaseStats* pc = ins.phase ("test_count");
+    if (pc->calls != 40000 || pc->bytes != 320000) {
+        cerr << "Lost counts from threads: " << pc->calls << " calls" << endl;
+        rtn = -1;
+    }
+
+    stringstream ss;
+    ins.report (ss);
+    cout << ss.str();
+    if (ss.str().find ("test_outer") == string::npos || ss.str().find ("test_count") == string::npos) {
+        cerr << "Report is missing phases" << endl;
+        rtn = -1;
+    }
+
+    {
+        HdfData data ("testinstrument.h5");
+        ins.save (data);
+    }
+    {
+        HdfData data ("testinstrument.h5", true);
+        unsigned long long int calls = 0;
+        unsigned long long int bytes = 0;
+        double seconds = 0.0;
+        data.read_val ("/instrument/test_outer/calls", calls);
+        data.read_val ("/instrument/test_outer/bytes", bytes);
+        data.read_val ("/instrument/test_outer/seconds", seconds);
+        if (calls != 10 || bytes != 10000 || seconds < 10 * 500e-6) {
+            cerr << "Saved phase wrong: " << calls << " calls, " << bytes << " bytes, "
+                 << seconds << " s" << endl;
+            rtn = -1;
+        }
+    }
+
+    ins.reset();
+    if (po->calls != 0 || po->nanoseconds != 0 || pc->bytes != 0) {
+        cerr << "reset() didn't zero the phases" << endl;
+        rtn = -1;
+    }
+    outer();
+    if (po->calls != 1) {
+        cerr << "A phase site doesn't count after reset()" << endl;
+        rtn = -1;
+    }
+
+    return rtn;
+}
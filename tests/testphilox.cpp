@@ -0,0 +1,133 @@
+/*
+ * Test the Philox counter-based generator: its blocks against the published known
+ * answers, that bulk fills are the same with any number of threads, and the moments of the
+ * uniform and normal fills. Reports the fill rate.
+ */
+
+#include "Philox.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+int main()
+{
+    int rtn = 0;
+
+    // Known answers for Philox4x32-10, from the Random123 distribution
+    struct Kat { Philox::Counter ctr; Philox::Key key; Philox::Counter expect; };
+    Kat kats[3] = {
+        { {{0, 0, 0, 0}}, {{0, 0}}, {{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}} },
+        { {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}}, {{0xffffffff, 0xffffffff}},
+          {{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}} },
+        { {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}}, {{0xa4093822, 0x299f31d0}},
+          {{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}} }
+    };
+    for (unsigned int k = 0; k < 3; ++k) {
+        Philox::Counter out = Philox::block (kats[k].ctr, kats[k].key);
+        if (out != kats[k].expect) {
+            cerr << "Known answer " << k << " failed" << endl;
+            rtn = -1;
+        }
+    }
+
+    const unsigned int n = 1000003;
+    Philox rng (12345);
+    vector<double> u1 (n), u4 (n), z (n);
+    vector<float> uf (n);
+
+#ifdef _OPENMP
+    int maxthreads = omp_get_max_threads();
+    omp_set_num_threads (1);
+#endif
+    rng.fillUniform (u1.data(), n, 7, 2);
+#ifdef _OPENMP
+    omp_set_num_threads (4);
+#endif
+    rng.fillUniform (u4.data(), n, 7, 2);
+#ifdef _OPENMP
+    omp_set_num_threads (maxthreads);
+#endif
+    if (u1 != u4) {
+        cerr << "Fill differs between 1 and 4 threads" << endl;
+        rtn = -1;
+    }
+    // Each value depends only on (seed, index, step, stream)
+    if (u1[54321] != rng.uniform<double> (54321, 7, 2)) {
+        cerr << "Fill doesn't match the single value" << endl;
+        rtn = -1;
+    }
+    rng.fillUniform (u4.data(), n, 8, 2);
+    unsigned int same = 0;
+    for (unsigned int i = 0; i < n; ++i) { if (u4[i] == u1[i]) { ++same; } }
+    if (same > 2) {
+        cerr << "The next step repeats " << same << " values" << endl;
+        rtn = -1;
+    }
+
+    // Moments: uniform mean 1/2, variance 1/12; normal mean 0, variance 1, kurtosis 3
+    double m = 0.0, v = 0.0;
+    double umin = 1.0, umax = 0.0;
+    for (unsigned int i = 0; i < n; ++i) {
+        m += u1[i];
+        umin = u1[i] < umin ? u1[i] : umin;
+        umax = u1[i] > umax ? u1[i] : umax;
+    }
+    m /= n;
+    for (unsigned int i = 0; i < n; ++i) { v += (u1[i] - m) * (u1[i] - m); }
+    v /= n;
+    if (std::abs (m - 0.5) > 0.002 || std::abs (v - 1.0/12.0) > 0.001 || umin < 0.0 || umax >= 1.0) {
+        cerr << "Uniform moments wrong: mean " << m << " var " << v << endl;
+        rtn = -1;
+    }
+
+    auto t0 = steady_clock::now();
+    rng.fillNormal (z.data(), n, 0, 0);
+    auto t1 = steady_clock::now();
+    rng.fillUniform (uf.data(), n, 0, 1);
+    auto t2 = steady_clock::now();
+    m = 0.0;
+    v = 0.0;
+    double k4 = 0.0;
+    for (unsigned int i = 0; i < n; ++i) {
+        if (!std::isfinite (z[i])) {
+            cerr << "Non-finite normal value at " << i << endl;
+            rtn = -1;
+            break;
+        }
+        m += z[i];
+    }
+    m /= n;
+    for (unsigned int i = 0; i < n; ++i) {
+        double d2 = (z[i] - m) * (z[i] - m);
+        v += d2;
+        k4 += d2 * d2;
+    }
+    v /= n;
+    k4 = k4 / n / (v * v);
+    if (std::abs (m) > 0.005 || std::abs (v - 1.0) > 0.01 || std::abs (k4 - 3.0) > 0.05) {
+        cerr << "Normal moments wrong: mean " << m << " var " << v << " kurtosis " << k4 << endl;
+        rtn = -1;
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+        if (uf[i] < 0.0f || uf[i] >= 1.0f) {
+            cerr << "Float uniform out of range at " << i << endl;
+            rtn = -1;
+            break;
+        }
+    }
+
+    double tnorm = duration_cast<microseconds>(t1 - t0).count();
+    double tunif = duration_cast<microseconds>(t2 - t1).count();
+    cout << "Philox: " << n / tnorm << " M normal doubles/s, "
+         << n / tunif << " M uniform floats/s" << endl;
+
+    return rtn;
+}
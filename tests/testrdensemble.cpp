@@ -0,0 +1,236 @@
+/*
+ * Test RD_Ensemble with a small diffusion-decay model derived from RD_Base. Checks that
+ * every member shares the one HexGrid, that stepping the members on several threads gives
+ * exactly the results of stepping them on one, and that each member writes its own HDF5
+ * files. Repeats with the grid Hilbert ordered and with ghost neighbours, which must give
+ * the same values hex for hex, and checks that a shared grid without a ghost table is
+ * refused. Reports the throughput in member-steps per second.
+ */
+
+#include "RD_Ensemble.h"
+#include "RD_Base.h"
+#include "HexGrid.h"
+#include "HdfData.h"
+#include "tools.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+
+using namespace morph;
+using namespace std;
+
+/*!
+ * du/dt = D lap(u) - k u
+ */
+class DecayModel : public RD_Base<double>
+{
+public:
+    double D = 0.01;
+    double k = 1.0;
+    vector<double> u;
+    vector<double> lapu;
+
+    void allocate (void) {
+        RD_Base<double>::allocate();
+        this->resize_vector_variable (this->u);
+        this->resize_vector_variable (this->lapu);
+    }
+    void init (void) {
+        this->set_dt (0.2 * (3.0 * this->d * this->d / 2.0) / (6.0 * this->D));
+        for (unsigned int h = 0; h < this->nhex; ++h) {
+            this->u[h] = std::exp (-40.0 * (this->hg->d_x[h]*this->hg->d_x[h]
+                                            + this->hg->d_y[h]*this->hg->d_y[h]));
+        }
+    }
+    void step (void) {
+        if (this->k < 0.0) {
+            throw runtime_error ("DecayModel: negative decay rate");
+        }
+        if (this->ghostNeighbours == true) {
+            this->fill_ghosts (this->u);
+            this->compute_laplace_ghost (this->u, this->lapu);
+        } else {
+            this->compute_laplace (this->u, this->lapu);
+        }
+        for (unsigned int h = 0; h < this->nhex; ++h) {
+            this->u[h] += this->dt * (this->D * this->lapu[h] - this->k * this->u[h]);
+        }
+        ++this->stepCount;
+    }
+    void save (void) {
+        stringstream fname;
+        fname << this->logpath << "/u_" << setw(5) << setfill('0') << this->stepCount << ".h5";
+        HdfData data (fname.str());
+        data.add_contained_vals ("/u", this->u);
+        data.add_val ("/stepCount", this->stepCount);
+    }
+};
+
+// Remove an ensemble's log directories and the files in them
+void removeLogs (const string& logpath, unsigned int M)
+{
+    vector<string> files;
+    Tools::readDirectoryTree (files, logpath);
+    for (const string& f : files) {
+        Tools::unlinkFile (logpath + "/" + f);
+    }
+    for (unsigned int i = 0; i < M; ++i) {
+        stringstream mpath;
+        mpath << logpath << "/member_" << setw(3) << setfill('0') << i;
+        Tools::removeDir (mpath.str());
+    }
+    Tools::removeDir (logpath);
+}
+
+int main()
+{
+    int rtn = 0;
+    try {
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+
+        const unsigned int M = 24;
+        const unsigned int nsteps = 200;
+        auto setup = [](DecayModel& m, unsigned int i) { m.k = 0.5 + 0.25 * i; };
+
+        // Reference: the same ensemble stepped on one thread
+        RD_Ensemble<DecayModel> serial;
+        serial.hextohex_d = 0.01;
+        serial.svgpath = curvepath;
+        serial.logpath = "testrdensemble_serial";
+        serial.nthreads = 1;
+        serial.allocate (M, setup);
+        serial.run (nsteps);
+
+        RD_Ensemble<DecayModel> ens;
+        ens.hextohex_d = 0.01;
+        ens.svgpath = curvepath;
+        ens.logpath = "testrdensemble";
+        ens.nthreads = 4;
+        ens.allocate (M, setup);
+        ens.run (nsteps, 100);
+
+        cout << M << " members of " << ens.hg->num() << " hexes, " << nsteps << " steps: "
+             << serial.memberStepsPerSecond << " member-steps/s on 1 thread, "
+             << ens.memberStepsPerSecond << " on " << ens.nthreads << endl;
+
+        for (unsigned int i = 0; i < M; ++i) {
+            if (ens[i].hg != ens.hg || !ens[i].sharedHexGrid || ens[i].nhex != ens.hg->num()) {
+                cerr << "Member " << i << " doesn't use the shared HexGrid" << endl;
+                rtn = -1;
+            }
+            if (ens[i].stepCount != nsteps) {
+                cerr << "Member " << i << " took " << ens[i].stepCount << " steps" << endl;
+                rtn = -1;
+            }
+            if (ens[i].u != serial[i].u) {
+                cerr << "Member " << i << " differs from the serial run" << endl;
+                rtn = -1;
+            }
+            // Each member has its own decay rate, so no two should end up the same
+            if (i > 0 && ens[i].u == ens[i-1].u) {
+                cerr << "Members " << i-1 << " and " << i << " are identical" << endl;
+                rtn = -1;
+            }
+            for (unsigned int s = 100; s <= nsteps; s += 100) {
+                stringstream fname;
+                fname << ens.logpath << "/member_" << setw(3) << setfill('0') << i
+                      << "/u_" << setw(5) << setfill('0') << s << ".h5";
+                if (!Tools::fileExists (fname.str())) {
+                    cerr << "Missing " << fname.str() << endl;
+                    rtn = -1;
+                    continue;
+                }
+                HdfData data (fname.str(), true);
+                vector<double> u;
+                data.read_contained_vals ("/u", u);
+                if (u.size() != ens[i].nhex) {
+                    cerr << fname.str() << " holds " << u.size() << " values" << endl;
+                    rtn = -1;
+                }
+                if (s == nsteps && u != ens[i].u) {
+                    cerr << fname.str() << " doesn't hold the final state" << endl;
+                    rtn = -1;
+                }
+            }
+        }
+
+        // An exception in one member reaches the caller, once the others have stepped
+        ens[3].k = -1.0;
+        bool threw = false;
+        try {
+            ens.run (1);
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw) {
+            cerr << "run() didn't rethrow a member's exception" << endl;
+            rtn = -1;
+        }
+        if (ens[2].stepCount != nsteps + 1 || ens[4].stepCount != nsteps + 1) {
+            cerr << "The other members weren't stepped" << endl;
+            rtn = -1;
+        }
+
+        // The grid Hilbert ordered, with ghost neighbours: the members take their ghost
+        // slots from the shared grid, and each hex ends with the value it had above
+        RD_Ensemble<DecayModel> hens;
+        hens.hextohex_d = 0.01;
+        hens.svgpath = curvepath;
+        hens.logpath = "testrdensemble_hilbert";
+        hens.hilbertOrder = true;
+        hens.ghostNeighbours = true;
+        hens.nthreads = 4;
+        hens.allocate (M, setup);
+        hens.run (nsteps);
+        if (hens.hg->d_canonical.empty() || hens.hg->d_nbtab.empty()) {
+            cerr << "The shared grid wasn't reordered or has no ghost table" << endl;
+            rtn = -1;
+        }
+        for (unsigned int i = 0; i < M; ++i) {
+            if (hens[i].hg != hens.hg || hens[i].nghost != hens.hg->d_ghostsrc.size()
+                || hens[i].u.size() != hens[i].nhex + hens[i].nghost) {
+                cerr << "Member " << i << " doesn't have the shared grid's ghost slots" << endl;
+                rtn = -1;
+            }
+            vector<double> hu (hens[i].u.begin(), hens[i].u.begin() + hens[i].nhex);
+            vector<double> cu;
+            hens.hg->toCanonical (hu, cu);
+            if (cu != serial[i].u) {
+                cerr << "Member " << i << " of the reordered ensemble differs from the serial run" << endl;
+                rtn = -1;
+            }
+        }
+
+        // A shared grid without a ghost table is refused
+        DecayModel noghosts;
+        noghosts.ghostNeighbours = true;
+        noghosts.useHexGrid (ens.hg);
+        threw = false;
+        try {
+            noghosts.allocate();
+        } catch (const runtime_error& e) {
+            threw = true;
+        }
+        if (!threw) {
+            cerr << "allocate() accepted a shared grid without a ghost table" << endl;
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+
+    removeLogs ("testrdensemble_serial", 24);
+    removeLogs ("testrdensemble", 24);
+    removeLogs ("testrdensemble_hilbert", 24);
+
+    return rtn;
+}
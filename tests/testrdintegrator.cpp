@@ -0,0 +1,192 @@
+/*
+ * Test RDIntegrator. Checks that each scheme converges at its expected order on the
+ * decay equation, that RK4 on a diffusion problem over a HexGrid, with and without
+ * lowMemoryRK4, gives exactly the result of a textbook RK4 (reporting the time per step
+ * of each), and that the adaptive BS23 scheme follows a problem with a fast transient in few steps.
+ */
+
+#include "HexGrid.h"
+#include "HexKernels.h"
+#include "RDIntegrator.h"
+#include "ReadCurves.h"
+#include "tools.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+using namespace morph;
+using namespace std;
+using namespace std::chrono;
+
+// The error at t=1 in integrating dy/dt = -y from y=1 with nsteps steps
+double decayError (RDScheme s, unsigned int nsteps)
+{
+    RDIntegrator<double> integ;
+    integ.scheme = s;
+    vector<vector<double> > y (1, vector<double>(1, 1.0));
+    double dt = 1.0 / nsteps;
+    for (unsigned int i = 0; i < nsteps; ++i) {
+        integ.step (y, dt, [](vector<vector<double> >& yy, vector<vector<double> >& dy) {
+                dy[0][0] = -yy[0][0];
+            });
+    }
+    return fabs (y[0][0] - exp (-1.0));
+}
+
+int main()
+{
+    int rtn = 0;
+    try {
+        // Convergence order. Halving dt should divide the error by 2^order.
+        RDScheme schemes[3] = { RDScheme::Euler, RDScheme::RK2, RDScheme::RK4 };
+        double orders[3] = { 1.0, 2.0, 4.0 };
+        for (unsigned int si = 0; si < 3; ++si) {
+            double e1 = decayError (schemes[si], 20);
+            double e2 = decayError (schemes[si], 40);
+            double order = log2 (e1 / e2);
+            cout << "Scheme " << si << ": error " << e1 << " then " << e2 << ", order " << order << endl;
+            if (fabs (order - orders[si]) > 0.1) {
+                cerr << "Unexpected order of convergence" << endl;
+                rtn = -1;
+            }
+        }
+
+        // Adaptive stepping. Field 0 decays 50 times faster than field 1, so a fixed step
+        // small enough for its early transient would be wasted on the rest of the run; the
+        // adaptive step grows once the transient has passed.
+        {
+            RDIntegrator<double> integ;
+            integ.scheme = RDScheme::BS23;
+            integ.atol = { 1e-8, 1e-10 };
+            integ.rtol = { 1e-5, 1e-7 };
+            vector<vector<double> > y (2, vector<double>(3, 1.0));
+            double t = 0.0;
+            double T = 5.0;
+            double dt = 1e-5;
+            while (t < T) {
+                double h = std::min (dt, T - t);
+                t += integ.stepAdaptive (y, h, [](vector<vector<double> >& yy, vector<vector<double> >& dy) {
+                        for (unsigned int j = 0; j < yy[0].size(); ++j) {
+                            dy[0][j] = -50.0 * yy[0][j];
+                            dy[1][j] = -yy[1][j];
+                        }
+                    });
+                // Keep the proposal unless we shortened the step to land on T
+                if (t < T) { dt = h; }
+            }
+            double err0 = fabs (y[0][0] - exp (-250.0));
+            double err1 = fabs (y[1][0] - exp (-5.0));
+            cout << "BS23: " << integ.accepted << " steps accepted, " << integ.rejected
+                 << " rejected; errors " << err0 << ", " << err1 << endl;
+            if (err0 > 1e-6 || err1 > 1e-5) {
+                cerr << "Adaptive solution is inaccurate" << endl;
+                rtn = -1;
+            }
+            // At RD_Base's default dt of 1e-5, a fixed step would take 500000 steps
+            if (integ.accepted > 500) {
+                cerr << "Adaptive stepping took too many steps" << endl;
+                rtn = -1;
+            }
+        }
+
+        // Two diffusing, reacting fields on a HexGrid
+        string pwd = Tools::getPwd();
+        string curvepath = "../tests/trial.svg";
+        if (pwd.substr(pwd.length()-11) == "build/tests") {
+            curvepath = "../../tests/trial.svg";
+        }
+        ReadCurves r(curvepath);
+        HexGrid hg(0.005, 7, 0, HexDomainShape::Boundary);
+        hg.setBoundary (r.getCorticalPath());
+        unsigned int n = hg.num();
+
+        vector<vector<float> > y0 (2, vector<float>(n, 0.0f));
+        for (unsigned int i = 0; i < n; ++i) {
+            y0[0][i] = sin (10.0 * hg.d_x[i]) * cos (7.0 * hg.d_y[i]);
+            y0[1][i] = cos (5.0 * hg.d_x[i]);
+        }
+        float d = hg.getd();
+        float norm = 2.0f / (3.0f * d * d);
+        float dt = 0.00001f;
+        vector<float> lap (n);
+        auto rhs = [&](vector<vector<float> >& y, vector<vector<float> >& dy) {
+            HexKernels::laplace (hg, y[0].data(), lap.data(), n, norm);
+            for (unsigned int i = 0; i < n; ++i) {
+                dy[0][i] = 0.1f * lap[i] - y[0][i] * y[1][i];
+            }
+            HexKernels::laplace (hg, y[1].data(), lap.data(), n, norm);
+            for (unsigned int i = 0; i < n; ++i) {
+                dy[1][i] = 0.05f * lap[i] + y[0][i] * y[1][i];
+            }
+        };
+
+        unsigned int nsteps = 200;
+        vector<vector<float> > y1 = y0;
+        RDIntegrator<float> integ;
+        steady_clock::time_point t0 = steady_clock::now();
+        for (unsigned int s = 0; s < nsteps; ++s) {
+            integ.step (y1, dt, rhs);
+        }
+        steady_clock::time_point t1 = steady_clock::now();
+
+        // The three buffer RK4
+        vector<vector<float> > y3 = y0;
+        RDIntegrator<float> integlm;
+        integlm.lowMemoryRK4 = true;
+        steady_clock::time_point t4 = steady_clock::now();
+        for (unsigned int s = 0; s < nsteps; ++s) {
+            integlm.step (y3, dt, rhs);
+        }
+        steady_clock::time_point t5 = steady_clock::now();
+
+        // Textbook RK4
+        vector<vector<float> > y2 = y0;
+        vector<vector<float> > k1 = y0, k2 = y0, k3 = y0, k4 = y0, q = y0;
+        float halfdt = dt/2.0;
+        float sixthdt = dt/6.0;
+        steady_clock::time_point t2 = steady_clock::now();
+        for (unsigned int s = 0; s < nsteps; ++s) {
+            rhs (y2, k1);
+            for (unsigned int f = 0; f < 2; ++f) {
+                for (unsigned int i = 0; i < n; ++i) { q[f][i] = y2[f][i] + k1[f][i] * halfdt; }
+            }
+            rhs (q, k2);
+            for (unsigned int f = 0; f < 2; ++f) {
+                for (unsigned int i = 0; i < n; ++i) { q[f][i] = y2[f][i] + k2[f][i] * halfdt; }
+            }
+            rhs (q, k3);
+            for (unsigned int f = 0; f < 2; ++f) {
+                for (unsigned int i = 0; i < n; ++i) { q[f][i] = y2[f][i] + k3[f][i] * dt; }
+            }
+            rhs (q, k4);
+            for (unsigned int f = 0; f < 2; ++f) {
+                for (unsigned int i = 0; i < n; ++i) {
+                    y2[f][i] += (k1[f][i] + 2.0f * k2[f][i] + 2.0f * k3[f][i] + k4[f][i]) * sixthdt;
+                }
+            }
+        }
+        steady_clock::time_point t3 = steady_clock::now();
+
+        cout << n << " hexes, 2 fields. RDIntegrator RK4: "
+             << duration_cast<microseconds>(t1-t0).count()/nsteps << " us/step; with lowMemoryRK4: "
+             << duration_cast<microseconds>(t5-t4).count()/nsteps << " us/step; textbook RK4: "
+             << duration_cast<microseconds>(t3-t2).count()/nsteps << " us/step" << endl;
+
+        if (y1 != y2) {
+            cerr << "RDIntegrator RK4 differs from textbook RK4" << endl;
+            rtn = -1;
+        }
+        if (y3 != y2) {
+            cerr << "RDIntegrator RK4 with lowMemoryRK4 differs from textbook RK4" << endl;
+            rtn = -1;
+        }
+
+    } catch (const exception& e) {
+        cerr << "Caught exception: " << e.what() << endl;
+        cerr << "Current working directory: " << Tools::getPwd() << endl;
+        rtn = -1;
+    }
+    return rtn;
+}